@@ -0,0 +1,68 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+namespace {
+    struct Position {
+        float x {0.0f};
+        float y {0.0f};
+        float z {0.0f};
+    };
+    struct Velocity {
+        float value {1.0f};
+    };
+    struct Stunned {
+        uint32_t frames {0};
+    };
+}
+
+void bench_archetype_graph() {
+    static constexpr uint32_t kNumEntities = 100000;
+    static constexpr uint32_t kNumIterations = 20;
+
+    using namespace mustache;
+    World world;
+    auto& entities = world.entities();
+    auto& archetype = entities.getArchetype<Position, Velocity>();
+    const auto group = entities.createBatch(archetype, kNumEntities);
+    const auto stunned_id = ComponentFactory::registerComponent<Stunned>();
+
+    Benchmark benchmark;
+
+    Logger{}.hideContext().info("Target archetype lookup by mask (map lookup)");
+    benchmark.add([&archetype, &entities, stunned_id] {
+        for (uint32_t i = 0; i < kNumEntities; ++i) {
+            auto mask = archetype.componentMask();
+            mask.add(stunned_id);
+            auto& target = entities.getArchetype(mask, archetype.sharedComponentInfo());
+            if (&target == &archetype) {
+                throw std::runtime_error("invalid archetype");
+            }
+        }
+    }, kNumIterations);
+    benchmark.show();
+    benchmark.reset();
+
+    Logger{}.hideContext().info("Target archetype lookup by cached edge");
+    benchmark.add([&archetype, &entities, stunned_id] {
+        for (uint32_t i = 0; i < kNumEntities; ++i) {
+            auto& target = entities.getArchetypeWith(archetype, stunned_id);
+            if (&target == &archetype) {
+                throw std::runtime_error("invalid archetype");
+            }
+        }
+    }, kNumIterations);
+    benchmark.show();
+    benchmark.reset();
+
+    Logger{}.hideContext().info("assign + removeComponent");
+    benchmark.add([&entities, &group] {
+        for (const auto entity : group) {
+            entities.assign<Stunned>(entity);
+        }
+        for (const auto entity : group) {
+            entities.removeComponent<Stunned>(entity);
+        }
+    }, kNumIterations);
+    benchmark.show();
+}
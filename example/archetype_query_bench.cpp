@@ -0,0 +1,100 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+#include <random>
+#include <string>
+
+namespace {
+    struct QueryA {
+        uint32_t value {0};
+    };
+    struct QueryB {
+        uint32_t value {0};
+    };
+
+    mustache::ComponentId runtimeComponent(uint32_t index) {
+        mustache::ComponentInfo info;
+        info.name = "archetype_query_bench::Component" + std::to_string(index);
+        info.size = sizeof(uint32_t);
+        info.align = alignof(uint32_t);
+        info.type_id_hash_code = std::hash<std::string>{}(info.name);
+        info.is_trivially_relocatable = true;
+        return mustache::ComponentFactory::componentId(info);
+    }
+}
+
+void bench_archetype_query() {
+    static constexpr uint32_t kNumComponents = 48;
+    static constexpr uint32_t kComponentsPerArchetype = 6;
+    static constexpr uint32_t kNumIterations = 100;
+
+    using namespace mustache;
+
+    std::vector<ComponentId> components;
+    for (uint32_t i = 0; i < kNumComponents; ++i) {
+        components.push_back(runtimeComponent(i));
+    }
+    const auto query_a = ComponentFactory::registerComponent<QueryA>();
+    const auto query_b = ComponentFactory::registerComponent<QueryB>();
+    const auto query_mask = ComponentFactory::makeMask<QueryA, QueryB>();
+
+    for (const uint32_t archetype_count : {1000u, 10000u}) {
+        World world;
+        auto& entities = world.entities();
+        std::mt19937 random{42u};
+        std::uniform_int_distribution<uint32_t> component_dist{0u, kNumComponents - 1u};
+        while (entities.getArchetypesCount() < archetype_count) {
+            ComponentIdMask mask;
+            for (uint32_t i = 0; i < kComponentsPerArchetype; ++i) {
+                mask.add(components[component_dist(random)]);
+            }
+            // about 1% of archetypes match the query
+            if (random() % 100u == 0u) {
+                mask.add(query_a);
+                mask.add(query_b);
+            } else if (random() % 2u == 0u) {
+                mask.add(query_a);
+            }
+            auto& archetype = entities.getArchetype(mask, SharedComponentsInfo{});
+            if (archetype.size() == 0u) {
+                (void) entities.create(archetype);
+            }
+        }
+
+        Logger{}.hideContext().info("Query matching, archetypes: %d, linear scan", archetype_count);
+        std::vector<ArchetypeIndex> found;
+        Benchmark benchmark;
+        benchmark.add([&entities, &found, &query_mask] {
+            found.clear();
+            for (uint32_t i = 0; i < entities.getArchetypesCount(); ++i) {
+                auto& archetype = entities.getArchetype(ArchetypeIndex::make(i));
+                if (archetype.isMatch(query_mask)) {
+                    found.push_back(archetype.id());
+                }
+            }
+        }, kNumIterations);
+        benchmark.show();
+        benchmark.reset();
+
+        Logger{}.hideContext().info("Query matching, archetypes: %d, component index", archetype_count);
+        benchmark.add([&entities, &found, &query_mask] {
+            found.clear();
+            entities.findArchetypes(query_mask, SharedComponentIdMask{}, found);
+        }, kNumIterations);
+        benchmark.show();
+        benchmark.reset();
+
+        Logger{}.hideContext().info("Cold forEach (match cache built from scratch), archetypes: %d", archetype_count);
+        benchmark.add([&entities] {
+            uint32_t count = 0;
+            entities.forEach([&count](const QueryA&, const QueryB&) {
+                ++count;
+            });
+            if (count == 0u) {
+                throw std::runtime_error("no matching entities");
+            }
+        }, kNumIterations);
+        benchmark.show();
+    }
+}
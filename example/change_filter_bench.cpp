@@ -0,0 +1,57 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+#include <random>
+
+namespace {
+    struct Position {
+        float x {0.0f};
+        float y {0.0f};
+        float z {0.0f};
+    };
+
+    struct ChangedPositionJob : public mustache::PerEntityJob<ChangedPositionJob> {
+        uint32_t count = 0u;
+        void operator() (const Position&) {
+            ++count;
+        }
+        [[nodiscard]] mustache::ComponentIdMask checkMask() const noexcept override {
+            return mustache::ComponentFactory::makeMask<Position>();
+        }
+    };
+}
+
+void bench_change_filter() {
+    static constexpr uint32_t kNumEntities = 1000000;
+    static constexpr uint32_t kNumIterations = 100;
+
+    using namespace mustache;
+    World world;
+    auto& entities = world.entities();
+    std::vector<Entity> created;
+    created.reserve(kNumEntities);
+    for (uint32_t i = 0; i < kNumEntities; ++i) {
+        created.push_back(entities.create<Position>());
+    }
+    ChangedPositionJob job;
+    job.run(world);
+
+    for (const uint32_t num_changed : {300u, 3000u}) {
+        std::mt19937 random{42u};
+        uint64_t visited = 0u;
+        Logger{}.hideContext().info("Change filtered job, entities: %d, changed: %d", kNumEntities, num_changed);
+        Benchmark benchmark;
+        benchmark.add([&] {
+            world.update();
+            for (uint32_t i = 0; i < num_changed; ++i) {
+                entities.getComponent<Position>(created[random() % kNumEntities])->x += 1.0f;
+            }
+            job.count = 0u;
+            job.run(world);
+            visited += job.count;
+        }, kNumIterations);
+        benchmark.show();
+        Logger{}.hideContext().info("Visited entities per run: %d", static_cast<uint32_t>(visited / kNumIterations));
+    }
+}
@@ -0,0 +1,99 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+#include <array>
+
+namespace {
+    struct Position {
+        float x {0.0f};
+        float y {0.0f};
+        float z {0.0f};
+    };
+    struct Payload {
+        std::array<float, 96> values {};
+    };
+
+    // one runtime component per small archetype
+    mustache::ComponentId markerComponent(uint32_t index) {
+        mustache::ComponentInfo info;
+        info.name = "chunk_capacity_bench::Marker" + std::to_string(index);
+        info.size = sizeof(uint32_t);
+        info.align = alignof(uint32_t);
+        info.type_id_hash_code = std::hash<std::string>{}(info.name);
+        info.is_trivially_relocatable = true;
+        return mustache::ComponentFactory::componentId(info);
+    }
+}
+
+void bench_chunk_capacity() {
+    static constexpr uint32_t kNumSmallArchetypes = 100;
+    static constexpr uint32_t kEntitiesPerSmallArchetype = 20;
+    static constexpr uint32_t kNumLargeEntities = 100000;
+    static constexpr uint32_t kNumIterations = 50;
+
+    using namespace mustache;
+
+    std::vector<ComponentId> markers;
+    for (uint32_t i = 0; i < kNumSmallArchetypes; ++i) {
+        markers.push_back(markerComponent(i));
+    }
+
+    // 1MB is close to the old fixed 16K rows for Position + Payload
+    for (const uint32_t chunk_bytes : {16u * 1024u, 64u * 1024u, 1024u * 1024u}) {
+        World world;
+        auto& entities = world.entities();
+        entities.setArchetypeChunkBytes(chunk_bytes);
+
+        size_t allocated = 0u;
+        for (const auto& marker : markers) {
+            ComponentIdMask mask;
+            mask.add(ComponentFactory::registerComponent<Position>());
+            mask.add(marker);
+            auto& archetype = entities.getArchetype(mask, SharedComponentsInfo{});
+            (void) entities.createBatch(archetype, kEntitiesPerSmallArchetype);
+            allocated += archetype.capacity() * (sizeof(Position) + sizeof(uint32_t));
+        }
+        auto& large = entities.getArchetype<Position, Payload>();
+        (void) entities.createBatch(large, kNumLargeEntities);
+        allocated += large.capacity() * (sizeof(Position) + sizeof(Payload));
+
+        Logger{}.hideContext().info("Chunk bytes: %d, small archetype capacity: %d, large archetype capacity: %d, "
+                                    "allocated: %d KB", chunk_bytes,
+                                    entities.getArchetype(ArchetypeIndex::make(0)).dataChunkCapacity().toInt(),
+                                    large.dataChunkCapacity().toInt(), static_cast<uint32_t>(allocated / 1024u));
+        Benchmark benchmark;
+        benchmark.add([&entities] {
+            entities.forEach([](Position& position, const Payload& payload) {
+                position.x += payload.values[0];
+            });
+        }, kNumIterations);
+        benchmark.show();
+    }
+
+    // rare archetypes with a few entities each
+    for (const uint32_t initial_capacity : {0u, 4u}) {
+        World world;
+        auto& entities = world.entities();
+        entities.setDefaultInitialChunkCapacity(initial_capacity);
+        size_t allocated = 0u;
+        Benchmark benchmark;
+        benchmark.add([&entities, &markers, &allocated] {
+            allocated = 0u;
+            for (const auto& marker : markers) {
+                ComponentIdMask mask;
+                mask.add(ComponentFactory::registerComponent<Position>());
+                mask.add(marker);
+                auto& archetype = entities.getArchetype(mask, SharedComponentsInfo{});
+                for (uint32_t i = 0; i < 3u; ++i) {
+                    (void) entities.create(archetype);
+                }
+                allocated += archetype.capacity() * (sizeof(Position) + sizeof(uint32_t));
+            }
+            entities.clear();
+        }, 1);
+        Logger{}.hideContext().info("Rare archetypes: %d x 3 entities, initial chunk capacity: %d, allocated: %d KB",
+                                    kNumSmallArchetypes, initial_capacity, static_cast<uint32_t>(allocated / 1024u));
+        benchmark.show();
+    }
+}
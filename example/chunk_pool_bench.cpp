@@ -0,0 +1,49 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+namespace {
+    struct Position {
+        float x {0.0f};
+        float y {0.0f};
+        float z {0.0f};
+    };
+    struct Velocity {
+        float value {1.0f};
+    };
+}
+
+void bench_chunk_pool() {
+    static constexpr uint32_t kNumEntities = 100000;
+    static constexpr uint32_t kNumIterations = 50;
+
+    using namespace mustache;
+
+    World world;
+    auto& entities = world.entities();
+    entities.setDefaultInitialChunkCapacity(64u);
+    std::vector<Entity> created;
+    for (uint32_t i = 0; i < kNumEntities; ++i) {
+        created.push_back(entities.create<Position>());
+    }
+
+    Logger{}.hideContext().info("Migrate %d entities between archetypes, release emptied chunks", kNumEntities);
+    Benchmark benchmark;
+    benchmark.add([&entities, &created] {
+        // chunks released by one archetype are allocated by another one
+        for (auto entity : created) {
+            entities.assign<Velocity>(entity);
+        }
+        entities.shrinkToFit();
+        for (auto entity : created) {
+            entities.removeComponent<Velocity>(entity);
+        }
+        entities.shrinkToFit();
+    }, kNumIterations);
+    benchmark.show();
+
+    const auto statistics = world.memoryManager().chunkPoolStatistics();
+    Logger{}.hideContext().info("Chunk pool hits: %d, misses: %d, pooled: %d KB",
+                                static_cast<uint32_t>(statistics.hits), static_cast<uint32_t>(statistics.misses),
+                                static_cast<uint32_t>(statistics.pooled_bytes / 1024u));
+}
@@ -0,0 +1,58 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+#include <algorithm>
+
+namespace {
+    struct Spawner {
+        uint32_t counter {0};
+    };
+    struct Position {
+        float x {0.0f};
+        float y {0.0f};
+        float z {0.0f};
+    };
+    struct Velocity {
+        float value {1.0f};
+    };
+}
+
+void bench_command_buffer() {
+    static constexpr uint32_t kNumSpawners = 100000;
+    static constexpr uint32_t kNumIterations = 10;
+
+    using namespace mustache;
+
+    std::vector<uint32_t> thread_counts {1u, 2u, 4u, 8u, Dispatcher::maxThreadCount()};
+    std::sort(thread_counts.begin(), thread_counts.end());
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+    for (const auto& thread_count : thread_counts) {
+        if (thread_count > Dispatcher::maxThreadCount()) {
+            continue;
+        }
+        for (const bool parallel_apply : {false, true}) {
+            WorldContext context;
+            // main thread takes part in parallel jobs
+            context.dispatcher = std::make_shared<Dispatcher>(std::max(thread_count - 1u, 1u));
+            context.dispatcher->setSingleThreadMode(thread_count < 2u);
+            World world{context};
+            auto& entities = world.entities();
+            entities.setParallelCommandApply(parallel_apply);
+            (void) entities.createBatch<Spawner>(kNumSpawners);
+
+            Logger{}.hideContext().info("Create entities from kParallel job, threads: %d, parallel apply: %s",
+                                        thread_count, parallel_apply ? "on" : "off");
+            Benchmark benchmark;
+            benchmark.add([&entities] {
+                // entities are created while EntityManager is locked and applied on unlock
+                entities.forEach([&entities](Spawner& spawner) {
+                    const auto entity = entities.create<Position>();
+                    entities.assign<Velocity>(entity, static_cast<float>(++spawner.counter));
+                }, JobRunMode::kParallel);
+            }, kNumIterations);
+            benchmark.show();
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+#include <cmath>
+
+namespace {
+    struct Position {
+        float x {0.0f};
+        float y {0.0f};
+        float z {0.0f};
+    };
+    struct Velocity {
+        float value {1.0f};
+    };
+
+    struct MoveJob : public mustache::PerEntityJob<MoveJob> {
+        void operator() (Position& position, const Velocity& velocity) {
+            position.x += velocity.value * std::sin(position.y);
+            position.y += velocity.value * std::cos(position.x);
+        }
+    };
+}
+
+void bench_dispatcher_scaling() {
+    static constexpr uint32_t kNumEntities = 1000000;
+    static constexpr uint32_t kNumItems = 1000000;
+    static constexpr uint32_t kNumIterations = 50;
+
+    using namespace mustache;
+
+    for (const uint32_t thread_count : {1u, 2u, 4u, 8u, 16u, 32u, 64u}) {
+        WorldContext context;
+        context.dispatcher = std::make_shared<Dispatcher>(thread_count);
+        World world{context};
+        auto& dispatcher = world.dispatcher();
+
+        std::vector<float> values(kNumItems, 1.0f);
+        Logger{}.hideContext().info("parallelFor, items: %d, threads: %d, tasks: %d", kNumItems, thread_count,
+                                    thread_count * 4u);
+        Benchmark benchmark;
+        benchmark.add([&dispatcher, &values, thread_count] {
+            dispatcher.parallelFor([&values](size_t index) {
+                values[index] = std::sqrt(values[index] + 1.0f);
+            }, 0u, values.size(), thread_count * 4u);
+        }, kNumIterations);
+        benchmark.show();
+
+        auto& entities = world.entities();
+        (void) entities.createBatch<Position, Velocity>(kNumEntities);
+        MoveJob job;
+        Logger{}.hideContext().info("PerEntityJob kParallel, entities: %d, threads: %d", kNumEntities, thread_count);
+        benchmark.reset();
+        benchmark.add([&job, &world] {
+            job.run(world, JobRunMode::kParallel);
+        }, kNumIterations);
+        benchmark.show();
+    }
+}
@@ -0,0 +1,47 @@
+#include <mustache/utils/dispatch.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/timer.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <vector>
+
+void bench_dispatcher_wait() {
+    static constexpr uint32_t kNumFrames = 2000;
+    static constexpr uint32_t kNumItems = 20000;
+
+    using namespace mustache;
+
+    const auto cores = std::max(Dispatcher::maxThreadCount(), 2u);
+    for (const uint32_t thread_count : {cores - 1u, cores * 4u}) {
+        Dispatcher dispatcher{thread_count};
+        std::vector<float> values(kNumItems, 1.0f);
+        std::vector<double> frame_times;
+        frame_times.reserve(kNumFrames);
+
+        // process CPU time includes workers spinning while the frame waits for them
+        const auto cpu_begin = std::clock();
+        Timer timer;
+        for (uint32_t frame = 0; frame < kNumFrames; ++frame) {
+            Timer frame_timer;
+            dispatcher.parallelFor([&values](size_t index) {
+                values[index] = std::sqrt(values[index] + 1.0f);
+            }, 0u, values.size(), thread_count + 1u);
+            frame_times.push_back(frame_timer.elapsed() * 1000000.0);
+        }
+        const auto wall_ms = timer.elapsed() * 1000.0;
+        const auto cpu_ms = 1000.0 * static_cast<double>(std::clock() - cpu_begin) / CLOCKS_PER_SEC;
+
+        std::sort(frame_times.begin(), frame_times.end());
+        const auto percentile = [&frame_times](double value) {
+            return frame_times[static_cast<size_t>(value * static_cast<double>(frame_times.size() - 1u))];
+        };
+        Logger{}.hideContext().info("Frames: %d, threads: %d, cores: %d", kNumFrames, thread_count,
+                                    Dispatcher::maxThreadCount());
+        Logger{}.hideContext().info("Frame time us, p50: %f, p99: %f, p99.9: %f, max: %f",
+                                    percentile(0.5), percentile(0.99), percentile(0.999), frame_times.back());
+        Logger{}.hideContext().info("Wall time per frame: %fus, CPU time per frame: %fus",
+                                    1000.0 * wall_ms / kNumFrames, 1000.0 * cpu_ms / kNumFrames);
+    }
+}
@@ -0,0 +1,71 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+namespace {
+    struct Position {
+        float x {0.0f};
+        float y {0.0f};
+        float z {0.0f};
+    };
+    struct Velocity {
+        float value {1.0f};
+    };
+    struct Active {
+    };
+}
+
+void bench_enable() {
+    static constexpr uint32_t kNumEntities = 100000;
+    static constexpr uint32_t kToggleStep = 10; // every 10th entity flips per iteration
+    static constexpr uint32_t kNumIterations = 20;
+
+    using namespace mustache;
+
+    {
+        World world;
+        auto& entities = world.entities();
+        std::vector<Entity> created;
+        for (uint32_t i = 0; i < kNumEntities; ++i) {
+            created.push_back(entities.create<Position, Velocity, Active>());
+        }
+        Logger{}.hideContext().info("Toggle by assign/removeComponent + iterate");
+        Benchmark benchmark;
+        uint32_t iteration = 0u;
+        benchmark.add([&] {
+            for (uint32_t i = iteration % kToggleStep; i < kNumEntities; i += kToggleStep) {
+                if (entities.hasComponent<Active>(created[i])) {
+                    entities.removeComponent<Active>(created[i]);
+                } else {
+                    entities.assign<Active>(created[i]);
+                }
+            }
+            ++iteration;
+            entities.forEach([](Position& position, const Velocity& velocity, const Active&) {
+                position.x += velocity.value;
+            });
+        }, kNumIterations);
+        benchmark.show();
+    }
+    {
+        World world;
+        auto& entities = world.entities();
+        std::vector<Entity> created;
+        for (uint32_t i = 0; i < kNumEntities; ++i) {
+            created.push_back(entities.create<Position, Velocity, Active>());
+        }
+        Logger{}.hideContext().info("Toggle by setEnabled + iterate");
+        Benchmark benchmark;
+        uint32_t iteration = 0u;
+        benchmark.add([&] {
+            for (uint32_t i = iteration % kToggleStep; i < kNumEntities; i += kToggleStep) {
+                entities.setEnabled<Active>(created[i], !entities.isEnabled<Active>(created[i]));
+            }
+            ++iteration;
+            entities.forEach([](Position& position, const Velocity& velocity, const Active&) {
+                position.x += velocity.value;
+            });
+        }, kNumIterations);
+        benchmark.show();
+    }
+}
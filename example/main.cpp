@@ -1,5 +1,45 @@
 #include <mustache/ecs/ecs.hpp>
 
+#include <map>
+#include <string>
+
+void bench_events();
+void bench_archetype_graph();
+void bench_command_buffer();
+void bench_archetype_query();
+void bench_change_filter();
+void bench_enable();
+void bench_tags();
+void bench_chunk_capacity();
+void bench_shrink();
+void bench_chunk_pool();
+void bench_tlb();
+void bench_dispatcher_scaling();
+void bench_dispatcher_wait();
+void bench_task_submit();
+void bench_system_schedule();
+
+namespace {
+    // mustache_example --bench [name]
+    const std::map<std::string, void(*)()> benchmarks {
+            {"events", &bench_events},
+            {"archetype_graph", &bench_archetype_graph},
+            {"command_buffer", &bench_command_buffer},
+            {"archetype_query", &bench_archetype_query},
+            {"change_filter", &bench_change_filter},
+            {"enable", &bench_enable},
+            {"tags", &bench_tags},
+            {"chunk_capacity", &bench_chunk_capacity},
+            {"shrink", &bench_shrink},
+            {"chunk_pool", &bench_chunk_pool},
+            {"tlb", &bench_tlb},
+            {"dispatcher_scaling", &bench_dispatcher_scaling},
+            {"dispatcher_wait", &bench_dispatcher_wait},
+            {"task_submit", &bench_task_submit},
+            {"system_schedule", &bench_system_schedule},
+    };
+}
+
 namespace {
     struct Vec3 {
         float x {0.0f};
@@ -65,7 +105,16 @@ void createEntities(mustache::World& world, uint32_t entities_count, uint32_t mo
     }
 }
 
-int main() {
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string{argv[1]} == "--bench") {
+        for (const auto& [name, function] : benchmarks) {
+            if (argc < 3 || name == argv[2]) {
+                function();
+            }
+        }
+        return 0;
+    }
+
     constexpr uint32_t entities_count = 10;
     constexpr float dt = 1.0f / 60.0f;
 
@@ -0,0 +1,65 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+#include <array>
+#include <fstream>
+
+namespace {
+    struct Position {
+        float x {0.0f};
+        float y {0.0f};
+        float z {0.0f};
+    };
+    struct Payload {
+        std::array<float, 32> values {};
+    };
+
+    // resident set size in KB, 0 if unknown
+    uint32_t residentKb() {
+#ifdef __linux__
+        std::ifstream statm{"/proc/self/statm"};
+        uint64_t size = 0u;
+        uint64_t resident = 0u;
+        if (statm >> size >> resident) {
+            return static_cast<uint32_t>(resident * 4u);
+        }
+#endif
+        return 0u;
+    }
+}
+
+void bench_shrink() {
+    static constexpr uint32_t kNumEntities = 500000;
+
+    using namespace mustache;
+
+    for (const bool decommit : {false, true}) {
+        World world;
+        world.memoryManager().setDecommitSize(decommit ? 16u * 1024u : 0u);
+        auto& entities = world.entities();
+        const auto before = residentKb();
+        (void) entities.createBatch<Position, Payload>(kNumEntities);
+        const auto peak = residentKb();
+        entities.clear();
+        const auto after_clear = residentKb();
+
+        Benchmark benchmark;
+        benchmark.add([&entities] {
+            entities.shrinkToFit();
+        }, 1);
+        const auto after_shrink = residentKb();
+        Logger{}.hideContext().info("Wave of %d entities, decommit: %s, RSS KB before: %d, peak: %d, "
+                                    "after clear: %d, after shrinkToFit: %d", kNumEntities, decommit ? "on" : "off",
+                                    before, peak, after_clear, after_shrink);
+        benchmark.show();
+
+        Logger{}.hideContext().info("Second wave after shrinkToFit, decommit: %s", decommit ? "on" : "off");
+        benchmark.reset();
+        benchmark.add([&entities] {
+            (void) entities.createBatch<Position, Payload>(kNumEntities);
+        }, 1);
+        benchmark.show();
+        entities.clear();
+    }
+}
@@ -0,0 +1,64 @@
+#include <mustache/ecs/world.hpp>
+#include <mustache/ecs/system.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/timer.hpp>
+
+#include <cmath>
+#include <vector>
+#include <utility>
+
+namespace {
+    constexpr uint32_t kNumSystems = 60u;
+    constexpr uint32_t kWorkSize = 20000u;
+
+    template<size_t _I>
+    struct ScheduleData {
+        float value = 0.0f;
+    };
+
+    template<size_t _I>
+    struct ScheduleSystem : public mustache::System<ScheduleSystem<_I> > {
+        void onConfigure(mustache::World&, mustache::SystemConfig& config) override {
+            config.writes<ScheduleData<_I> >();
+            // every sixth system consumes data of the previous one, the rest touch disjoint data
+            if constexpr (_I % 6u == 5u) {
+                config.reads<ScheduleData<_I - 1u> >();
+            }
+            values_.assign(kWorkSize, 1.0f);
+        }
+        void onUpdate(mustache::World&) override {
+            for (auto& value : values_) {
+                value = std::sqrt(value + 1.0f);
+            }
+        }
+        std::vector<float> values_;
+    };
+
+    template<size_t... _I>
+    void addSystems(mustache::SystemManager& systems, std::index_sequence<_I...>) {
+        (systems.addSystem<ScheduleSystem<_I> >(), ...);
+    }
+}
+
+void bench_system_schedule() {
+    static constexpr uint32_t kNumFrames = 500;
+
+    using namespace mustache;
+
+    for (const bool parallel : {false, true}) {
+        WorldContext context;
+        context.dispatcher = std::make_shared<Dispatcher>();
+        World world{context};
+        addSystems(world.systems(), std::make_index_sequence<kNumSystems>());
+        world.systems().setParallelUpdate(parallel);
+        world.init();
+
+        Timer timer;
+        for (uint32_t frame = 0; frame < kNumFrames; ++frame) {
+            world.update();
+        }
+        Logger{}.hideContext().info("Systems: %d, parallel: %s, threads: %d, frame time: %fus", kNumSystems,
+                                    parallel ? "true" : "false", world.dispatcher().threadCount(),
+                                    1000000.0 * timer.elapsed() / kNumFrames);
+    }
+}
@@ -0,0 +1,63 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+namespace {
+    struct Position {
+        float x {0.0f};
+        float y {0.0f};
+        float z {0.0f};
+    };
+    struct Velocity {
+        float value {1.0f};
+    };
+
+    template<size_t>
+    struct Tag {
+    };
+
+    // same marker with one byte of state, it gets a column like any other component
+    template<size_t>
+    struct ByteTag {
+        char value {0};
+    };
+
+    template<template<size_t> class _Tag, size_t... _I>
+    void benchTags(const char* name, std::index_sequence<_I...>) {
+        static constexpr uint32_t kNumEntities = 100000;
+        static constexpr uint32_t kNumIterations = 20;
+
+        using namespace mustache;
+
+        World world;
+        auto& entities = world.entities();
+        Logger{}.hideContext().info("%s: create %d entities with %d markers", name, kNumEntities, sizeof...(_I));
+        Benchmark benchmark;
+        benchmark.add([&entities] {
+            entities.clear();
+            (void) entities.createBatch<Position, Velocity, _Tag<_I>...>(kNumEntities);
+        }, kNumIterations);
+        benchmark.show();
+        benchmark.reset();
+
+        Logger{}.hideContext().info("%s: remove and assign one marker of every 10th entity", name);
+        std::vector<Entity> created;
+        entities.forEach([&created](Entity entity, const Position&) {
+            created.push_back(entity);
+        });
+        benchmark.add([&entities, &created] {
+            for (uint32_t i = 0; i < created.size(); i += 10u) {
+                entities.removeComponent<_Tag<0> >(created[i]);
+            }
+            for (uint32_t i = 0; i < created.size(); i += 10u) {
+                entities.assign<_Tag<0> >(created[i]);
+            }
+        }, kNumIterations);
+        benchmark.show();
+    }
+}
+
+void bench_tags() {
+    benchTags<Tag>("Empty tags", std::make_index_sequence<16>{});
+    benchTags<ByteTag>("Byte markers", std::make_index_sequence<16>{});
+}
@@ -0,0 +1,79 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+#include <array>
+
+namespace {
+    struct Position {
+        float x {0.0f};
+        float y {0.0f};
+        float z {0.0f};
+    };
+
+    struct SmallJob : public mustache::PerEntityJob<SmallJob> {
+        void operator() (Position& position) {
+            position.x += 1.0f;
+        }
+    };
+}
+
+void bench_task_submit() {
+    static constexpr uint32_t kNumTasks = 256;
+    static constexpr uint32_t kNumFrames = 2000;
+
+    using namespace mustache;
+
+    Dispatcher dispatcher;
+    std::array<uint32_t, kNumTasks> results{};
+    // capture of the same size as BaseJob::runParallel closure, too large for std::function small buffer
+    std::array<uint64_t, 8> payload{};
+
+    Logger{}.hideContext().info("Submit %d small tasks per frame, std::function per task", kNumTasks);
+    Benchmark benchmark;
+    benchmark.add([&dispatcher, &results, payload] {
+        for (uint32_t i = 0; i < kNumTasks; ++i) {
+            Job job = [&results, payload, i](ThreadId) {
+                results[i] += static_cast<uint32_t>(payload[0]) + 1u;
+            };
+            dispatcher.addParallelTask(std::move(job));
+        }
+        dispatcher.waitForParallelFinish();
+    }, kNumFrames);
+    benchmark.show();
+
+    Logger{}.hideContext().info("Submit %d small tasks per frame, inline tasks", kNumTasks);
+    benchmark.reset();
+    benchmark.add([&dispatcher, &results, payload] {
+        for (uint32_t i = 0; i < kNumTasks; ++i) {
+            dispatcher.addParallelTask([&results, payload, i](ThreadId) {
+                results[i] += static_cast<uint32_t>(payload[0]) + 1u;
+            });
+        }
+        dispatcher.waitForParallelFinish();
+    }, kNumFrames);
+    benchmark.show();
+
+    Logger{}.hideContext().info("Submit %d small tasks per frame, one addParallelTasks", kNumTasks);
+    benchmark.reset();
+    benchmark.add([&dispatcher, &results, payload] {
+        auto function = [&results, payload](ParallelTaskId task_id) {
+            results[task_id.toInt()] += static_cast<uint32_t>(payload[0]) + 1u;
+        };
+        dispatcher.addParallelTasks(kNumTasks, function);
+        dispatcher.waitForParallelFinish();
+    }, kNumFrames);
+    benchmark.show();
+
+    WorldContext context;
+    context.dispatcher = std::make_shared<Dispatcher>();
+    World world{context};
+    (void) world.entities().createBatch<Position>(1000u);
+    SmallJob job;
+    Logger{}.hideContext().info("PerEntityJob kParallel over 1000 entities per frame");
+    benchmark.reset();
+    benchmark.add([&job, &world] {
+        job.run(world, JobRunMode::kParallel);
+    }, kNumFrames);
+    benchmark.show();
+}
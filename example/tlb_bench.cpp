@@ -0,0 +1,134 @@
+#include <mustache/ecs/ecs.hpp>
+#include <mustache/utils/logger.hpp>
+#include <mustache/utils/benchmark.hpp>
+
+#include <array>
+#include <random>
+#include <algorithm>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    struct Position {
+        float x {0.0f};
+        float y {0.0f};
+        float z {0.0f};
+    };
+    struct Payload {
+        std::array<float, 13> values {};
+    };
+
+    // dTLB read misses of the calling thread, not available without perf_event_open permissions
+    class DtlbCounter {
+    public:
+        DtlbCounter() {
+#ifdef __linux__
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.size = sizeof(attr);
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8u) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16u);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+        }
+        ~DtlbCounter() {
+#ifdef __linux__
+            if (fd_ >= 0) {
+                close(fd_);
+            }
+#endif
+        }
+        [[nodiscard]] bool available() const noexcept {
+            return fd_ >= 0;
+        }
+        void start() noexcept {
+#ifdef __linux__
+            if (available()) {
+                ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+        }
+        uint64_t stop() noexcept {
+            uint64_t result = 0u;
+#ifdef __linux__
+            if (available()) {
+                ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fd_, &result, sizeof(result)) != sizeof(result)) {
+                    result = 0u;
+                }
+            }
+#endif
+            return result;
+        }
+    private:
+        int fd_ = -1;
+    };
+
+    const char* backendName(mustache::MemoryManager::ChunkBackend backend) {
+        switch (backend) {
+            case mustache::MemoryManager::ChunkBackend::kMalloc:
+                return "malloc";
+            case mustache::MemoryManager::ChunkBackend::kMmap:
+                return "mmap + THP";
+            case mustache::MemoryManager::ChunkBackend::kHugeTlb:
+                return "mmap + MAP_HUGETLB";
+        }
+        return "unknown";
+    }
+}
+
+void bench_tlb() {
+    static constexpr uint32_t kNumEntities = 2000000;
+    static constexpr uint32_t kNumIterations = 10;
+    static constexpr size_t kArenaSize = 256u * 1024u * 1024u;
+
+    using namespace mustache;
+    using ChunkBackend = MemoryManager::ChunkBackend;
+
+    for (const auto backend : {ChunkBackend::kMalloc, ChunkBackend::kMmap, ChunkBackend::kHugeTlb}) {
+        WorldContext context;
+        context.memory_manager = std::make_shared<MemoryManager>(backend, kArenaSize);
+        World world{context};
+        auto& entities = world.entities();
+        std::vector<Entity> created;
+        created.reserve(kNumEntities);
+        for (uint32_t i = 0; i < kNumEntities; ++i) {
+            created.push_back(entities.create<Position, Payload>());
+        }
+        std::shuffle(created.begin(), created.end(), std::mt19937{42u});
+
+        Logger{}.hideContext().info("Random access to %d entities, chunk backend: %s", kNumEntities,
+                                    backendName(world.memoryManager().chunkBackend()));
+        DtlbCounter counter;
+        uint64_t misses = 0u;
+        float sum = 0.0f;
+        Benchmark benchmark;
+        benchmark.add([&entities, &created, &counter, &misses, &sum] {
+            counter.start();
+            for (auto entity : created) {
+                sum += entities.getComponent<Payload>(entity)->values[0];
+                entities.getComponent<Position>(entity)->x += 1.0f;
+            }
+            misses += counter.stop();
+        }, kNumIterations);
+        benchmark.show();
+        if (counter.available()) {
+            Logger{}.hideContext().info("dTLB read misses per iteration: %d, sum: %f",
+                                        static_cast<uint32_t>(misses / kNumIterations), sum);
+        } else {
+            Logger{}.hideContext().info("dTLB read misses per iteration: n/a (perf_event_open failed), sum: %f",
+                                        sum);
+        }
+    }
+}
@@ -106,6 +106,8 @@ namespace converter {
             type_info.default_value.resize(info.size);
             memcpy(type_info.default_value.data(), info.default_value, info.size);
         }
+        type_info.is_tag = info.size == 0u;
+        type_info.uses_world = info.functions.create != nullptr;
         return type_info;
     }
 
@@ -301,6 +303,12 @@ Job* makeJob(JobDescriptor info) {
     for (uint32_t i = 0; i < info.check_update_size; ++i) {
         job->version_check_mask.set(convert(info.check_update[i]), true);
     }
+    for (uint32_t i = 0; i < info.exclude_size; ++i) {
+        job->exclude_mask.set(convert(info.exclude[i]), true);
+    }
+    for (uint32_t i = 0; i < info.any_of_size; ++i) {
+        job->any_of_masks.push_back(convert(info.any_of[i]));
+    }
 //    mustache::Logger{}.info("New job has been create, name: [%s], ptr: %p", info.name, job);
     return convert(job);
 }
@@ -319,14 +327,11 @@ Entity createEntity(World* world, Archetype* archetype) {
 void createEntityGroup(World* world, Archetype* archetype_ptr, Entity* ptr, uint32_t count) {
     auto& entities = convert(world)->entities();
     auto& archetype = *convert(archetype_ptr);
+    const auto group = entities.createBatch(archetype, count);
     auto* out = reinterpret_cast<mustache::Entity*>(ptr);
     if (out) {
-        for (uint32_t i = 0; i < count; ++i) {
-            out[i] = entities.create(archetype);
-        }
-    } else {
-        for (uint32_t i = 0; i < count; ++i) {
-            (void) entities.create(archetype);
+        for (const auto entity : group) {
+            *out++ = entity;
         }
     }
 }
@@ -334,12 +339,12 @@ void createEntityGroup(World* world, Archetype* archetype_ptr, Entity* ptr, uint
 void destroyEntities(World* world, Entity* entities, uint32_t count, bool now) {
     auto& manager = convert(world)->entities();
     const auto mustache_entities = reinterpret_cast<mustache::Entity*>(entities);
+    if (now) {
+        manager.destroyBatchNow(mustache_entities, count);
+        return;
+    }
     for (uint32_t i = 0; i < count; ++i) {
-        if (now) {
-            manager.destroyNow(mustache_entities[i]);
-        } else {
-            manager.destroy(mustache_entities[i]);
-        }
+        manager.destroy(mustache_entities[i]);
     }
 }
 
@@ -75,6 +75,11 @@ typedef struct {
     bool is_const;
 } JobArgInfo;
 
+typedef struct {
+    uint32_t component_count;
+    ComponentId* ids;
+} ComponentMask;
+
 typedef void (* ForEachArrayCallback)(struct Job*, JobForEachArrayArg*);
 typedef void (* JobEvent)(struct Job*, struct World*, TasksCount, JobSize, enum JobRunMode);
 typedef struct {
@@ -87,13 +92,12 @@ typedef struct {
     uint32_t check_update_size;
     bool entity_required;
     const char* name;
+    ComponentId* exclude; // entities with any of these components are skipped
+    uint32_t exclude_size;
+    ComponentMask* any_of; // entity must have at least one component of every mask
+    uint32_t any_of_size;
 } JobDescriptor;
 
-typedef struct {
-    uint32_t component_count;
-    ComponentId* ids;
-} ComponentMask;
-
 typedef struct {
     const char* update_group;
     const char** update_before;
@@ -8,22 +8,32 @@
 #include <mustache/ecs/new_component_data_storage.hpp>
 #include <mustache/ecs/default_component_data_storage.hpp>
 
+#include <algorithm>
 #include <cstring>
 
 using namespace mustache;
 
 Archetype::Archetype(World& world, ArchetypeIndex id, const ComponentIdMask& mask,
-                     const SharedComponentsInfo& shared_components_info, uint32_t chunk_size):
+                     const SharedComponentsInfo& shared_components_info, uint32_t chunk_size,
+                     ChunkCapacity data_chunk_capacity, ChunkCapacity initial_data_capacity):
         world_{world},
         mask_{mask},
         shared_components_info_ {shared_components_info},
         version_storage_{world.memoryManager(), mask.componentsCount(), chunk_size},
+        enable_storage_{world.memoryManager(), mask.componentsCount(), chunk_size},
         operation_helper_{world.memoryManager(), mask},
-        data_storage_{std::make_unique<DefaultComponentDataStorage>(mask, world_.memoryManager())},
+        data_chunk_capacity_{data_chunk_capacity},
+        data_storage_{std::make_unique<DefaultComponentDataStorage>(mask, world_.memoryManager(),
+                                                                    data_chunk_capacity, initial_data_capacity)},
         entities_{world.memoryManager()},
+        add_edges_{world.memoryManager()},
+        remove_edges_{world.memoryManager()},
+        remove_shared_edges_{world.memoryManager()},
+        transition_plans_{world.memoryManager()},
         id_{id} {
     MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__);
-    Logger{}.debug("Archetype version chunk size: %d", chunk_size);
+    Logger{}.debug("Archetype version chunk size: %d, data chunk capacity: %d", chunk_size,
+                   data_chunk_capacity.toInt());
 }
 
 Archetype::~Archetype() {
@@ -34,10 +44,16 @@ Archetype::~Archetype() {
     data_storage_->clear(true);
 }
 
+EntityGroup Archetype::createGroup(size_t count) {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__);
+    return world_.entities().createBatch(*this, static_cast<uint32_t>(count));
+}
+
 ComponentStorageIndex Archetype::pushBack(Entity entity) {
     MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__);
     const auto index = ComponentStorageIndex::make(entities_.size());
     versionStorage().emplace(worldVersion(), index.toArchetypeIndex());
+    enable_storage_.emplace(index.toArchetypeIndex());
     entities_.push_back(entity);
     data_storage_->emplace(index);
     return index;
@@ -58,8 +74,7 @@ const ArrayWrapper<Entity, ArchetypeEntityIndex, true>& Archetype::entities() co
 
 WorldVersion Archetype::getComponentVersion(ArchetypeEntityIndex index, ComponentId id) const noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
-    return versionStorage().getVersion(versionStorage().chunkAt(index),
-                                       getComponentIndex(id));
+    return versionStorage().getVersion(index, getComponentIndex(id));
 }
 
 uint32_t Archetype::capacity() const noexcept {
@@ -129,6 +144,13 @@ void Archetype::callOnRemove(ArchetypeEntityIndex entity_index, const ComponentI
     }
 }
 
+void Archetype::clearEdges() noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    add_edges_.clear();
+    remove_edges_.clear();
+    remove_shared_edges_.clear();
+}
+
 bool Archetype::isEmpty() const noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
     return entities_.empty();
@@ -144,6 +166,42 @@ ChunkIndex Archetype::lastChunkIndex() const noexcept {
     return result;
 }
 
+const ArchetypeTransitionPlan& Archetype::transitionPlan(const Archetype& source) {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    const auto source_id = source.id();
+    if (!transition_plans_.has(source_id)) {
+        transition_plans_.resize(source_id.next().toInt());
+    }
+    auto& plan = transition_plans_[source_id];
+    if (plan) {
+        return *plan;
+    }
+    plan = std::make_unique<ArchetypeTransitionPlan>();
+    for (uint32_t i = 0; i < operation_helper_.external_move.size(); ++i) {
+        const auto& info = operation_helper_.external_move[i];
+        const auto source_index = source.getComponentIndex<FunctionSafety::kSafe>(info.id);
+        if (source_index.isValid()) {
+            const auto& component_info = ComponentFactory::componentInfo(info.id);
+            if (component_info.is_trivially_relocatable || !info.move_ptr) {
+                plan->memcpy_group.push_back({source_index, info.component_index, info.size});
+            } else {
+                plan->call_group.push_back({source_index, info.component_index, info.move_ptr, info.size});
+            }
+        } else if (info.hasConstructorOrAfterAssign()) {
+            plan->init_group.push_back({info.component_index, info.id, i});
+        }
+    }
+    mask_.forEachItem([this, &source, &plan](ComponentId id) {
+        if (ComponentFactory::componentInfo(id).is_tag) {
+            const auto source_index = source.getComponentIndex<FunctionSafety::kSafe>(id);
+            if (source_index.isValid()) {
+                plan->tag_group.push_back({source_index, getComponentIndex<FunctionSafety::kUnsafe>(id)});
+            }
+        }
+    });
+    return *plan;
+}
+
 void Archetype::externalMove(Entity entity, Archetype& prev_archetype, ArchetypeEntityIndex prev_index,
                              const ComponentIdMask& skip_constructor) {
     if (this == &prev_archetype) {
@@ -152,28 +210,104 @@ void Archetype::externalMove(Entity entity, Archetype& prev_archetype, Archetype
     }
     MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__);
 
-    const auto index = pushBack(entity);
+    const auto& plan = transitionPlan(prev_archetype);
+    const auto index = pushBack(entity).toArchetypeIndex();
+
+    for (const auto& info : plan.memcpy_group) {
+        memcpy(getComponent<FunctionSafety::kUnsafe>(info.destination, index),
+               prev_archetype.getComponent<FunctionSafety::kUnsafe>(info.source, prev_index), info.size);
+    }
+    for (const auto& info : plan.call_group) {
+        info.move_constructor(getComponent<FunctionSafety::kUnsafe>(info.destination, index),
+                              prev_archetype.getComponent<FunctionSafety::kUnsafe>(info.source, prev_index));
+    }
+    for (const auto& info : plan.init_group) {
+        if (!skip_constructor.has(info.id)) {
+            operation_helper_.external_move[info.external_move].constructorAndAfterAssign(
+                    getComponent<FunctionSafety::kUnsafe>(info.destination, index), world_, entity);
+        }
+    }
+    copyEnableBits(plan, prev_archetype, prev_index, index);
+
+    prev_archetype.remove(entity, prev_index, mask_);
+    world_.entities().updateLocation(entity, id_, index);
+}
+
+void Archetype::externalMove(Archetype& prev_archetype, ArchetypeEntityIndex first, uint32_t count,
+                             const ComponentIdMask& skip_constructor) {
+    if (this == &prev_archetype) {
+        std::string msg = "Moving from archetype [" + mask_.toString() + "] to itself";
+        throw std::runtime_error(msg);
+    }
+    MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__);
+    if (count < 1u) {
+        return;
+    }
+
+    const auto& plan = transitionPlan(prev_archetype);
+    const auto dest_first = ComponentStorageIndex::make(entities_.size());
+    const auto source_first = ComponentStorageIndex::fromArchetypeIndex(first);
 
-    ComponentIndex component_index = ComponentIndex::make(0);
-    const auto source_view = prev_archetype.getElementView(prev_index);
-    const auto dest_view = getElementView(index.toArchetypeIndex());
-    for (const auto& info : operation_helper_.external_move) {
-        auto prev_ptr = source_view.getData<FunctionSafety::kSafe>(prev_archetype.getComponentIndex<FunctionSafety::kSafe>(info.id));
-        if (prev_ptr != nullptr) {
-            auto component_ptr = dest_view.getData<FunctionSafety::kUnsafe>(component_index);
-            info.move(component_ptr, prev_ptr);
+    entities_.reserve(dest_first.toInt() + count);
+    for (uint32_t i = 0; i < count; ++i) {
+        entities_.push_back(prev_archetype.entities_[ArchetypeEntityIndex::make(first.toInt() + i)]);
+    }
+    data_storage_->emplace(ComponentStorageIndex::make(dest_first.toInt() + count - 1u));
+    versionStorage().emplace(worldVersion(), dest_first.toArchetypeIndex(), count);
+    enable_storage_.emplace(ArchetypeEntityIndex::make(dest_first.toInt() + count - 1u));
+
+    // both archetypes store rows of a chunk contiguously, every run lies inside one source and one destination chunk
+    uint32_t done = 0;
+    while (done < count) {
+        const auto source = ComponentStorageIndex::make(source_first.toInt() + done);
+        const auto dest = ComponentStorageIndex::make(dest_first.toInt() + done);
+        const auto run_size = std::min({count - done, prev_archetype.data_storage_->distToChunkEnd(source),
+                                        data_storage_->distToChunkEnd(dest)});
+        for (const auto& info : plan.memcpy_group) {
+            memcpy(data_storage_->getData<FunctionSafety::kUnsafe>(info.destination, dest),
+                   prev_archetype.data_storage_->getData<FunctionSafety::kUnsafe>(info.source, source),
+                   info.size * run_size);
+        }
+        for (const auto& info : plan.call_group) {
+            auto dest_ptr = static_cast<std::byte*>(data_storage_->getData<FunctionSafety::kUnsafe>(
+                    info.destination, dest));
+            auto source_ptr = static_cast<std::byte*>(prev_archetype.data_storage_->getData<FunctionSafety::kUnsafe>(
+                    info.source, source));
+            for (uint32_t i = 0; i < run_size; ++i) {
+                info.move_constructor(dest_ptr + i * info.size, source_ptr + i * info.size);
+            }
         }
-        else {
-            if (info.hasConstructorOrAfterAssign() && !skip_constructor.has(info.id)) {
-                auto component_ptr = dest_view.getData<FunctionSafety::kUnsafe>(component_index);
-                info.constructorAndAfterAssign(component_ptr, world_, entity);
+        for (const auto& info : plan.init_group) {
+            if (skip_constructor.has(info.id)) {
+                continue;
+            }
+            const auto& init = operation_helper_.external_move[info.external_move];
+            auto dest_ptr = static_cast<std::byte*>(data_storage_->getData<FunctionSafety::kUnsafe>(
+                    info.destination, dest));
+            for (uint32_t i = 0; i < run_size; ++i) {
+                const auto& entity = entities_[ArchetypeEntityIndex::make(dest.toInt() + i)];
+                init.constructorAndAfterAssign(dest_ptr + i * init.size, world_, entity);
             }
         }
-        ++component_index;
+        done += run_size;
+    }
+    if (prev_archetype.enable_storage_.hasDisabled()) {
+        for (uint32_t i = 0; i < count; ++i) {
+            copyEnableBits(plan, prev_archetype, ArchetypeEntityIndex::make(first.toInt() + i),
+                           ArchetypeEntityIndex::make(dest_first.toInt() + i));
+        }
     }
 
-    prev_archetype.remove(*source_view.getEntity<FunctionSafety::kUnsafe>(), prev_index, mask_);
-    world_.entities().updateLocation(entity, id_, index.toArchetypeIndex());
+    std::vector<ArchetypeEntityIndex> moved(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        moved[i] = ArchetypeEntityIndex::make(first.toInt() + i);
+    }
+    prev_archetype.remove(moved, mask_);
+
+    auto& entity_manager = world_.entities();
+    for (auto index = dest_first.toArchetypeIndex(); index < ArchetypeEntityIndex::make(entities_.size()); ++index) {
+        entity_manager.updateLocation(entities_[index], id_, index);
+    }
 }
 
 ArchetypeEntityIndex Archetype::insert(Entity entity, const ComponentIdMask& skip_constructor) {
@@ -204,25 +338,159 @@ ArchetypeEntityIndex Archetype::insert(Entity entity, const ComponentIdMask& ski
     return index.toArchetypeIndex();
 }
 
+void Archetype::insert(const EntityGroup& group) {
+    MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__);
+    const uint32_t count = group.size();
+    if (count < 1u) {
+        return;
+    }
+    const auto first_index = appendRows(count);
+    auto index = first_index;
+    for (const auto entity : group) {
+        entities_[index] = entity;
+        ++index;
+    }
+    initRows(first_index, count, nullptr);
+
+    auto& entity_manager = world_.entities();
+    for (index = first_index; index < ArchetypeEntityIndex::make(first_index.toInt() + count); ++index) {
+        entity_manager.updateLocation(entities_[index], id_, index);
+    }
+}
+
+ArchetypeEntityIndex Archetype::appendRows(uint32_t count) {
+    MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__);
+    const auto first_index = ArchetypeEntityIndex::make(entities_.size());
+    if (count < 1u) {
+        return first_index;
+    }
+    entities_.resize(first_index.toInt() + count);
+    data_storage_->emplace(ComponentStorageIndex::make(first_index.toInt() + count - 1u));
+    versionStorage().emplace(worldVersion(), first_index, count);
+    enable_storage_.emplace(ArchetypeEntityIndex::make(first_index.toInt() + count - 1u));
+    return first_index;
+}
+
+void Archetype::initRows(ArchetypeEntityIndex first, uint32_t count, const ComponentIdMask* skip_constructor) {
+    MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__);
+    const auto end_index = ComponentStorageIndex::make(first.toInt() + count);
+
+    // components of one chunk are stored contiguously, so every column is initialized per chunk
+    auto begin = ComponentStorageIndex::fromArchetypeIndex(first);
+    while (begin < end_index) {
+        const auto run_size = std::min(data_storage_->distToChunkEnd(begin), end_index.toInt() - begin.toInt());
+        const auto* run_skip = skip_constructor != nullptr ? skip_constructor + (begin.toInt() - first.toInt()) : nullptr;
+        for (const auto& info : operation_helper_.insert) {
+            const auto component_id = operation_helper_.component_index_to_component_id[info.component_index];
+            auto component_ptr = static_cast<std::byte*>(data_storage_->getData<FunctionSafety::kUnsafe>(
+                    info.component_index, begin));
+            for (uint32_t i = 0; i < run_size; ++i) {
+                if (run_skip == nullptr || !run_skip[i].has(component_id)) {
+                    const auto& entity = entities_[ArchetypeEntityIndex::make(begin.toInt() + i)];
+                    info.constructor(component_ptr + i * info.size, entity, world_);
+                }
+            }
+        }
+        for (const auto& info : operation_helper_.create_with_value) {
+            auto component_ptr = static_cast<std::byte*>(data_storage_->getData<FunctionSafety::kUnsafe>(
+                    info.component_index, begin));
+            if (run_skip != nullptr) {
+                const auto component_id = operation_helper_.component_index_to_component_id[info.component_index];
+                for (uint32_t i = 0; i < run_size; ++i) {
+                    if (!run_skip[i].has(component_id)) {
+                        memcpy(component_ptr + i * info.size, info.value, info.size);
+                    }
+                }
+                continue;
+            }
+            const size_t bytes = info.size * run_size;
+            if (info.is_zero) {
+                memset(component_ptr, 0, bytes);
+            } else {
+                // fill the first element, then double already initialized range
+                memcpy(component_ptr, info.value, info.size);
+                size_t filled = info.size;
+                while (filled < bytes) {
+                    const size_t to_copy = std::min(filled, bytes - filled);
+                    memcpy(component_ptr + filled, component_ptr, to_copy);
+                    filled += to_copy;
+                }
+            }
+        }
+        begin = ComponentStorageIndex::make(begin.toInt() + run_size);
+    }
+}
+
+void Archetype::moveRows(Archetype& source, const ArchetypeEntityIndex* source_indices, ArchetypeEntityIndex first,
+                         uint32_t count, const ComponentIdMask* skip_constructor) {
+    MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__);
+    const auto& plan = transitionPlan(source);
+    for (const auto& info : plan.memcpy_group) {
+        for (uint32_t i = 0; i < count; ++i) {
+            memcpy(getComponent<FunctionSafety::kUnsafe>(info.destination, ArchetypeEntityIndex::make(first.toInt() + i)),
+                   source.getComponent<FunctionSafety::kUnsafe>(info.source, source_indices[i]), info.size);
+        }
+    }
+    for (const auto& info : plan.call_group) {
+        for (uint32_t i = 0; i < count; ++i) {
+            info.move_constructor(getComponent<FunctionSafety::kUnsafe>(info.destination, ArchetypeEntityIndex::make(first.toInt() + i)),
+                                  source.getComponent<FunctionSafety::kUnsafe>(info.source, source_indices[i]));
+        }
+    }
+    for (const auto& info : plan.init_group) {
+        const auto& move_info = operation_helper_.external_move[info.external_move];
+        for (uint32_t i = 0; i < count; ++i) {
+            if (skip_constructor == nullptr || !skip_constructor[i].has(info.id)) {
+                const auto index = ArchetypeEntityIndex::make(first.toInt() + i);
+                move_info.constructorAndAfterAssign(getComponent<FunctionSafety::kUnsafe>(info.destination, index),
+                                                    world_, entities_[index]);
+            }
+        }
+    }
+    if (source.enable_storage_.hasDisabled()) {
+        for (uint32_t i = 0; i < count; ++i) {
+            copyEnableBits(plan, source, source_indices[i], ArchetypeEntityIndex::make(first.toInt() + i));
+        }
+    }
+}
+
+void Archetype::copyEnableBits(const ArchetypeTransitionPlan& plan, const Archetype& source,
+                               ArchetypeEntityIndex source_index, ArchetypeEntityIndex index) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    const auto& source_storage = source.enable_storage_;
+    if (!source_storage.hasDisabled()) {
+        return;
+    }
+    for (const auto& info : plan.memcpy_group) {
+        enable_storage_.copy(info.destination, index, source_storage, info.source, source_index);
+    }
+    for (const auto& info : plan.call_group) {
+        enable_storage_.copy(info.destination, index, source_storage, info.source, source_index);
+    }
+    for (const auto& info : plan.tag_group) {
+        enable_storage_.copy(info.destination, index, source_storage, info.source, source_index);
+    }
+}
+
 void Archetype::internalMove(ArchetypeEntityIndex source_index, ArchetypeEntityIndex destination_index) {
     MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__);
     // moving last entity to index
-    ComponentIndex component_index = ComponentIndex::make(0);
     auto source_view = getElementView(source_index);
     auto dest_view = getElementView(destination_index);
     for (auto& info : operation_helper_.internal_move) {
-        auto source_ptr = source_view.getData<FunctionSafety::kUnsafe>(component_index);
-        auto dest_ptr = dest_view.getData<FunctionSafety::kUnsafe>(component_index);
+        auto source_ptr = source_view.getData<FunctionSafety::kUnsafe>(info.component_index);
+        auto dest_ptr = dest_view.getData<FunctionSafety::kUnsafe>(info.component_index);
         info.move(dest_ptr, source_ptr);
-        ++component_index;
     }
 
     auto source_entity = *source_view.getEntity<FunctionSafety::kUnsafe>();
     auto& dest_entity = *dest_view.getEntity<FunctionSafety::kUnsafe>();
 
     const auto world_version = worldVersion();
-    versionStorage().setVersion(world_version, versionStorage().chunkAt(source_index));
-    versionStorage().setVersion(world_version, versionStorage().chunkAt(destination_index));
+    versionStorage().setVersion(world_version, source_index);
+    versionStorage().setVersion(world_version, destination_index);
+    enable_storage_.copy(destination_index, source_index);
+    enable_storage_.reset(source_index);
 
     world_.entities().updateLocation(dest_entity, ArchetypeIndex::null(), ArchetypeEntityIndex::null());
     world_.entities().updateLocation(source_entity, id_, destination_index);
@@ -262,18 +530,95 @@ void Archetype::remove(Entity entity_to_destroy, ArchetypeEntityIndex entity_ind
         } else {
             popBack();
         }
-        versionStorage().setVersion(worldVersion(), versionStorage().chunkAt(entity_index));
+        versionStorage().setVersion(worldVersion(), entity_index);
+        enable_storage_.reset(entity_index);
         world_.entities().updateLocation(entity_to_destroy, ArchetypeIndex::null(), ArchetypeEntityIndex::null());
     } else {
         internalMove(last_index, entity_index);
     }
+}
 
-    /// TODO: fix for NewComponentDataStorage
-    /*if (isEmpty()) {
-        entities_.clear();
-        entities_.shrink_to_fit();
-        data_storage_->clear(true);
-    }*/
+void Archetype::remove(const std::vector<ArchetypeEntityIndex>& sorted_indices,
+                       const ComponentIdMask& skip_on_remove_call) {
+    MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__);
+    const auto count = static_cast<uint32_t>(sorted_indices.size());
+    if (count < 1u) {
+        return;
+    }
+    const auto on_remove_mask = mask_.intersection(skip_on_remove_call.inverse());
+    for (const auto& index : sorted_indices) {
+        callOnRemove(index, on_remove_mask);
+    }
+
+    auto& entity_manager = world_.entities();
+    for (const auto& index : sorted_indices) {
+        entity_manager.resetLocation(entities_[index], id_, index);
+    }
+
+    const auto old_size = size();
+    const auto new_size = old_size - count;
+
+    // every hole below new_size takes the last surviving entity from the tail
+    struct Move {
+        ArchetypeEntityIndex from;
+        ArchetypeEntityIndex to;
+    };
+    std::vector<Move> moves;
+    uint32_t source = old_size;
+    size_t tail_victim = sorted_indices.size();
+    for (size_t hole = 0; hole < sorted_indices.size() && sorted_indices[hole].toInt() < new_size; ++hole) {
+        --source;
+        while (tail_victim > hole && sorted_indices[tail_victim - 1].toInt() == source) {
+            --tail_victim;
+            --source;
+        }
+        moves.push_back(Move{ArchetypeEntityIndex::make(source), sorted_indices[hole]});
+    }
+
+    for (const auto& info : operation_helper_.internal_move) {
+        for (const auto& move : moves) {
+            auto source_ptr = getComponent<FunctionSafety::kUnsafe>(info.component_index, move.from);
+            auto dest_ptr = getComponent<FunctionSafety::kUnsafe>(info.component_index, move.to);
+            info.move(dest_ptr, source_ptr);
+        }
+    }
+
+    const auto world_version = worldVersion();
+    VersionBlockIndex last_stamped_block;
+    for (const auto& move : moves) {
+        const auto entity = entities_[move.from];
+        entities_[move.to] = entity;
+        entity_manager.updateLocation(entity, id_, move.to);
+        const auto block = versionStorage().blockAt(move.to);
+        if (block != last_stamped_block) {
+            versionStorage().setVersion(world_version, move.to);
+            last_stamped_block = block;
+        }
+        enable_storage_.copy(move.to, move.from);
+    }
+    if (enable_storage_.hasDisabled()) {
+        for (uint32_t index = new_size; index < old_size; ++index) {
+            enable_storage_.reset(ArchetypeEntityIndex::make(index));
+        }
+    }
+
+    // tail contains removed and moved-from entities
+    const auto tail_end = ComponentStorageIndex::make(old_size);
+    for (const auto& info : operation_helper_.destroy) {
+        auto begin = ComponentStorageIndex::make(new_size);
+        while (begin < tail_end) {
+            const auto run_size = std::min(data_storage_->distToChunkEnd(begin), tail_end.toInt() - begin.toInt());
+            auto ptr = static_cast<std::byte*>(data_storage_->getData<FunctionSafety::kUnsafe>(
+                    info.component_index, begin));
+            for (uint32_t i = 0; i < run_size; ++i) {
+                info.destructor(ptr + i * info.size);
+            }
+            begin = ComponentStorageIndex::make(begin.toInt() + run_size);
+        }
+    }
+
+    entities_.resize(new_size);
+    data_storage_->decrSize(count);
 }
 
 WorldVersion Archetype::worldVersion() const noexcept {
@@ -281,6 +626,17 @@ WorldVersion Archetype::worldVersion() const noexcept {
     return world_.version();
 }
 
+uint32_t Archetype::shrinkToFit(uint32_t spare_chunks, uint32_t max_chunks) {
+    MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__);
+    const auto released = data_storage_->shrinkToFit(spare_chunks, max_chunks);
+    // bit chunks are much smaller than data chunks, so they are not limited by max_chunks
+    enable_storage_.shrinkToFit(size());
+    if (released > 0u && isEmpty()) {
+        entities_.shrink_to_fit();
+    }
+    return released;
+}
+
 void Archetype::clear() {
     MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__);
     if (isEmpty()) {
@@ -296,4 +652,5 @@ void Archetype::clear() {
 
     entities_.clear();
     data_storage_->clear(false);
+    enable_storage_.clear();
 }
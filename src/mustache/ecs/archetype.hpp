@@ -9,11 +9,13 @@
 #include <mustache/ecs/job_arg_parcer.hpp>
 #include <mustache/ecs/component_factory.hpp>
 #include <mustache/ecs/component_version_storage.hpp>
+#include <mustache/ecs/component_enable_storage.hpp>
 #include <mustache/ecs/archetype_operation_helper.hpp>
 #include <mustache/ecs/base_component_data_storage.hpp>
 
 #include <stdexcept>
 #include <cstdint>
+#include <limits>
 #include <string>
 
 namespace mustache {
@@ -55,9 +57,11 @@ namespace mustache {
     class MUSTACHE_EXPORT Archetype : public Uncopiable {
     public:
         Archetype(World& world, ArchetypeIndex id, const ComponentIdMask& mask,
-                  const SharedComponentsInfo& shared_components_info, uint32_t chunk_size);
+                  const SharedComponentsInfo& shared_components_info, uint32_t chunk_size,
+                  ChunkCapacity data_chunk_capacity, ChunkCapacity initial_data_capacity = ChunkCapacity::null());
         ~Archetype();
 
+        /// creates count entities in this archetype, see EntityManager::createBatch
         [[nodiscard]] EntityGroup createGroup(size_t count);
 
         [[nodiscard]] uint32_t size() const noexcept {
@@ -72,6 +76,11 @@ namespace mustache {
 
         [[nodiscard]] ChunkCapacity chunkCapacity() const noexcept;
 
+        /// rows in one chunk of component data
+        [[nodiscard]] ChunkCapacity dataChunkCapacity() const noexcept {
+            return data_chunk_capacity_;
+        }
+
         [[nodiscard]] bool isMatch(const ComponentIdMask& mask) const noexcept;
 
         [[nodiscard]] bool isMatch(const SharedComponentIdMask& mask) const noexcept;
@@ -80,6 +89,11 @@ namespace mustache {
 
         [[nodiscard]] bool hasComponent(SharedComponentId component_id) const noexcept;
 
+        /// constructor or afterAssign of some component gets World, so initializing a row may change entities
+        [[nodiscard]] bool usesWorld() const noexcept {
+            return operation_helper_.uses_world;
+        }
+
         WorldVersion worldVersion() const noexcept;
 
         template<FunctionSafety _Safety = FunctionSafety::kSafe>
@@ -116,6 +130,14 @@ namespace mustache {
             return version_storage_;
         }
 
+        [[nodiscard]] EnableStorage& enableStorage() noexcept {
+            return enable_storage_;
+        }
+
+        [[nodiscard]] const EnableStorage& enableStorage() const noexcept {
+            return enable_storage_;
+        }
+
         template<FunctionSafety _Safety = FunctionSafety::kSafe>
         [[nodiscard]] MUSTACHE_INLINE const SharedComponentTag* getSharedComponent(SharedComponentIndex index) const noexcept;
 
@@ -140,8 +162,7 @@ namespace mustache {
 
         MUSTACHE_INLINE void markComponentDirty(ComponentIndex component, ArchetypeEntityIndex index,
                                                 WorldVersion version) noexcept {
-            const auto chunk = versionStorage().chunkAt(index);
-            versionStorage().setVersion(version, chunk, component);
+            versionStorage().setVersion(version, index, component);
         }
 
         template<FunctionSafety _Safety = FunctionSafety::kDefault>
@@ -160,12 +181,40 @@ namespace mustache {
 
         void clear();
 
+        /// releases at most max_chunks unused data chunks keeping spare_chunks, returns number of released chunks
+        uint32_t shrinkToFit(uint32_t spare_chunks = 0u, uint32_t max_chunks = std::numeric_limits<uint32_t>::max());
+
         /// Entity must belong to default(empty) archetype
         ArchetypeEntityIndex insert(Entity entity, const ComponentIdMask& skip_constructor = ComponentIdMask::null());
 
+        /// Entities must belong to default(empty) archetype, storage grows once and components are initialized per column
+        void insert(const EntityGroup& group);
+
+        /// appends count rows with null entities and uninitialized components, returns index of the first one
+        ArchetypeEntityIndex appendRows(uint32_t count);
+
+        /// initializes components of count appended rows, skip_constructor is null or holds a mask per row
+        void initRows(ArchetypeEntityIndex first, uint32_t count, const ComponentIdMask* skip_constructor);
+
+        /// moves components of source rows into count appended rows column by column, source rows stay in place
+        void moveRows(Archetype& source, const ArchetypeEntityIndex* source_indices, ArchetypeEntityIndex first,
+                      uint32_t count, const ComponentIdMask* skip_constructor);
+
         // Move from prev to this archetype
         void externalMove(Entity entity, Archetype& prev, ArchetypeEntityIndex prev_index,
                           const ComponentIdMask& skip_constructor);
+
+        // Move count entities starting at first from prev to this archetype, columns are moved by chunk-sized runs
+        void externalMove(Archetype& prev, ArchetypeEntityIndex first, uint32_t count,
+                          const ComponentIdMask& skip_constructor);
+
+        /// plan of moving entity from source to this archetype, created once per source archetype
+        const ArchetypeTransitionPlan& transitionPlan(const Archetype& source);
+
+        /// copies enable bits of components kept by transition
+        void copyEnableBits(const ArchetypeTransitionPlan& plan, const Archetype& source,
+                            ArchetypeEntityIndex source_index, ArchetypeEntityIndex index) noexcept;
+
         void internalMove(ArchetypeEntityIndex from, ArchetypeEntityIndex to);
         /**
          * removes entity from archetype, calls destructor for each trivially destructible component
@@ -173,17 +222,46 @@ namespace mustache {
          * returns new entity at index.
          */
         void remove(Entity entity, ArchetypeEntityIndex index, const ComponentIdMask& skip_on_remove_call);
+        /**
+         * removes entities at sorted unique indices.
+         * holes are filled with entities from the tail, so every surviving entity is moved at most once,
+         * destructors are called per column for the released tail.
+         */
+        void remove(const std::vector<ArchetypeEntityIndex>& sorted_indices, const ComponentIdMask& skip_on_remove_call);
         void callDestructor(const ElementView& view);
         void callOnRemove(ArchetypeEntityIndex index, const ComponentIdMask& components_to_be_removed);
 
+        // transition graph: archetype with one more / one less component, filled lazily by EntityManager
+        template<typename _Id>
+        [[nodiscard]] static MUSTACHE_INLINE Archetype* findEdge(const ArrayWrapper<Archetype*, _Id, true>& edges,
+                                                                 _Id id) noexcept {
+            return edges.has(id) ? edges[id] : nullptr;
+        }
+
+        template<typename _Id>
+        static void setEdge(ArrayWrapper<Archetype*, _Id, true>& edges, _Id id, Archetype* target) {
+            if (!edges.has(id)) {
+                edges.resize(id.next().toInt(), nullptr);
+            }
+            edges[id] = target;
+        }
+
+        void clearEdges() noexcept;
+
 
         World& world_;
         const ComponentIdMask mask_;
         const SharedComponentsInfo shared_components_info_;
         VersionStorage version_storage_;
+        EnableStorage enable_storage_;
         ArchetypeOperationHelper operation_helper_;
+        const ChunkCapacity data_chunk_capacity_;
         std::unique_ptr<BaseComponentDataStorage> data_storage_;
         ArrayWrapper<Entity, ArchetypeEntityIndex, true> entities_;
+        ArrayWrapper<Archetype*, ComponentId, true> add_edges_;
+        ArrayWrapper<Archetype*, ComponentId, true> remove_edges_;
+        ArrayWrapper<Archetype*, SharedComponentId, true> remove_shared_edges_;
+        ArrayWrapper<std::unique_ptr<ArchetypeTransitionPlan>, ArchetypeIndex, true> transition_plans_; // by source
         const ArchetypeIndex id_;
     };
 
@@ -5,6 +5,8 @@
 #include <mustache/ecs/entity.hpp>
 #include <mustache/ecs/component_factory.hpp>
 
+#include <algorithm>
+
 using namespace mustache;
 
 ArchetypeOperationHelper::ArchetypeOperationHelper(MemoryManager& memory_manager, const ComponentIdMask& mask):
@@ -31,32 +33,40 @@ ArchetypeOperationHelper::ArchetypeOperationHelper(MemoryManager& memory_manager
         }
         component_id_to_component_index[component_id] = component_index;
         const auto& info = ComponentFactory::componentInfo(component_id);
+        if (info.is_tag) {
+            ++component_index;
+            continue;
+        }
 
         if (info.functions.create || info.functions.after_assign) {
             insert.push_back(InsertInfo {
                     info.functions.create,
                     info.functions.after_assign,
-                    component_index
+                    component_index,
+                    info.size
             });
         } else if (!info.default_value.empty()) {
+            const auto is_zero = std::all_of(info.default_value.begin(), info.default_value.end(),
+                                             [](std::byte b) noexcept { return b == std::byte{0}; });
             create_with_value.push_back(CreateWithValueInfo {
                     info.default_value.data(),
                     info.default_value.size(),
-                    component_index
+                    component_index,
+                    is_zero
             });
         }
         if (info.functions.destroy) {
             destroy.push_back(DestroyInfo {
                     info.functions.destroy,
-                    component_index
-            });
-        }
-        if (info.functions.move) {
-            internal_move.push_back(InternalMoveInfo {
-                    info.functions.move,
+                    component_index,
                     info.size
             });
         }
+        internal_move.push_back(InternalMoveInfo {
+                info.functions.move,
+                info.size,
+                component_index
+        });
         if (info.functions.before_remove) {
             before_remove_functions.push_back({ component_index, info.functions.before_remove });
         }
@@ -64,9 +74,11 @@ ArchetypeOperationHelper::ArchetypeOperationHelper(MemoryManager& memory_manager
         external_move_info.constructor_ptr = info.functions.create;
         external_move_info.move_ptr = info.functions.move_constructor;
         external_move_info.id = component_id;
+        external_move_info.component_index = component_index;
         external_move_info.size = info.size;
         external_move_info.default_data = info.default_value.empty() ? nullptr : info.default_value.data();
         external_move_info.after_assign = info.functions.after_assign;
+        uses_world = uses_world || info.uses_world;
 
         ++component_index;
     }
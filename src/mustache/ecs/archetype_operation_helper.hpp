@@ -12,6 +12,37 @@
 namespace mustache {
     struct ComponentIdMask;
 
+    /**
+     * Resolved steps to move an entity from source archetype to destination one.
+     * Built once for every (source, destination) pair, see Archetype::transitionPlan
+     */
+    struct MUSTACHE_EXPORT ArchetypeTransitionPlan {
+        struct CopyInfo { // trivially relocatable components
+            ComponentIndex source;
+            ComponentIndex destination;
+            size_t size;
+        };
+        struct MoveInfo {
+            ComponentIndex source;
+            ComponentIndex destination;
+            ComponentInfo::MoveFunction move_constructor;
+            size_t size;
+        };
+        struct InitInfo { // components missing in source archetype
+            ComponentIndex destination;
+            ComponentId id;
+            uint32_t external_move; // index in ArchetypeOperationHelper::external_move
+        };
+        struct TagInfo { // tags of both archetypes, have no data but may be disabled
+            ComponentIndex source;
+            ComponentIndex destination;
+        };
+        std::vector<CopyInfo> memcpy_group;
+        std::vector<MoveInfo> call_group;
+        std::vector<InitInfo> init_group; // only components with constructor, default value or afterAssign
+        std::vector<TagInfo> tag_group;
+    };
+
     class MUSTACHE_EXPORT ArchetypeOperationHelper {
     private:
         friend class Archetype;
@@ -33,17 +64,20 @@ namespace mustache {
             ComponentInfo::Constructor constructor_func;
             ComponentInfo::AfterAssing after_assign_func;
             ComponentIndex component_index;
+            size_t size = 0;
         };
 
         struct CreateWithValueInfo {
             const std::byte* value = nullptr;
             size_t size = 0;
             ComponentIndex component_index;
+            bool is_zero = false; // value contains only zero bytes, memset can be used
         };
 
         struct DestroyInfo {
             ComponentInfo::Destructor destructor;
             ComponentIndex component_index;
+            size_t size = 0;
         };
 
         struct BeforeRemoveInfo {
@@ -54,6 +88,7 @@ namespace mustache {
         struct InternalMoveInfo {
             ComponentInfo::MoveFunction move_ptr;
             size_t size;
+            ComponentIndex component_index;
             MUSTACHE_INLINE void move(void* dest, void* src) const {
                 if (move_ptr) {
                     move_ptr(dest, src);
@@ -68,6 +103,7 @@ namespace mustache {
             ComponentInfo::AfterAssing after_assign;
             ComponentInfo::MoveFunction move_ptr;
             ComponentId id;
+            ComponentIndex component_index;
             const std::byte* default_data = nullptr;
             size_t size;
 
@@ -112,7 +148,8 @@ namespace mustache {
         std::vector<CreateWithValueInfo, Allocator<CreateWithValueInfo> > create_with_value; // only non-empty values
         std::vector<DestroyInfo, Allocator<DestroyInfo> > destroy; // only non-null destroy functions
         std::vector<BeforeRemoveInfo, Allocator<BeforeRemoveInfo> > before_remove_functions; // only non-null beforeRemove functions
-        ArrayWrapper<ExternalMoveInfo, ComponentIndex, true> external_move;
-        ArrayWrapper<InternalMoveInfo, ComponentIndex, true> internal_move; // move or copy function
+        std::vector<ExternalMoveInfo, Allocator<ExternalMoveInfo> > external_move; // every component except tags
+        std::vector<InternalMoveInfo, Allocator<InternalMoveInfo> > internal_move; // move or copy function, every component except tags
+        bool uses_world = false; // some component gets World in constructor or afterAssign
     };
 }
@@ -12,3 +12,8 @@ void BaseComponentDataStorage::emplace(ComponentStorageIndex position) {
         size_ = next.toInt();
     }
 }
+
+uint32_t BaseComponentDataStorage::shrinkToFit(uint32_t, uint32_t) {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    return 0u;
+}
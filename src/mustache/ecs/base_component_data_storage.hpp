@@ -25,6 +25,9 @@ namespace mustache {
 
         virtual void emplace(ComponentStorageIndex position);
 
+        /// releases at most max_chunks unused chunks but keeps spare_chunks of them, returns number of released chunks
+        virtual uint32_t shrinkToFit(uint32_t spare_chunks, uint32_t max_chunks);
+
         template<FunctionSafety _Safety = FunctionSafety::kDefault>
         MUSTACHE_INLINE void* getData(ComponentIndex component_index, ComponentStorageIndex index) const noexcept {
             if constexpr (isSafe(_Safety)) {
@@ -54,6 +57,10 @@ namespace mustache {
             --size_;
         }
 
+        MUSTACHE_INLINE void decrSize(uint32_t count) noexcept {
+            size_ -= count;
+        }
+
         MUSTACHE_INLINE DataStorageIterator getIterator(ComponentStorageIndex index) const noexcept;
 
     protected:
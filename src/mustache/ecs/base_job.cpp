@@ -9,38 +9,50 @@ using namespace mustache;
 
 namespace {
     void filterArchetype(Archetype& archetype, const ArchetypeFilterParam& check, const ArchetypeFilterParam& set,
-                         WorldFilterResult& result, BaseJob& job) {
+                         const std::vector<ComponentIndex>& required, WorldFilterResult& result, BaseJob& job) {
         MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
         WorldFilterResult::ArchetypeFilterResult item;
         item.archetype = &archetype;
         item.entities_count = 0u;
 
+        const auto& enable_storage = archetype.enableStorage();
+        if (enable_storage.hasDisabled()) {
+            for (const auto& component : required) {
+                if (enable_storage.hasDisabled(component)) {
+                    item.disabled_components.push_back(component);
+                }
+            }
+        }
+        const auto& disabled = item.disabled_components;
+
         const auto last_index = archetype.lastChunkIndex();
-        bool is_prev_match = false;
+        const auto archetype_size = archetype.size();
+        bool is_block_open = false;
         WorldFilterResult::EntityBlock block{ArchetypeEntityIndex::make(0), ArchetypeEntityIndex::make(0)};
-        const auto chunk_size = archetype.chunkCapacity().toInt();
+        // adjacent dirty ranges (also from neighbour chunks) are merged into one block
+        const auto on_range = [&item, &block, &is_block_open](ArchetypeEntityIndex begin, ArchetypeEntityIndex end) {
+            if (is_block_open && block.end == begin) {
+                block.end = end;
+                return;
+            }
+            if (is_block_open) {
+                item.addBlock(block);
+            }
+            block.begin = begin;
+            block.end = end;
+            is_block_open = true;
+        };
 
-        // TODO: make 2-3 levels of component version (for group of 1024, 32, 1) and let VersionStorage return filtered range
+        auto& version_storage = archetype.versionStorage();
         for (auto chunk_index = ChunkIndex::make(0); chunk_index <= last_index; ++chunk_index) {
-            const bool is_match =
-                    job.extraChunkFilterCheck(archetype, chunk_index) &&
-                    archetype.versionStorage().checkAndSet(check, set, chunk_index);
-
-            if (is_match) {
-                if (!is_prev_match) {
-                    block.begin = ArchetypeEntityIndex::make(chunk_index.toInt() * chunk_size);
-                }
-                block.end = ArchetypeEntityIndex::make(chunk_index.next().toInt() * chunk_size);
-            } else {
-                if (is_prev_match) {
-                    item.addBlock(block);
-                }
+            const bool is_chunk_disabled = !disabled.empty() &&
+                    enable_storage.isChunkDisabled(disabled.data(), static_cast<uint32_t>(disabled.size()),
+                                                   chunk_index, archetype_size);
+            if (!is_chunk_disabled && job.extraChunkFilterCheck(archetype, chunk_index)) {
+                version_storage.filterChunk(check, set, chunk_index, archetype_size, on_range);
             }
-            is_prev_match = is_match;
         }
-        if (is_prev_match) {
-            const auto end_of_archetype = ArchetypeEntityIndex::make(archetype.size());
-            block.end = std::min(end_of_archetype, block.end);
+        if (is_block_open) {
             item.addBlock(block);
         }
         if (item.entities_count > 0) {
@@ -48,39 +60,64 @@ namespace {
             result.total_entity_count += item.entities_count;
         }
     }
+}
 
-    bool apply(World& world, const FilterCheckParam& check, const FilterSetParam& set,
-               WorldFilterResult& result, BaseJob& job) {
-        MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
+bool BaseJob::isArchetypeMatch(const Archetype& archetype, const ArchetypeMatchCache& cache) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+    const auto& mask = archetype.componentMask();
+    if (mask.isMatchAny(cache.exclude_mask)) {
+        return false;
+    }
+    for (const auto& any_of : cache.any_of_masks) {
+        if (!mask.isMatchAny(any_of)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-        auto& entities = world.entities();
-        const auto num_archetypes = entities.getArchetypesCount();
-        result.filtered_archetypes.reserve(num_archetypes);
+std::vector<BaseJob::ArchetypeMatchCache::Item>& BaseJob::updateMatchCache(World& world, const ComponentIdMask& check,
+                                                                        const ComponentIdMask& set) {
+    MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__ );
+
+    auto& entities = world.entities();
+    auto& cache = match_cache_;
+    const bool is_cache_valid = cache.entity_manager_id == entities.instanceId() &&
+            cache.mask == filter_result_.mask && cache.shared_component_mask == filter_result_.shared_component_mask &&
+            cache.exclude_mask == filter_result_.exclude_mask && cache.any_of_masks == filter_result_.any_of_masks &&
+            cache.check_mask == check && cache.set_mask == set;
+    if (!is_cache_valid) {
+        cache.entity_manager_id = entities.instanceId();
+        cache.checked_archetypes_count = 0u;
+        cache.mask = filter_result_.mask;
+        cache.shared_component_mask = filter_result_.shared_component_mask;
+        cache.exclude_mask = filter_result_.exclude_mask;
+        cache.any_of_masks = filter_result_.any_of_masks;
+        cache.check_mask = check;
+        cache.set_mask = set;
+        cache.items.clear();
+    }
 
-        ArchetypeFilterParam archetype_check;
-        archetype_check.version = check.version;
-        for (ArchetypeIndex index = ArchetypeIndex::make(0); index < ArchetypeIndex::make(num_archetypes); ++index) {
+    const auto num_archetypes = entities.getArchetypesCount();
+    if (cache.checked_archetypes_count < num_archetypes) {
+        cache.found.clear();
+        entities.findArchetypes(cache.mask, cache.shared_component_mask, cache.found,
+                                ArchetypeIndex::make(cache.checked_archetypes_count));
+        for (const auto& index : cache.found) {
             auto& arch = entities.getArchetype(index);
-
-            const bool is_archetype_match =
-                    arch.size() > 0u &&
-                    arch.isMatch(result.mask) &&
-                    arch.isMatch(result.shared_component_mask) &&
-                    job.extraArchetypeFilterCheck(arch);
-
-            if (is_archetype_match) {
-                archetype_check.mask = arch.makeComponentMask(check.mask).items();
-                ArchetypeFilterParam archetype_set;
-                archetype_set.version = set.version;
-                archetype_set.mask = arch.makeComponentMask(set.mask).items();
-                if (arch.versionStorage().checkAndSet(archetype_check, archetype_set)) {
-                    filterArchetype(arch, archetype_check, archetype_set, result, job);
-                }
+            if (!isArchetypeMatch(arch, cache)) {
+                continue;
             }
+            auto& item = cache.items.emplace_back();
+            item.archetype = &arch;
+            item.check.mask = arch.makeComponentMask(check).items();
+            item.set.mask = arch.makeComponentMask(set).items();
+            item.required = arch.makeComponentMask(cache.mask).items();
         }
-
-        return result.total_entity_count > 0u;
+        cache.checked_archetypes_count = num_archetypes;
     }
+
+    return cache.items;
 }
 
 TasksCount BaseJob::taskCount(World& world, uint32_t entity_count) const noexcept {
@@ -130,7 +167,21 @@ uint32_t BaseJob::applyFilter(World& world) noexcept {
             cur_world_version
     };
 
-    if (apply(world, check, set, filter_result_, *this)) {
+    auto& archetypes = updateMatchCache(world, check.mask, set.mask);
+    filter_result_.filtered_archetypes.reserve(archetypes.size());
+    for (auto& item : archetypes) {
+        auto& arch = *item.archetype;
+        if (arch.size() < 1u || !extraArchetypeFilterCheck(arch)) {
+            continue;
+        }
+        item.check.version = check.version;
+        item.set.version = set.version;
+        if (arch.versionStorage().checkAndSet(item.check, item.set)) {
+            filterArchetype(arch, item.check, item.set, item.required, filter_result_, *this);
+        }
+    }
+
+    if (filter_result_.total_entity_count > 0u) {
         last_update_version_ = cur_world_version;
     }
 
@@ -162,23 +213,41 @@ void BaseJob::runParallel(World& world, TasksCount task_count) {
     invocation_index.entity_index_in_task = ParallelTaskItemIndexInTask::make(0);
     invocation_index.task_index = ParallelTaskId::make(0);
 
-    for (ArchetypeGroup task : TaskGroup::make(filter_result_, task_count)) {
-        dispatcher.addParallelTask([task, this, invocation_index, &world](ThreadId thread_id) mutable {
-            invocation_index.thread_id = thread_id;
-            const auto task_size = TaskSize::make(task.taskSize());
-            {
-                MUSTACHE_PROFILER_BLOCK_LVL_0("onTaskBegin");
-                onTaskBegin(world, task_size, invocation_index.task_index);
-            }
-            {
-                MUSTACHE_PROFILER_BLOCK_LVL_0("singleTask");
-                singleTask(world, task, invocation_index);
+    // all tasks are published at once, closures are stored inline in tasks
+    auto tasks = dispatcher.allocateTasks(task_count.toInt());
+    uint32_t num_tasks = 0u;
+    try {
+        for (ArchetypeGroup task : TaskGroup::make(filter_result_, task_count)) {
+            auto function = [task, this, invocation_index, &world](ThreadId thread_id) mutable {
+                invocation_index.thread_id = thread_id;
+                const auto task_size = TaskSize::make(task.taskSize());
+                {
+                    MUSTACHE_PROFILER_BLOCK_LVL_0("onTaskBegin");
+                    onTaskBegin(world, task_size, invocation_index.task_index);
+                }
+                {
+                    MUSTACHE_PROFILER_BLOCK_LVL_0("singleTask");
+                    singleTask(world, task, invocation_index);
+                }
+                MUSTACHE_PROFILER_BLOCK_LVL_0("onTaskEnd");
+                onTaskEnd(world, task_size, invocation_index.task_index);
+            };
+            if (tasks != nullptr) {
+                tasks[num_tasks++].assign(std::move(function));
+            } else {
+                function(ThreadId::make(0));
             }
-            MUSTACHE_PROFILER_BLOCK_LVL_0("onTaskEnd");
-            onTaskEnd(world, task_size, invocation_index.task_index);
-        });
-        ++invocation_index.task_index;
-        invocation_index.entity_index = ParallelTaskGlobalItemIndex::make(invocation_index.entity_index.toInt() + task.taskSize());
+            ++invocation_index.task_index;
+            invocation_index.entity_index = ParallelTaskGlobalItemIndex::make(invocation_index.entity_index.toInt() + task.taskSize());
+        }
+    } catch (...) {
+        // tasks are not published, so they must not be counted by the batch
+        dispatcher.cancelTasks(tasks, task_count.toInt());
+        throw;
+    }
+    if (tasks != nullptr) {
+        dispatcher.publishTasks(tasks, num_tasks);
+        dispatcher.cancelTasks(tasks + num_tasks, task_count.toInt() - num_tasks);
     }
     dispatcher.waitForParallelFinish();
 }
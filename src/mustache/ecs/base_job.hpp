@@ -5,6 +5,7 @@
 #include <mustache/ecs/task_view.hpp>
 #include <mustache/ecs/world_filter.hpp>
 #include <mustache/ecs/component_mask.hpp>
+#include <mustache/ecs/component_version_storage.hpp>
 
 namespace mustache {
     class Archetype;
@@ -30,6 +31,10 @@ namespace mustache {
                                         JobInvocationIndex invocation_index) = 0;
         virtual ComponentIdMask checkMask() const noexcept = 0;
         virtual ComponentIdMask updateMask() const noexcept = 0;
+        /// components required by the job
+        [[nodiscard]] const ComponentIdMask& componentMask() const noexcept {
+            return filter_result_.mask;
+        }
         [[nodiscard]] virtual std::string name() const noexcept {
             return nameCStr();
         }
@@ -51,7 +56,35 @@ namespace mustache {
         virtual void onJobEnd(World&, TasksCount, JobSize total_entity_count, JobRunMode mode) noexcept;
 
     protected:
+        /// archetypes matching masks of the job with resolved component indices, only new archetypes are checked on run
+        struct ArchetypeMatchCache {
+            struct Item {
+                Archetype* archetype;
+                ArchetypeFilterParam check;
+                ArchetypeFilterParam set;
+                std::vector<ComponentIndex> required; // components of mask, their enable bits are checked
+            };
+            uint64_t entity_manager_id = 0u; // EntityManager::instanceId()
+            size_t checked_archetypes_count = 0u;
+            ComponentIdMask mask;
+            SharedComponentIdMask shared_component_mask;
+            ComponentIdMask exclude_mask;
+            std::vector<ComponentIdMask> any_of_masks;
+            ComponentIdMask check_mask;
+            ComponentIdMask set_mask;
+            std::vector<Item> items;
+            std::vector<ArchetypeIndex> found; // archetypes found by last update
+        };
+
+        /// checks exclude and any-of masks, required masks are checked by EntityManager::findArchetypes
+        static bool isArchetypeMatch(const Archetype& archetype, const ArchetypeMatchCache& cache) noexcept;
+
+        /// returns cached archetypes matching filter_result_ masks
+        std::vector<ArchetypeMatchCache::Item>& updateMatchCache(World& world, const ComponentIdMask& check,
+                                                                 const ComponentIdMask& set);
+
         WorldVersion last_update_version_;
         WorldFilterResult filter_result_;
+        ArchetypeMatchCache match_cache_;
     };
 }
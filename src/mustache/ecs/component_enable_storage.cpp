@@ -0,0 +1,155 @@
+#include "component_enable_storage.hpp"
+
+#include <mustache/utils/profiler.hpp>
+
+#include <algorithm>
+
+using namespace mustache;
+
+EnableStorage::EnableStorage(MemoryManager& memory_manager, uint32_t num_components, uint32_t chunk_size):
+        memory_manager_{&memory_manager},
+        num_components_{num_components},
+        chunk_size_{chunk_size},
+        words_per_chunk_{(chunk_size + kWordSize - 1u) / kWordSize},
+        chunks_{memory_manager},
+        disabled_count_{new std::atomic<uint32_t>[num_components]} {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__);
+    for (uint32_t i = 0; i < num_components_; ++i) {
+        disabled_count_[i].store(0u, std::memory_order_relaxed);
+    }
+}
+
+EnableStorage::~EnableStorage() {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__);
+    shrinkToFit(0u);
+}
+
+void EnableStorage::emplace(ArchetypeEntityIndex index) {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    if (num_components_ < 1u) {
+        return;
+    }
+    const auto required_chunks = index.toInt() / chunk_size_ + 1u;
+    while (chunks_.size() < required_chunks) {
+        const auto num_words = num_components_ * words_per_chunk_;
+        auto chunk = static_cast<std::atomic<uint64_t>*>(memory_manager_->allocate(
+                sizeof(std::atomic<uint64_t>) * num_words, alignof(std::atomic<uint64_t>)));
+        for (uint32_t i = 0; i < num_words; ++i) {
+            new(chunk + i) std::atomic<uint64_t>{0u};
+        }
+        chunks_.push_back(chunk);
+    }
+}
+
+void EnableStorage::shrinkToFit(uint32_t size) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__);
+    // bits of removed rows are reset, so chunks are released clean
+    const auto used_chunks = (size + chunk_size_ - 1u) / chunk_size_;
+    while (chunks_.size() > used_chunks) {
+        memory_manager_->deallocate(chunks_.back());
+        chunks_.pop_back();
+    }
+}
+
+bool EnableStorage::isEnabled(ComponentIndex component, ArchetypeEntityIndex index) const noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    if (!hasDisabled(component)) {
+        return true;
+    }
+    return (word(component, index).load(std::memory_order_relaxed) & bit(index, chunk_size_)) == 0u;
+}
+
+bool EnableStorage::setEnabled(ComponentIndex component, ArchetypeEntityIndex index, bool value) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    const auto mask = bit(index, chunk_size_);
+    auto& w = word(component, index);
+    if (value) {
+        if ((w.fetch_and(~mask, std::memory_order_relaxed) & mask) == 0u) {
+            return false;
+        }
+        disabled_count_[component.toInt()].fetch_sub(1u, std::memory_order_relaxed);
+        total_disabled_.fetch_sub(1u, std::memory_order_relaxed);
+        return true;
+    }
+    if ((w.fetch_or(mask, std::memory_order_relaxed) & mask) != 0u) {
+        return false;
+    }
+    disabled_count_[component.toInt()].fetch_add(1u, std::memory_order_relaxed);
+    total_disabled_.fetch_add(1u, std::memory_order_relaxed);
+    return true;
+}
+
+void EnableStorage::copy(ArchetypeEntityIndex destination, ArchetypeEntityIndex source) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    if (!hasDisabled()) {
+        return;
+    }
+    const auto source_mask = bit(source, chunk_size_);
+    for (auto component = ComponentIndex::make(0); component < ComponentIndex::make(num_components_); ++component) {
+        if (hasDisabled(component)) {
+            const bool is_disabled = (word(component, source).load(std::memory_order_relaxed) & source_mask) != 0u;
+            setEnabled(component, destination, !is_disabled);
+        }
+    }
+}
+
+void EnableStorage::copy(ComponentIndex destination_component, ArchetypeEntityIndex destination,
+                         const EnableStorage& source_storage, ComponentIndex source_component,
+                         ArchetypeEntityIndex source) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    if (!source_storage.isEnabled(source_component, source)) {
+        setEnabled(destination_component, destination, false);
+    }
+}
+
+void EnableStorage::reset(ArchetypeEntityIndex index) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    if (!hasDisabled()) {
+        return;
+    }
+    for (auto component = ComponentIndex::make(0); component < ComponentIndex::make(num_components_); ++component) {
+        if (hasDisabled(component)) {
+            setEnabled(component, index, true);
+        }
+    }
+}
+
+void EnableStorage::clear() noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    if (!hasDisabled()) {
+        return;
+    }
+    for (auto& chunk : chunks_) {
+        for (uint32_t i = 0; i < num_components_ * words_per_chunk_; ++i) {
+            chunk[i].store(0u, std::memory_order_relaxed);
+        }
+    }
+    for (uint32_t i = 0; i < num_components_; ++i) {
+        disabled_count_[i].store(0u, std::memory_order_relaxed);
+    }
+    total_disabled_.store(0u, std::memory_order_relaxed);
+}
+
+uint64_t EnableStorage::disabledBits(const ComponentIndex* components, uint32_t count,
+                                     ArchetypeEntityIndex index, uint32_t& num_rows) const noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    const auto row = index.toInt() % chunk_size_;
+    const auto shift = row % kWordSize;
+    num_rows = std::min(kWordSize - shift, chunk_size_ - row);
+    uint64_t result = 0u;
+    for (uint32_t i = 0; i < count; ++i) {
+        result |= word(components[i], index).load(std::memory_order_relaxed);
+    }
+    return result >> shift;
+}
+
+bool EnableStorage::isChunkDisabled(const ComponentIndex* components, uint32_t count, ChunkIndex chunk,
+                                    uint32_t size) const noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    const auto first = chunk.toInt() * chunk_size_;
+    if (count < 1u || first >= size) {
+        return false;
+    }
+    const auto num_rows = std::min(chunk_size_, size - first);
+    return countRows(components, count, ArchetypeEntityIndex::make(first), true, num_rows) == num_rows;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <mustache/utils/uncopiable.hpp>
+#include <mustache/utils/fast_log2_uint.hpp>
+#include <mustache/utils/memory_manager.hpp>
+
+#include <mustache/ecs/id_deff.hpp>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace mustache {
+
+    /**
+     * Per entity enable bits of archetype components, one bit per component per row stored per chunk.
+     * Bit is set for disabled component, so rows are enabled by default.
+     * setEnabled is thread safe, rows are added or moved only by structural changes.
+     */
+    class MUSTACHE_EXPORT EnableStorage : public Uncopiable {
+    public:
+        static constexpr uint32_t kWordSize = 64u;
+
+        EnableStorage(MemoryManager& memory_manager, uint32_t num_components, uint32_t chunk_size);
+        ~EnableStorage();
+
+        /// makes bits of rows up to index available
+        void emplace(ArchetypeEntityIndex index);
+
+        /// releases bit chunks not required by first size rows
+        void shrinkToFit(uint32_t size) noexcept;
+
+        [[nodiscard]] uint32_t chunkCount() const noexcept {
+            return static_cast<uint32_t>(chunks_.size());
+        }
+
+        [[nodiscard]] bool isEnabled(ComponentIndex component, ArchetypeEntityIndex index) const noexcept;
+
+        /// returns true if state was changed
+        bool setEnabled(ComponentIndex component, ArchetypeEntityIndex index, bool value) noexcept;
+
+        /// copies bits of all components from source row to destination row
+        void copy(ArchetypeEntityIndex destination, ArchetypeEntityIndex source) noexcept;
+
+        /// copies bit of one component from row of another archetype
+        void copy(ComponentIndex destination_component, ArchetypeEntityIndex destination,
+                  const EnableStorage& source_storage, ComponentIndex source_component,
+                  ArchetypeEntityIndex source) noexcept;
+
+        /// enables all components of row
+        void reset(ArchetypeEntityIndex index) noexcept;
+
+        /// enables all components of all rows
+        void clear() noexcept;
+
+        [[nodiscard]] bool hasDisabled() const noexcept {
+            return total_disabled_.load(std::memory_order_relaxed) > 0u;
+        }
+
+        [[nodiscard]] bool hasDisabled(ComponentIndex component) const noexcept {
+            return disabled_count_[component.toInt()].load(std::memory_order_relaxed) > 0u;
+        }
+
+        /**
+         * Bits of rows starting at index, set bit means any of components is disabled.
+         * Only first num_rows bits are valid, rows are not crossing end of word.
+         */
+        [[nodiscard]] uint64_t disabledBits(const ComponentIndex* components, uint32_t count,
+                                            ArchetypeEntityIndex index, uint32_t& num_rows) const noexcept;
+
+        /// number of consecutive rows starting at index which are (is_disabled) or are not disabled, at most limit
+        [[nodiscard]] uint32_t countRows(const ComponentIndex* components, uint32_t count, ArchetypeEntityIndex index,
+                                         bool is_disabled, uint32_t limit) const noexcept {
+            uint32_t result = 0u;
+            while (result < limit) {
+                uint32_t num_rows = 0u;
+                const auto bits = disabledBits(components, count, ArchetypeEntityIndex::make(index.toInt() + result),
+                                               num_rows);
+                const auto stop_bits = is_disabled ? ~bits : bits;
+                const auto run = stop_bits == 0u ? kWordSize : countTrailingZeros(stop_bits);
+                if (run < num_rows) {
+                    result += run;
+                    break;
+                }
+                result += num_rows;
+            }
+            return result < limit ? result : limit;
+        }
+
+        /// true if every row of the chunk has any of components disabled
+        [[nodiscard]] bool isChunkDisabled(const ComponentIndex* components, uint32_t count, ChunkIndex chunk,
+                                           uint32_t size) const noexcept;
+
+    private:
+        [[nodiscard]] std::atomic<uint64_t>& word(ComponentIndex component, ArchetypeEntityIndex index) const noexcept {
+            const auto chunk = index.toInt() / chunk_size_;
+            const auto row = index.toInt() - chunk * chunk_size_;
+            return chunks_[chunk][component.toInt() * words_per_chunk_ + row / kWordSize];
+        }
+        [[nodiscard]] static uint64_t bit(ArchetypeEntityIndex index, uint32_t chunk_size) noexcept {
+            return uint64_t{1u} << ((index.toInt() % chunk_size) % kWordSize);
+        }
+
+        MemoryManager* memory_manager_;
+        uint32_t num_components_;
+        uint32_t chunk_size_;
+        uint32_t words_per_chunk_;
+        std::vector<std::atomic<uint64_t>*, Allocator<std::atomic<uint64_t>*> > chunks_;
+        std::unique_ptr<std::atomic<uint32_t>[]> disabled_count_; // per component
+        std::atomic<uint32_t> total_disabled_{0u};
+    };
+}
@@ -4,6 +4,7 @@
 #include <mustache/utils/profiler.hpp>
 
 #include <map>
+#include <deque>
 #include <mutex>
 
 using namespace mustache;
@@ -18,7 +19,7 @@ namespace {
         };
         std::map<std::string, Element> type_map;
         IdType next_component_id{IdType::make(0)};
-        std::vector<ComponentInfo> components_info;
+        std::deque<ComponentInfo> components_info; // references stay valid on growth, commands keep pointers to infos
         mutable std::mutex mutex;
 
         IdType getId(const ComponentInfo& info) {
@@ -27,10 +28,11 @@ namespace {
             const auto find_res = type_map.find(info.name);
 
             if (find_res != type_map.end()) {
+                // info of registered component is not overwritten, other threads may use it
                 if(components_info.size() <= find_res->second.id.toInt()) {
                     components_info.resize(find_res->second.id.toInt() + 1);
+                    components_info[find_res->second.id.toInt()] = find_res->second.info;
                 }
-                components_info[find_res->second.id.toInt()] = find_res->second.info;
                 return find_res->second.id;
             }
             if (!info.default_value.empty() && info.default_value.size() != info.size) {
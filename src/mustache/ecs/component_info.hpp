@@ -73,6 +73,22 @@ namespace mustache {
         } functions;
 
         std::vector<std::byte> default_value; // this array will be used to init component in case of empty constructor
+        bool is_trivially_relocatable{false}; // component can be moved with memcpy, no destructor call required
+        bool is_tag{false}; // stateless component: takes no chunk memory and no per-row work, only marks archetype
+        bool uses_world{false}; // constructor or afterAssign gets World, so it may change entities
+
+        template<typename T>
+        static constexpr bool usesWorld() noexcept {
+            return std::is_constructible<T, World&, Entity>::value || std::is_constructible<T, Entity, World&>::value ||
+                   std::is_constructible<T, World&>::value || detail::hasAfterAssign<T>(nullptr);
+        }
+
+        template<typename T>
+        static constexpr bool isTag() noexcept {
+            return std::is_empty<T>::value && std::is_trivially_default_constructible<T>::value &&
+                   std::is_trivially_destructible<T>::value && std::is_trivially_copyable<T>::value &&
+                   !detail::hasBeforeRemove<T>(nullptr) && !detail::hasAfterAssign<T>(nullptr);
+        }
 
         template<typename T>
         static void componentConstructor(void *ptr, [[maybe_unused]] const Entity& entity, [[maybe_unused]] World& world) {
@@ -177,7 +193,10 @@ namespace mustache {
                         &componentComparator<T>,
                         detail::hasBeforeRemove<T>(nullptr) ? &beforeComponentRemove<T> : ComponentInfo::BeforeRemove{},
                         detail::hasAfterAssign<T>(nullptr) ? &afterComponentAssign<T> : ComponentInfo::AfterAssing{},
-                }, {}
+                }, {},
+                std::is_trivially_copyable<T>::value,
+                isTag<T>(),
+                usesWorld<T>()
             };
             return result;
         }
@@ -64,6 +64,11 @@ namespace mustache {
             return (value_ & rhs.value_) == rhs.value_;
         }
 
+        /// true if at least one item of rhs is in the mask
+        [[nodiscard]] bool isMatchAny(const ComponentMask& rhs) const noexcept {
+            return (value_ & rhs.value_).any();
+        }
+
         [[nodiscard]] bool has(_ItemType item) const noexcept{
             return value_.test(item.toInt());
         }
@@ -6,20 +6,52 @@ using namespace mustache;
 
 VersionStorage::VersionStorage(MemoryManager& memory_manager, uint32_t num_components, uint32_t chunk_size):
         chunk_size_{chunk_size},
+        block_size_{std::min(chunk_size, kBlockSize)},
+        blocks_per_chunk_{block_size_ > 0u ? (chunk_size + block_size_ - 1u) / block_size_ : 0u},
         chunk_versions_{memory_manager},
+        block_versions_{memory_manager},
         global_versions_{memory_manager} {
     MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__);
     global_versions_.resize(num_components);
 }
 
+void VersionStorage::resize(ChunkIndex last_chunk) {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    const auto required_size = last_chunk.next().toInt<size_t>() * numComponents();
+    if (chunk_versions_.size() < required_size) {
+        chunk_versions_.resize(required_size);
+        block_versions_.resize(required_size * blocks_per_chunk_);
+    }
+}
+
 void VersionStorage::emplace(WorldVersion version, ArchetypeEntityIndex index) noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__);
-    const auto chunk = chunkAt(index);
-    if (chunk.toInt<size_t>() * numComponents() <= chunk_versions_.size()) {
-        chunk_versions_.resize(chunk.next().toInt<size_t>() * numComponents());
-    }
+    resize(chunkAt(index));
+    setVersion(version, index);
+}
 
-    setVersion(version, chunk);
+void VersionStorage::emplace(WorldVersion version, ArchetypeEntityIndex first, uint32_t count) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__);
+    if (count < 1u) {
+        return;
+    }
+    const auto last = ArchetypeEntityIndex::make(first.toInt() + count - 1u);
+    const auto first_chunk = chunkAt(first);
+    const auto last_chunk = chunkAt(last);
+    resize(last_chunk);
+    for (auto chunk = first_chunk; chunk <= last_chunk; ++chunk) {
+        const auto begin = numComponents() * chunk.toInt();
+        for (uint32_t i = 0; i < numComponents(); ++i) {
+            chunk_versions_[begin + i] = version;
+        }
+    }
+    const auto last_block = blockAt(last);
+    for (auto block = blockAt(first); block <= last_block; ++block) {
+        setBlockVersion(version, block);
+    }
+    for (uint32_t i = 0; i < numComponents(); ++i) {
+        global_versions_[ComponentIndex::make(i)] = version;
+    }
 }
 
 void VersionStorage::setVersion(WorldVersion version, ChunkIndex chunk) noexcept {
@@ -29,6 +61,20 @@ void VersionStorage::setVersion(WorldVersion version, ChunkIndex chunk) noexcept
         global_versions_[ComponentIndex::make(i)] = version;
         chunk_versions_[begin + i] = version;
     }
+    const auto first_block = firstBlock(chunk);
+    for (uint32_t i = 0; i < blocks_per_chunk_; ++i) {
+        setBlockVersion(version, VersionBlockIndex::make(first_block.toInt() + i));
+    }
+}
+
+void VersionStorage::setVersion(WorldVersion version, ArchetypeEntityIndex index) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    const auto begin = numComponents() * chunkAt(index).toInt();
+    for (uint32_t i = 0; i < numComponents(); ++i) {
+        global_versions_[ComponentIndex::make(i)] = version;
+        chunk_versions_[begin + i] = version;
+    }
+    setBlockVersion(version, blockAt(index));
 }
 
 void VersionStorage::setVersion(WorldVersion version, ComponentIndex component_index) noexcept {
@@ -40,9 +86,51 @@ void VersionStorage::setVersion(WorldVersion version, ChunkIndex chunk, Componen
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
     const auto update_index = numComponents() * chunk.toInt() + component.toInt();
     chunk_versions_[update_index] = version;
+    const auto first_block = firstBlock(chunk);
+    for (uint32_t i = 0; i < blocks_per_chunk_; ++i) {
+        block_versions_[numComponents() * (first_block.toInt() + i) + component.toInt()] = version;
+    }
     setVersion(version, component);
 }
 
+void VersionStorage::setVersion(WorldVersion version, ArchetypeEntityIndex index, ComponentIndex component) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    chunk_versions_[numComponents() * chunkAt(index).toInt() + component.toInt()] = version;
+    block_versions_[numComponents() * blockAt(index).toInt() + component.toInt()] = version;
+    setVersion(version, component);
+}
+
+void VersionStorage::setBlockVersion(WorldVersion version, VersionBlockIndex block) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    const auto begin = numComponents() * block.toInt();
+    for (uint32_t i = 0; i < numComponents(); ++i) {
+        block_versions_[begin + i] = version;
+    }
+}
+
+void VersionStorage::setVersion(const MaskAndVersion& set, ChunkIndex chunk) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    if (set.mask.empty()) {
+        return;
+    }
+    setChunkVersion(set, chunk);
+    const auto first_block = firstBlock(chunk);
+    for (uint32_t i = 0; i < blocks_per_chunk_; ++i) {
+        auto versions = block_versions_.data() + numComponents() * (first_block.toInt() + i);
+        for (auto component_index : set.mask) {
+            versions[component_index.toInt()] = set.version;
+        }
+    }
+}
+
+void VersionStorage::setChunkVersion(const MaskAndVersion& set, ChunkIndex chunk) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    auto versions = chunk_versions_.data() + numComponents() * chunk.toInt();
+    for (auto component_index : set.mask) {
+        versions[component_index.toInt()] = set.version;
+    }
+}
+
 WorldVersion VersionStorage::getVersion(ComponentIndex component) const noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
     return global_versions_[component];
@@ -54,6 +142,12 @@ WorldVersion VersionStorage::getVersion(ChunkIndex chunk, ComponentIndex compone
     return chunk_version[component.toInt()];
 }
 
+WorldVersion VersionStorage::getVersion(VersionBlockIndex block, ComponentIndex component) const noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    const WorldVersion* block_version = block_versions_.data() + numComponents() * block.toInt();
+    return block_version[component.toInt()];
+}
+
 bool VersionStorage::checkAndSet(const MaskAndVersion& check, const MaskAndVersion& set) noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
     bool need_update = check.version.isNull() || check.mask.empty();
@@ -73,10 +167,10 @@ bool VersionStorage::checkAndSet(const MaskAndVersion& check, const MaskAndVersi
     return need_update;
 }
 
-bool VersionStorage::checkAndSet(const MaskAndVersion& check, const MaskAndVersion& set, ChunkIndex chunk) noexcept {
+bool VersionStorage::checkAndSet(const MaskAndVersion& check, const MaskAndVersion& set,
+                                 VersionBlockIndex block) noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
-    const auto first_index = numComponents() * chunk.toInt();
-    auto versions = chunk_versions_.data() + first_index;
+    auto versions = block_versions_.data() + numComponents() * block.toInt();
     bool result = check.version.isNull() || check.mask.empty();
     if (!result) {
         for (auto component_index : check.mask) {
@@ -95,6 +189,20 @@ bool VersionStorage::checkAndSet(const MaskAndVersion& check, const MaskAndVersi
     return result;
 }
 
+bool VersionStorage::isChanged(const MaskAndVersion& check, ChunkIndex chunk) const noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    if (check.version.isNull() || check.mask.empty()) {
+        return true;
+    }
+    const auto versions = chunk_versions_.data() + numComponents() * chunk.toInt();
+    for (auto component_index : check.mask) {
+        if (versions[component_index.toInt()] > check.version) {
+            return true;
+        }
+    }
+    return false;
+}
+
 uint32_t VersionStorage::numComponents() const noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
     return static_cast<uint32_t >(global_versions_.size());
@@ -105,6 +213,12 @@ ChunkIndex VersionStorage::chunkAt(ArchetypeEntityIndex index) const noexcept {
     return ChunkIndex::make(index.toInt() / chunk_size_);
 }
 
+VersionBlockIndex VersionStorage::blockAt(ArchetypeEntityIndex index) const noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    const auto chunk = index.toInt() / chunk_size_;
+    return VersionBlockIndex::make(chunk * blocks_per_chunk_ + (index.toInt() - chunk * chunk_size_) / block_size_);
+}
+
 uint32_t VersionStorage::chunkSize() const noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
     return chunk_size_;
@@ -5,6 +5,8 @@
 #include <mustache/ecs/id_deff.hpp>
 #include <mustache/ecs/component_mask.hpp>
 
+#include <algorithm>
+
 namespace mustache {
     class MemoryManager;
 
@@ -13,33 +15,109 @@ namespace mustache {
         std::vector<ComponentIndex> mask;
     };
 
+    /**
+     * Component versions on three levels: whole archetype, chunk and block of (up to) kBlockSize entities.
+     * Version of chunk is the max of versions of its blocks, so unchanged chunk skips all its blocks.
+     */
     class MUSTACHE_EXPORT VersionStorage : public Uncopiable {
     public:
+        static constexpr uint32_t kBlockSize = 32u;
 
         VersionStorage(MemoryManager& memory_manager, uint32_t num_components, uint32_t chunk_size);
 
+        /// stamps block (and chunk) of index
         void emplace(WorldVersion version, ArchetypeEntityIndex index) noexcept;
+        /// emplaces count entities starting at first, every touched block is stamped once
+        void emplace(WorldVersion version, ArchetypeEntityIndex first, uint32_t count) noexcept;
 
+        /// all components of the chunk and its blocks
         void setVersion(WorldVersion version, ChunkIndex chunk) noexcept;
+        /// all components of the block (and chunk) containing entity
+        void setVersion(WorldVersion version, ArchetypeEntityIndex index) noexcept;
         void setVersion(WorldVersion version, ComponentIndex component) noexcept;
         void setVersion(WorldVersion version, ChunkIndex chunk, ComponentIndex component) noexcept;
+        void setVersion(WorldVersion version, ArchetypeEntityIndex index, ComponentIndex component) noexcept;
 
         [[nodiscard]] WorldVersion getVersion(ComponentIndex component) const noexcept;
         [[nodiscard]] WorldVersion getVersion(ChunkIndex chunk, ComponentIndex component) const noexcept;
+        [[nodiscard]] WorldVersion getVersion(VersionBlockIndex block, ComponentIndex component) const noexcept;
         [[nodiscard]] WorldVersion getVersion(ArchetypeEntityIndex entity_index, ComponentIndex component) const noexcept {
-            return getVersion(ChunkIndex::make(entity_index.toInt() / chunkSize()), component);
+            return getVersion(blockAt(entity_index), component);
         }
 
         bool checkAndSet(const MaskAndVersion& check, const MaskAndVersion& set) noexcept;
-        bool checkAndSet(const MaskAndVersion& check, const MaskAndVersion& set, ChunkIndex chunk) noexcept;
+        bool checkAndSet(const MaskAndVersion& check, const MaskAndVersion& set, VersionBlockIndex block) noexcept;
+
+        /// true if any component from check.mask was changed in chunk after check.version
+        [[nodiscard]] bool isChanged(const MaskAndVersion& check, ChunkIndex chunk) const noexcept;
+
+        /**
+         * Checks blocks of the chunk (only rows below size), stamps matched ones with set.version
+         * and calls on_range(begin, end) for every run of matched rows.
+         */
+        template<typename _F>
+        void filterChunk(const MaskAndVersion& check, const MaskAndVersion& set, ChunkIndex chunk, uint32_t size,
+                         _F&& on_range) {
+            const uint32_t chunk_begin = chunk.toInt() * chunk_size_;
+            const uint32_t chunk_end = std::min(chunk_begin + chunk_size_, size);
+            if (chunk_begin >= chunk_end) {
+                return;
+            }
+            if (check.version.isNull() || check.mask.empty()) {
+                setVersion(set, chunk);
+                on_range(ArchetypeEntityIndex::make(chunk_begin), ArchetypeEntityIndex::make(chunk_end));
+                return;
+            }
+            if (!isChanged(check, chunk)) {
+                return;
+            }
+            bool is_prev_match = false;
+            bool is_any_match = false;
+            uint32_t range_begin = chunk_begin;
+            auto block = firstBlock(chunk);
+            for (uint32_t begin = chunk_begin; begin < chunk_end; begin += block_size_, ++block) {
+                const bool is_match = checkAndSet(check, set, block);
+                if (is_match && !is_prev_match) {
+                    range_begin = begin;
+                }
+                if (!is_match && is_prev_match) {
+                    on_range(ArchetypeEntityIndex::make(range_begin), ArchetypeEntityIndex::make(begin));
+                }
+                is_prev_match = is_match;
+                is_any_match = is_any_match || is_match;
+            }
+            if (is_prev_match) {
+                on_range(ArchetypeEntityIndex::make(range_begin), ArchetypeEntityIndex::make(chunk_end));
+            }
+            if (is_any_match) {
+                setChunkVersion(set, chunk);
+            }
+        }
 
         [[nodiscard]] ChunkIndex chunkAt(ArchetypeEntityIndex) const noexcept;
+        [[nodiscard]] VersionBlockIndex blockAt(ArchetypeEntityIndex) const noexcept;
+        [[nodiscard]] VersionBlockIndex firstBlock(ChunkIndex chunk) const noexcept {
+            return VersionBlockIndex::make(chunk.toInt() * blocks_per_chunk_);
+        }
 
         [[nodiscard]] uint32_t numComponents() const noexcept;
         [[nodiscard]] uint32_t chunkSize() const noexcept;
+        [[nodiscard]] uint32_t blockSize() const noexcept {
+            return block_size_;
+        }
     protected:
+        /// stamps components of set.mask in chunk and all its blocks
+        void setVersion(const MaskAndVersion& set, ChunkIndex chunk) noexcept;
+        /// stamps components of set.mask in chunk only
+        void setChunkVersion(const MaskAndVersion& set, ChunkIndex chunk) noexcept;
+        void setBlockVersion(WorldVersion version, VersionBlockIndex block) noexcept;
+        void resize(ChunkIndex last_chunk);
+
         uint32_t chunk_size_;
+        uint32_t block_size_;
+        uint32_t blocks_per_chunk_;
         std::vector<WorldVersion, Allocator<WorldVersion> > chunk_versions_; // per chunk component version
+        std::vector<WorldVersion, Allocator<WorldVersion> > block_versions_; // per block component version
         mustache::ArrayWrapper<WorldVersion, ComponentIndex, true> global_versions_; // global component version
     };
 }
@@ -2,66 +2,176 @@
 
 #include <mustache/utils/logger.hpp>
 #include <mustache/utils/profiler.hpp>
+#include <mustache/utils/fast_log2_uint.hpp>
 
 #include <mustache/ecs/component_factory.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 using namespace mustache;
 
-namespace {
-    constexpr auto kChunkCapacity = ChunkCapacity::make(1024 * 16);
+ChunkCapacity DefaultComponentDataStorage::chunkCapacityFor(const ComponentIdMask& mask,
+                                                            uint32_t chunk_bytes) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
+    size_t row_size = 0u;
+    mask.forEachItem([&row_size](ComponentId id) {
+        const auto& info = ComponentFactory::componentInfo(id);
+        if (!info.is_tag) {
+            row_size += info.size;
+        }
+    });
+    if (row_size == 0u) {
+        return ChunkCapacity::make(kMaxChunkCapacity);
+    }
+    const auto rows = std::clamp(chunk_bytes / row_size, size_t{kMinChunkCapacity}, size_t{kMaxChunkCapacity});
+    return ChunkCapacity::make(1u << fastLog2_2(static_cast<uint32_t>(rows)));
 }
 
-DefaultComponentDataStorage::DefaultComponentDataStorage(const ComponentIdMask& mask, MemoryManager& memory_manager):
+DefaultComponentDataStorage::DefaultComponentDataStorage(const ComponentIdMask& mask, MemoryManager& memory_manager,
+                                                         ChunkCapacity chunk_capacity, ChunkCapacity initial_capacity):
     BaseComponentDataStorage{},
     memory_manager_{&memory_manager},
+    components_{memory_manager},
     component_getter_info_{memory_manager},
-    chunk_capacity_{kChunkCapacity},
+    chunk_capacity_{chunk_capacity},
+    chunk_shift_{fastLog2_2(chunk_capacity.toInt())},
+    chunk_mask_{chunk_capacity.toInt() - 1u},
     chunks_{memory_manager} {
     MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__);
+    if (chunk_capacity.toInt() != (1u << chunk_shift_)) {
+        throw std::runtime_error("Chunk capacity must be a power of two: " + std::to_string(chunk_capacity.toInt()));
+    }
+    initial_capacity_ = chunk_capacity.toInt();
+    if (initial_capacity.isValid() && initial_capacity.toInt() > 0u && initial_capacity < chunk_capacity) {
+        const auto log2 = fastLog2_2(initial_capacity.toInt());
+        initial_capacity_ = (1u << log2) < initial_capacity.toInt() ? 2u << log2 : 1u << log2;
+    }
+    first_chunk_capacity_ = initial_capacity_;
     if (!mask.isEmpty()) {
-        component_getter_info_.reserve(mask.componentsCount());
+        components_.reserve(mask.componentsCount());
+        chunk_align_ = 1u;
+        mask.forEachItem([this](ComponentId id) {
+            components_.push_back(id);
+            chunk_align_ = std::max(chunk_align_, static_cast<uint32_t>(ComponentFactory::componentInfo(id).align));
+        });
+        component_getter_info_.resize(components_.size());
+        chunk_size_ = updateLayout(chunk_capacity_.toInt());
+        first_chunk_size_ = updateLayout(first_chunk_capacity_);
+    }
+    Logger{}.debug("New ComponentDataStorage has been created, components: %s | chunk capacity: %d | initial: %d",
+                  mask.toString().c_str(), chunkCapacity().toInt(), initial_capacity_);
+}
 
-        auto offset = ComponentOffset::make(0u);
-        mask.forEachItem([this, &offset, &mask](ComponentId id) {
-            const auto& info = ComponentFactory::componentInfo(id);
-            if (offset.toInt() == 0) {
-                chunk_align_ = static_cast<uint32_t>(info.align);
+uint32_t DefaultComponentDataStorage::updateLayout(uint32_t capacity) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__);
+    auto offset = ComponentOffset::make(0u);
+    for (auto index = ComponentIndex::make(0); index < ComponentIndex::make(components_.size()); ++index) {
+        const auto& info = ComponentFactory::componentInfo(components_[index]);
+        auto& getter = component_getter_info_[index];
+        if (info.is_tag) {
+            // tags have no column, every row points to the chunk begin
+            getter.offset = ComponentOffset::make(0u);
+            getter.size = 0u;
+            continue;
+        }
+        getter.offset = offset.alignAs(static_cast<uint32_t>(info.align));
+        getter.size = static_cast<uint32_t>(info.size);
+        offset = getter.offset.add(capacity * info.size);
+    }
+    // archetype of tags only still needs chunks to address rows
+    return std::max(offset.alignAs(chunk_align_).toInt(), chunk_align_);
+}
+
+void DefaultComponentDataStorage::resizeFirstChunk(uint32_t capacity) {
+    MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__);
+    const std::vector<ComponentDataGetter> prev_getters{component_getter_info_.begin(), component_getter_info_.end()};
+    const auto chunk_size = updateLayout(capacity);
+    auto chunk = static_cast<ChunkPtr>(memory_manager_->allocateChunk(chunk_size, chunk_align_));
+    if (chunk == nullptr) {
+        throw std::runtime_error("Can not allocate memory for chunk of capacity: " + std::to_string(capacity));
+    }
+    if (!chunks_.empty()) {
+        auto prev_chunk = chunks_[ChunkIndex::make(0)];
+        for (auto index = ComponentIndex::make(0); index < ComponentIndex::make(components_.size()); ++index) {
+            const auto& getter = component_getter_info_[index];
+            if (getter.size == 0u) {
+                continue;
             }
-            ComponentDataGetter getter;
-            getter.offset = offset.alignAs(static_cast<uint32_t>(info.align));
-            getter.size = static_cast<uint32_t>(info.size);
-            component_getter_info_.push_back(getter);
-            offset = getter.offset.add(chunk_capacity_.toInt() * info.size);
-        });
+            const auto& info = ComponentFactory::componentInfo(components_[index]);
+            auto source = dataPointerWithOffset<std::byte>(prev_chunk, prev_getters[index.toInt()].offset);
+            auto dest = dataPointerWithOffset<std::byte>(chunk, getter.offset);
+            if (info.is_trivially_relocatable || !info.functions.move_constructor) {
+                memcpy(dest, source, static_cast<size_t>(size_) * getter.size);
+                continue;
+            }
+            for (uint32_t i = 0; i < size_; ++i) {
+                info.functions.move_constructor(dest + i * getter.size, source + i * getter.size);
+                if (info.functions.destroy) {
+                    info.functions.destroy(source + i * getter.size);
+                }
+            }
+        }
+        freeChunk(prev_chunk, first_chunk_size_);
+        chunks_[ChunkIndex::make(0)] = chunk;
+    } else {
+        chunks_.push_back(chunk);
+    }
+    first_chunk_capacity_ = capacity;
+    first_chunk_size_ = chunk_size;
+}
 
-        chunk_size_ = offset.alignAs(chunk_align_).toInt();
+void DefaultComponentDataStorage::resetFirstChunk() noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__);
+    if (first_chunk_capacity_ != initial_capacity_) {
+        first_chunk_capacity_ = initial_capacity_;
+        first_chunk_size_ = updateLayout(first_chunk_capacity_);
     }
-    Logger{}.debug("New ComponentDataStorage has been created, components: %s | chunk capacity: %d",
-                  mask.toString().c_str(), chunkCapacity().toInt());
 }
 
 void DefaultComponentDataStorage::allocateChunk() {
     MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__);
-    auto chunk = static_cast<ChunkPtr>(memory_manager_->allocate(chunk_size_, chunk_align_));
+    if (!decommitted_chunks_.empty()) {
+        chunks_.push_back(decommitted_chunks_.back());
+        decommitted_chunks_.pop_back();
+        return;
+    }
+    auto chunk = static_cast<ChunkPtr>(memory_manager_->allocateChunk(chunk_size_, chunk_align_));
     if (chunk == nullptr) {
         throw std::runtime_error("Can not allocate memory for chunk: " + std::to_string(chunks_.size()));
     }
     chunks_.push_back(chunk);
 }
 
-void DefaultComponentDataStorage::freeChunk(ChunkPtr chunk) noexcept {
+void DefaultComponentDataStorage::freeChunk(ChunkPtr chunk, uint32_t size) noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__);
-    memory_manager_->deallocate(chunk);
+    memory_manager_->deallocateChunk(chunk, size);
 }
 
 uint32_t DefaultComponentDataStorage::capacity() const noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
-    return static_cast<uint32_t>(chunk_capacity_.toInt() * chunks_.size());
+    if (chunks_.empty()) {
+        return 0u;
+    }
+    return static_cast<uint32_t>(first_chunk_capacity_ + chunk_capacity_.toInt() * (chunks_.size() - 1u));
 }
 
 void DefaultComponentDataStorage::reserve(size_t new_capacity) {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
-    while (chunk_size_ > 0u && capacity() < new_capacity) {
+    if (chunk_size_ < 1u || capacity() >= new_capacity) {
+        return;
+    }
+    const auto full_capacity = chunk_capacity_.toInt();
+    if (first_chunk_capacity_ < full_capacity) {
+        // at least doubles, first chunk is grown up to full one before the second chunk is allocated
+        auto capacity = chunks_.empty() ? first_chunk_capacity_ : 2u * first_chunk_capacity_;
+        while (capacity < new_capacity && capacity < full_capacity) {
+            capacity *= 2u;
+        }
+        resizeFirstChunk(std::min(capacity, full_capacity));
+    }
+    while (capacity() < new_capacity) {
         allocateChunk();
     }
 }
@@ -69,23 +179,50 @@ void DefaultComponentDataStorage::reserve(size_t new_capacity) {
 void DefaultComponentDataStorage::clear(bool free_chunks) {
     MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__);
     if (free_chunks) {
-        for (auto chunk : chunks_) {
-            freeChunk(chunk);
+        for (auto index = ChunkIndex::make(0); index < ChunkIndex::make(chunks_.size()); ++index) {
+            freeChunk(chunks_[index], index.toInt() == 0u ? first_chunk_size_ : chunk_size_);
         }
         chunks_.clear();
         chunks_.shrink_to_fit();
+        for (auto chunk : decommitted_chunks_) {
+            freeChunk(chunk, chunk_size_);
+        }
+        decommitted_chunks_.clear();
+        resetFirstChunk();
     }
     size_ = 0;
 }
 
+uint32_t DefaultComponentDataStorage::shrinkToFit(uint32_t spare_chunks, uint32_t max_chunks) {
+    MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__);
+    const auto used_chunks = size_ > 0u ? ((size_ - 1u) >> chunk_shift_) + 1u : 0u;
+    uint32_t released = 0u;
+    while (released < max_chunks && chunks_.size() > used_chunks + spare_chunks) {
+        auto chunk = chunks_.back();
+        chunks_.pop_back();
+        ++released;
+        // the first chunk may be smaller than others, it is not reused
+        const bool is_full = !chunks_.empty() || first_chunk_capacity_ == chunk_capacity_.toInt();
+        if (is_full && memory_manager_->decommit(chunk, chunk_size_)) {
+            decommitted_chunks_.push_back(chunk);
+        } else {
+            freeChunk(chunk, chunks_.empty() ? first_chunk_size_ : chunk_size_);
+        }
+    }
+    if (chunks_.empty()) {
+        // empty storage starts from the small chunk again
+        resetFirstChunk();
+    }
+    return released;
+}
+
 uint32_t DefaultComponentDataStorage::distToChunkEnd(ComponentStorageIndex global_index) const noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
     const auto diff = [](const auto a, const auto b) noexcept{
         return b > a ? b - a : 0;
     };
     const auto storage_size = size();
-    const auto index_in_chunk = (global_index % chunkCapacity());
-    const auto elements_in_chunk = chunkCapacity().toInt() - index_in_chunk.toInt();
+    const auto elements_in_chunk = chunk_capacity_.toInt() - (global_index.toInt() & chunk_mask_);
     const auto elements_in_arch = diff(global_index.toInt(), storage_size);
     return std::min(elements_in_arch, elements_in_chunk);
 }
@@ -98,19 +235,17 @@ void* DefaultComponentDataStorage::getDataSafe(ComponentIndex component_index,
         !component_getter_info_.has(component_index) || index.toInt() >= size_) {
         return nullptr;
     }
-    const auto chunk_index = index % chunk_capacity_;
     const auto& info = component_getter_info_[component_index];
-    const auto offset = info.offset.add(info.size * chunk_index.toInt<size_t>());
-    auto chunk = chunks_[index / chunk_capacity_];
+    const auto offset = info.offset.add(info.size * static_cast<size_t>(index.toInt() & chunk_mask_));
+    auto chunk = chunks_[ChunkIndex::make(index.toInt() >> chunk_shift_)];
     return dataPointerWithOffset(chunk, offset);
 }
 
 void* DefaultComponentDataStorage::getDataUnsafe(ComponentIndex component_index,
                                                  ComponentStorageIndex index) const noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__);
-    const auto chunk_index = index % chunk_capacity_;
     const auto& info = component_getter_info_[component_index];
-    const auto offset = info.offset.add(info.size * chunk_index.toInt<size_t>());
-    auto chunk = chunks_[index / chunk_capacity_];
+    const auto offset = info.offset.add(info.size * static_cast<size_t>(index.toInt() & chunk_mask_));
+    auto chunk = chunks_[ChunkIndex::make(index.toInt() >> chunk_shift_)];
     return dataPointerWithOffset(chunk, offset);
 }
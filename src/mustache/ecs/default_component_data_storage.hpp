@@ -5,12 +5,27 @@
 #include <mustache/ecs/component_mask.hpp>
 #include <mustache/ecs/base_component_data_storage.hpp>
 
+#include <vector>
+
 namespace mustache {
     class MemoryManager;
 
     class DefaultComponentDataStorage : public BaseComponentDataStorage {
     public:
-        DefaultComponentDataStorage(const ComponentIdMask& mask, MemoryManager& memory_manager);
+        static constexpr uint32_t kDefaultChunkBytes = 64u * 1024u;
+        static constexpr uint32_t kMinChunkCapacity = 32u;
+        static constexpr uint32_t kMaxChunkCapacity = 16u * 1024u;
+
+        /// rows per chunk: largest power of two with chunk_bytes >= rows * row size, clamped by min/max capacity
+        [[nodiscard]] static ChunkCapacity chunkCapacityFor(const ComponentIdMask& mask, uint32_t chunk_bytes) noexcept;
+
+        /**
+         * chunk_capacity must be a power of two.
+         * First chunk is allocated for initial_capacity rows (rounded up to a power of two, null means full chunk)
+         * and doubles up to chunk_capacity, rows are relocated on every growth.
+         */
+        DefaultComponentDataStorage(const ComponentIdMask& mask, MemoryManager& memory_manager,
+                                    ChunkCapacity chunk_capacity, ChunkCapacity initial_capacity = ChunkCapacity::null());
 
         uint32_t capacity() const noexcept override;
 
@@ -18,6 +33,8 @@ namespace mustache {
 
         void clear(bool free_chunks) override;
 
+        uint32_t shrinkToFit(uint32_t spare_chunks, uint32_t max_chunks) override;
+
         uint32_t distToChunkEnd(ComponentStorageIndex index) const noexcept override;
 
         [[nodiscard]] MUSTACHE_INLINE ChunkCapacity chunkCapacity() const noexcept {
@@ -37,7 +54,16 @@ namespace mustache {
         using ChunkPtr = std::byte*;
 
         void allocateChunk();
-        void freeChunk(ChunkPtr chunk) noexcept;
+        void freeChunk(ChunkPtr chunk, uint32_t size) noexcept;
+
+        /// updates offsets of components for chunk with capacity rows, returns size of chunk in bytes
+        uint32_t updateLayout(uint32_t capacity) noexcept;
+
+        /// reallocates the first chunk for capacity rows and relocates stored rows
+        void resizeFirstChunk(uint32_t capacity);
+
+        /// layout of empty storage for the first chunk of initial capacity
+        void resetFirstChunk() noexcept;
 
         template <typename T = std::byte>
         [[nodiscard]] MUSTACHE_INLINE static T* data(ChunkPtr chunk) noexcept {
@@ -50,9 +76,16 @@ namespace mustache {
         }
 
         MemoryManager* memory_manager_ = nullptr;
+        ArrayWrapper<ComponentId, ComponentIndex, true> components_;
         ArrayWrapper<ComponentDataGetter, ComponentIndex, true> component_getter_info_; // ComponentIndex -> {offset, size}
         ChunkCapacity chunk_capacity_;
+        uint32_t initial_capacity_ {0u};
+        uint32_t first_chunk_capacity_ {0u}; // less than chunk capacity until the first chunk is grown up
+        uint32_t first_chunk_size_ {0u}; // bytes
+        uint32_t chunk_shift_ {0u}; // log2 of chunk capacity
+        uint32_t chunk_mask_ {0u}; // chunk capacity - 1
         ArrayWrapper<ChunkPtr, ChunkIndex, true> chunks_;
+        std::vector<ChunkPtr> decommitted_chunks_; // released full chunks without physical memory, reused first
         uint32_t chunk_size_ {0u};
         uint32_t chunk_align_ {0u};
     };
@@ -3,3 +3,13 @@
 //
 
 #include "entity_group.hpp"
+
+using namespace mustache;
+
+EntityGroup::Iterator EntityGroup::begin() const {
+    return Iterator{this, 0u};
+}
+
+EntityGroup::Iterator EntityGroup::end() const {
+    return Iterator{this, size()};
+}
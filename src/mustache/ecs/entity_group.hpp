@@ -7,13 +7,13 @@ namespace mustache {
 
     class MUSTACHE_EXPORT EntityGroup {
     public:
-        EntityGroup(std::vector<Entity>&& fragmented, uint32_t first, uint32_t count):
+        EntityGroup(std::vector<Entity>&& fragmented, Entity first, uint32_t count):
                 fragmented_(std::move(fragmented)),
                 first_{first},
                 count_{count} {
 
         };
-        EntityGroup(const std::vector<Entity>& fragmented, uint32_t first, uint32_t count):
+        EntityGroup(const std::vector<Entity>& fragmented, Entity first, uint32_t count):
                 fragmented_(fragmented),
                 first_{first},
                 count_{count} {
@@ -46,7 +46,7 @@ namespace mustache {
                 return fragmented_[index];
             }
             if(index - fragmented_.size() < count_) {
-                return Entity::makeFromValue(first_ + index);
+                return contiguousAt(index);
             }
             throw std::out_of_range("Invalid index");
         }
@@ -54,7 +54,7 @@ namespace mustache {
             if(index < fragmented_.size()) {
                 return fragmented_[index];
             }
-            return Entity::makeFromValue(first_ + index);
+            return contiguousAt(index);
         }
 
         [[nodiscard]] Iterator begin() const;
@@ -66,9 +66,20 @@ namespace mustache {
         [[nodiscard]] uint32_t size() const noexcept {
             return count_ + numFragmented();
         }
+        /// first entity of the contiguous id range, entities in the range have sequential ids and same version
+        [[nodiscard]] Entity first() const noexcept {
+            return first_;
+        }
+        [[nodiscard]] uint32_t numContiguous() const noexcept {
+            return count_;
+        }
     private:
+        [[nodiscard]] Entity contiguousAt(uint32_t index) const noexcept {
+            return Entity::makeFromValue(first_.value + (index - numFragmented()));
+        }
+
         std::vector<Entity> fragmented_;
-        uint32_t first_{0u};
+        Entity first_;
         uint32_t count_{0u};
     };
 }
@@ -4,6 +4,8 @@
 
 #include <mustache/ecs/world.hpp>
 
+#include <algorithm>
+
 using namespace mustache;
 
 namespace mustache {
@@ -12,11 +14,18 @@ namespace mustache {
     }
 }
 
+namespace {
+    std::atomic<uint64_t> next_instance_id{1u};
+}
+
 EntityManager::EntityManager(World& world):
         world_{world},
         entities_{world.memoryManager()},
         locations_{world.memoryManager()},
         marked_for_delete_{world.memoryManager()},
+        marked_for_delete_mask_{world.memoryManager()},
+        replay_slots_{world.memoryManager()},
+        instance_id_{next_instance_id++},
         this_world_id_{world.id()},
         world_version_{world.version()},
         archetypes_{world.memoryManager()} {
@@ -43,9 +52,11 @@ Archetype& EntityManager::getArchetype(const ComponentIdMask& mask, const Shared
 
         auto min = archetype_chunk_size_info_.min_size;
         auto max = archetype_chunk_size_info_.max_size;
+        uint32_t initial_capacity = 0u; // the largest of requested by functions
 
         for (const auto& func: get_chunk_size_functions_) {
             const auto size = func(arch_mask);
+            initial_capacity = std::max(initial_capacity, size.initial_capacity);
             if (min == 0 || size.min > min) {
                 min = size.min;
             }
@@ -54,7 +65,10 @@ Archetype& EntityManager::getArchetype(const ComponentIdMask& mask, const Shared
                 max = size.max;
             }
         }
-        auto chunk_size = archetype_chunk_size_info_.default_size;
+        // version chunk does not cross data chunks unless it is required by chunk size functions
+        const auto data_chunk_capacity = DefaultComponentDataStorage::chunkCapacityFor(arch_mask,
+                                                                                       archetype_chunk_bytes_);
+        auto chunk_size = std::min(archetype_chunk_size_info_.default_size, data_chunk_capacity.toInt());
 
         if (max < min) {
             throw std::runtime_error("Can not create archetype: "
@@ -70,17 +84,148 @@ Archetype& EntityManager::getArchetype(const ComponentIdMask& mask, const Shared
         }
 
         result = new Archetype(world_, archetypes_.back_index().next(),
-                               arch_mask, shared, chunk_size);
+                               arch_mask, shared, chunk_size, data_chunk_capacity,
+                               ChunkCapacity::make(initial_capacity > 0u ? initial_capacity
+                                                                         : archetype_initial_chunk_capacity_));
         archetypes_.emplace_back(result, deleter);
+
+        // archetypes are only appended, so index lists stay sorted
+        arch_mask.forEachItem([this, result](ComponentId id) {
+            if (!component_archetypes_.has(id)) {
+                component_archetypes_.resize(id.next().toInt());
+            }
+            component_archetypes_[id].push_back(result->id());
+        });
+        shared.mask().forEachItem([this, result](SharedComponentId id) {
+            if (!shared_component_archetypes_.has(id)) {
+                shared_component_archetypes_.resize(id.next().toInt());
+            }
+            shared_component_archetypes_[id].push_back(result->id());
+        });
     }
     return *result;
 }
 
+void EntityManager::findArchetypes(const ComponentIdMask& mask, const SharedComponentIdMask& shared,
+                                   std::vector<ArchetypeIndex>& out, ArchetypeIndex first) const {
+    MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__ );
+
+    static const std::vector<ArchetypeIndex> empty_list;
+    const std::vector<ArchetypeIndex>* rarest = nullptr;
+    const auto select = [&rarest](const auto& lists, auto id) {
+        const auto& list = lists.has(id) ? lists[id] : empty_list;
+        if (rarest == nullptr || list.size() < rarest->size()) {
+            rarest = &list;
+        }
+        return !rarest->empty();
+    };
+    mask.forEachItem([&](ComponentId id) {
+        return select(component_archetypes_, id);
+    });
+    if (rarest == nullptr || !rarest->empty()) {
+        shared.forEachItem([&](SharedComponentId id) {
+            return select(shared_component_archetypes_, id);
+        });
+    }
+
+    if (rarest == nullptr) {
+        // every archetype matches empty masks
+        for (auto index = first; index < ArchetypeIndex::make(archetypes_.size()); ++index) {
+            out.push_back(index);
+        }
+        return;
+    }
+    // candidates are taken from the shortest list, other components are checked by masks
+    for (auto it = std::lower_bound(rarest->begin(), rarest->end(), first); it != rarest->end(); ++it) {
+        const auto& archetype = *archetypes_[*it];
+        if (archetype.isMatch(mask) && archetype.isMatch(shared)) {
+            out.push_back(*it);
+        }
+    }
+}
+
+Archetype& EntityManager::getArchetypeWith(Archetype& archetype, ComponentId component) {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+    if (auto cached = Archetype::findEdge(archetype.add_edges_, component); cached != nullptr) {
+        return *cached;
+    }
+    auto mask = archetype.mask_;
+    mask.add(component);
+    auto& result = getArchetype(mask, archetype.sharedComponentInfo());
+    Archetype::setEdge(archetype.add_edges_, component, &result);
+    return result;
+}
+
+Archetype& EntityManager::getArchetypeWithout(Archetype& archetype, ComponentId component) {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+    if (auto cached = Archetype::findEdge(archetype.remove_edges_, component); cached != nullptr) {
+        return *cached;
+    }
+    auto mask = archetype.mask_;
+    mask.set(component, false);
+    auto& result = getArchetype(mask, archetype.sharedComponentInfo());
+    Archetype::setEdge(archetype.remove_edges_, component, &result);
+    return result;
+}
+
+Archetype& EntityManager::getArchetypeWithout(Archetype& archetype, SharedComponentId component) {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+    if (auto cached = Archetype::findEdge(archetype.remove_shared_edges_, component); cached != nullptr) {
+        return *cached;
+    }
+    auto shared_components_info = archetype.sharedComponentInfo();
+    shared_components_info.remove(component);
+    auto& result = getArchetype(archetype.componentMask(), shared_components_info);
+    Archetype::setEdge(archetype.remove_shared_edges_, component, &result);
+    return result;
+}
+
+EntityGroup EntityManager::createBatch(Archetype& archetype, uint32_t count) {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
+
+    if (isLocked()) {
+        std::vector<Entity> entities(count);
+        for (auto& entity : entities) {
+            entity = createLocked(archetype.componentMask(), archetype.sharedComponentInfo());
+        }
+        return EntityGroup{std::move(entities), Entity{}, 0u};
+    }
+
+    const uint32_t num_fragmented = std::min(count, empty_slots_);
+    std::vector<Entity> fragmented(num_fragmented);
+    for (auto& entity : fragmented) {
+        const auto id = next_slot_;
+        const auto version = entities_[id].version();
+        next_slot_ = entities_[id].id();
+        entity.reset(id, version, this_world_id_);
+        entities_[id] = entity;
+    }
+    empty_slots_ -= num_fragmented;
+
+    const uint32_t num_contiguous = count - num_fragmented;
+    Entity first;
+    if (num_contiguous > 0u) {
+        first.reset(EntityId::make(entities_.size()), EntityVersion::make(0), this_world_id_);
+        const auto new_size = entities_.size() + num_contiguous;
+        entities_.reserve(new_size);
+        for (uint32_t i = 0; i < num_contiguous; ++i) {
+            entities_.push_back(Entity::makeFromValue(first.value + i));
+        }
+        locations_.resize(new_size);
+    }
+
+    EntityGroup group{std::move(fragmented), first, num_contiguous};
+    archetype.insert(group);
+    return group;
+}
+
 void EntityManager::clear() {
     MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
 
     entities_.clear();
     locations_.clear();
+    marked_for_delete_.clear();
+    marked_for_delete_mask_.clear();
     next_slot_ = EntityId::make(0);
     empty_slots_ = 0u;
     for(auto& arh : archetypes_) {
@@ -88,6 +233,39 @@ void EntityManager::clear() {
     }
 }
 
+void EntityManager::shrinkToFit() {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
+    for (auto& archetype : archetypes_) {
+        (void) archetype->shrinkToFit();
+    }
+    world_.memoryManager().flushThreadCache();
+}
+
+uint32_t EntityManager::trim(uint32_t max_chunks) {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
+    const auto archetypes_count = static_cast<uint32_t>(archetypes_.size());
+    uint32_t released = 0u;
+    for (uint32_t i = 0; i < archetypes_count && released < max_chunks; ++i) {
+        if (trim_cursor_.toInt() >= archetypes_count) {
+            trim_cursor_ = ArchetypeIndex::make(0u);
+        }
+        released += archetypes_[trim_cursor_]->shrinkToFit(1u, max_chunks - released);
+        if (released < max_chunks) {
+            ++trim_cursor_;
+        }
+    }
+    if (released > 0u) {
+        // released blocks are kept by thread cache otherwise, out of pool limit
+        world_.memoryManager().flushThreadCache();
+    }
+    return released;
+}
+
+void EntityManager::setTrimBudget(uint32_t max_chunks_per_update) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+    trim_budget_ = max_chunks_per_update;
+}
+
 void EntityManager::update() {
     MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
 
@@ -95,10 +273,91 @@ void EntityManager::update() {
         throw std::runtime_error("Can not update locked EntityManager");
     }
     world_version_ = world_.version();
-    for (auto entity : marked_for_delete_) {
-        destroyNow(entity);
+    if (trim_budget_ > 0u) {
+        (void) trim(trim_budget_);
+    }
+    if (marked_for_delete_.empty()) {
+        return;
+    }
+    // entities can be marked for destroy by component callbacks during destruction, they will be destroyed next update
+    auto to_destroy = std::move(marked_for_delete_);
+    marked_for_delete_ = decltype(marked_for_delete_){world_.memoryManager()};
+    destroyBatchNow(to_destroy.data(), to_destroy.size());
+    if (marked_for_delete_.empty()) {
+        to_destroy.clear();
+        marked_for_delete_ = std::move(to_destroy); // keep capacity
     }
-    marked_for_delete_.clear();
+}
+
+void EntityManager::destroyBatchNow(const Entity* entities, size_t count) {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
+
+    if (isLocked()) {
+        auto& storage = getTemporalStorage();
+        for (size_t i = 0; i < count; ++i) {
+            storage.destroyNow(entities[i]);
+        }
+        return;
+    }
+
+    // archetype index in high bits, entity index in low bits: sorting groups entities by archetype
+    std::vector<uint64_t> keys;
+    std::vector<Entity> without_archetype;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const auto entity = entities[i];
+        if (!isEntityValid(entity)) {
+            continue;
+        }
+        const auto& location = locations_[entity.id()];
+        if (location.archetype.isNull()) {
+            without_archetype.push_back(entity);
+        } else {
+            keys.push_back((location.archetype.toInt<uint64_t>() << 32u) | location.index.toInt<uint64_t>());
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::sort(without_archetype.begin(), without_archetype.end());
+    without_archetype.erase(std::unique(without_archetype.begin(), without_archetype.end()),
+                            without_archetype.end());
+
+    std::vector<ArchetypeEntityIndex> indices;
+    std::vector<Entity> released;
+    for (size_t begin = 0; begin < keys.size();) {
+        const auto archetype_index = ArchetypeIndex::make(keys[begin] >> 32u);
+        indices.clear();
+        released.clear();
+        auto& archetype = *archetypes_[archetype_index];
+        size_t end = begin;
+        for (; end < keys.size() && (keys[end] >> 32u) == archetype_index.toInt<uint64_t>(); ++end) {
+            const auto index = ArchetypeEntityIndex::make(keys[end] & 0xFFFFFFFFull);
+            indices.push_back(index);
+            released.push_back(archetype.entities_[index]);
+        }
+        archetype.remove(indices, ComponentIdMask::null());
+        releaseEntityIdsUnsafe(released.data(), released.size());
+        begin = end;
+    }
+    releaseEntityIdsUnsafe(without_archetype.data(), without_archetype.size());
+}
+
+void EntityManager::releaseEntityIdsUnsafe(const Entity* entities, size_t count) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__ );
+
+    if (count < 1u) {
+        return;
+    }
+    const auto last_id = entities[count - 1u].id();
+    const auto tail_next = empty_slots_ ? next_slot_ : last_id.next();
+    for (size_t i = 0; i < count; ++i) {
+        const auto id = entities[i].id();
+        const auto next = (i + 1u < count) ? entities[i + 1u].id() : tail_next;
+        entities_[id].reset(next, entities[i].version().next());
+        setMarkedForDestroy(id, false);
+    }
+    next_slot_ = entities[0].id();
+    empty_slots_ += static_cast<uint32_t>(count);
 }
 
 void EntityManager::clearArchetype(Archetype& archetype) {
@@ -120,6 +379,11 @@ void EntityManager::addDependency(ComponentId component, const ComponentIdMask&
 
     auto& dependency = dependencies_[component];
     dependency = dependency.merge(extra.merge(getExtraComponents(extra)));
+
+    // cached transitions may skip new dependencies
+    for (auto& archetype : archetypes_) {
+        archetype->clearEdges();
+    }
 }
 
 void EntityManager::addChunkSizeFunction(const ArchetypeChunkSizeFunction& function) {
@@ -138,6 +402,16 @@ void EntityManager::setDefaultArchetypeVersionChunkSize(uint32_t value) noexcept
     archetype_chunk_size_info_.default_size = value;
 }
 
+void EntityManager::setDefaultInitialChunkCapacity(uint32_t rows) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+    archetype_initial_chunk_capacity_ = rows;
+}
+
+void EntityManager::setArchetypeChunkBytes(uint32_t value) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+    archetype_chunk_bytes_ = value;
+}
+
 ComponentIdMask EntityManager::getExtraComponents(const ComponentIdMask& mask) const noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
 
@@ -192,10 +466,7 @@ void EntityManager::removeComponent(Entity entity, ComponentId component) {
         return;
     }
 
-    auto mask = prev_archetype.mask_;
-    mask.set(component, false);
-
-    auto& archetype = getArchetype(mask, prev_archetype.sharedComponentInfo());
+    auto& archetype = getArchetypeWithout(prev_archetype, component);
     if (&archetype == &prev_archetype) {
         return;
     }
@@ -204,6 +475,53 @@ void EntityManager::removeComponent(Entity entity, ComponentId component) {
     archetype.externalMove(entity, prev_archetype, prev_index, ComponentIdMask::null());
 }
 
+void EntityManager::addComponentToAll(ComponentId component, const ComponentIdMask& mask,
+                                      const SharedComponentIdMask& shared) {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
+
+    if (isLocked()) {
+        getTemporalStorage().addComponentToAll(component, mask, shared);
+        return;
+    }
+    // new archetypes are created while iterating, they already contain the component
+    std::vector<ArchetypeIndex> sources;
+    findArchetypes(mask, shared, sources);
+    for (const auto& index : sources) {
+        auto& source = *archetypes_[index];
+        if (source.isEmpty() || source.hasComponent(component)) {
+            continue;
+        }
+        auto& target = getArchetypeWith(source, component);
+        if (&target != &source) {
+            target.externalMove(source, ArchetypeEntityIndex::make(0), source.size(), ComponentIdMask::null());
+        }
+    }
+}
+
+void EntityManager::removeComponentFromAll(ComponentId component, const ComponentIdMask& mask,
+                                           const SharedComponentIdMask& shared) {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
+
+    if (isLocked()) {
+        getTemporalStorage().removeComponentFromAll(component, mask, shared);
+        return;
+    }
+    auto required = mask;
+    required.add(component);
+    std::vector<ArchetypeIndex> sources;
+    findArchetypes(required, shared, sources);
+    for (const auto& index : sources) {
+        auto& source = *archetypes_[index];
+        if (source.isEmpty()) {
+            continue;
+        }
+        auto& target = getArchetypeWithout(source, component);
+        if (&target != &source) {
+            target.externalMove(source, ArchetypeEntityIndex::make(0), source.size(), ComponentIdMask::null());
+        }
+    }
+}
+
 bool EntityManager::removeSharedComponent(Entity entity, SharedComponentId component) {
     MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__ );
 
@@ -218,10 +536,7 @@ bool EntityManager::removeSharedComponent(Entity entity, SharedComponentId compo
         return false;
     }
 
-    auto shared_components_info = prev_archetype.sharedComponentInfo();
-    shared_components_info.remove(component);
-
-    auto& archetype = getArchetype(prev_archetype.componentMask(), shared_components_info);
+    auto& archetype = getArchetypeWithout(prev_archetype, component);
     if (&archetype == &prev_archetype) {
         return false;
     }
@@ -255,11 +570,60 @@ void EntityManager::markDirty(Entity entity, ComponentId component_id) noexcept
     }
 }
 
+void EntityManager::setEnabled(Entity entity, ComponentId component_id, bool value) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+
+    if (!isEntityValid(entity)) {
+        return;
+    }
+    const auto location = locations_[entity.id()];
+    if (!location.archetype.isValid()) {
+        return;
+    }
+    const auto& arch = archetypes_[location.archetype];
+    const auto component_index = arch->getComponentIndex(component_id);
+    if (component_index.isValid() && arch->enableStorage().setEnabled(component_index, location.index, value) && value) {
+        arch->markComponentDirty(component_index, location.index, worldVersion());
+    }
+}
+
+bool EntityManager::isEnabled(Entity entity, ComponentId component_id) const noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+
+    if (!isEntityValid(entity)) {
+        return false;
+    }
+    const auto location = locations_[entity.id()];
+    if (!location.archetype.isValid()) {
+        return false;
+    }
+    const auto& arch = archetypes_[location.archetype];
+    const auto component_index = arch->getComponentIndex(component_id);
+    return component_index.isValid() && arch->enableStorage().isEnabled(component_index, location.index);
+}
+
+TemporalStorage::Statistics EntityManager::temporalStorageStatistics() const noexcept {
+    TemporalStorage::Statistics result;
+    for (const auto& storage : temporal_storages_) {
+        const auto statistics = storage.statistics();
+        result.used += statistics.used;
+        result.capacity += statistics.capacity;
+        result.high_water_mark += statistics.high_water_mark;
+        result.chunk_count += statistics.chunk_count;
+        result.chunk_allocations += statistics.chunk_allocations;
+    }
+    return result;
+}
+
 void EntityManager::onLock() {
     MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
 
-    const auto thread_count = world_.dispatcher().maxThreadCount();
-    temporal_storages_.resize(thread_count);
+    // dispatcher can be created with more threads than cores, thread id 0 is for threads outside of dispatcher
+    auto& dispatcher = world_.dispatcher();
+    const auto thread_count = std::max(dispatcher.maxThreadCount(), dispatcher.threadCount() + 1u);
+    while (temporal_storages_.size() < thread_count) {
+        temporal_storages_.emplace_back(world_.memoryManager());
+    }
     next_entity_id_ = static_cast<uint32_t >(entities_.size());
 }
 
@@ -269,162 +633,346 @@ void EntityManager::onUnlock() {
         throw std::runtime_error("Entity manager must be unlocked");
     }
 
+    applyStorages();
+    // bulk actions are applied after per-entity commands, so they affect entities created while locked too
     for (auto& storage : temporal_storages_) {
-        applyStorage(storage);
+        for (const auto& action : storage.bulk_actions_) {
+            if (action.add) {
+                addComponentToAll(action.component_id, action.mask, action.shared);
+            } else {
+                removeComponentFromAll(action.component_id, action.mask, action.shared);
+            }
+        }
         storage.clear();
     }
+    commands_recorded_.store(false, std::memory_order_relaxed);
 }
 
-void EntityManager::applyCommandPack(TemporalStorage& storage, size_t begin, size_t end) {
-    MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__);
-
-    ComponentIdMask final_mask;
-    ComponentIdMask initial_mask;
-    SharedComponentsInfo shared;
-    const auto entity = storage.actions_[begin].entity;
-    const bool create = storage.actions_[begin].action == TemporalStorage::Action::kCreateEntity;
-    if (create) {
-        const auto index = storage.actions_[begin].create_action_index;
-        if (storage.create_actions_.has(index)) {
-            final_mask = storage.create_actions_[index].mask;
-            shared = storage.create_actions_[index].shared;
+bool EntityManager::beginReplayEntry(const TemporalStorage& storage, const TemporalStorage::ActionInfo& command,
+                                     ReplayEntry& entry) {
+    const auto entity = command.entity;
+    entry.entity = entity;
+    if (command.action == TemporalStorage::Action::kCreateEntity) {
+        entry.create = true;
+        if (storage.create_actions_.has(command.create_action_index)) {
+            const auto& create_action = storage.create_actions_[command.create_action_index];
+            entry.target = &getArchetype(create_action.mask, create_action.shared);
+        } else {
+            entry.target = &getArchetype<>();
         }
         if (!entities_.has(entity.id())) {
             entities_.resize(entity.id().next().toInt());
             locations_.resize(entity.id().next().toInt());
-            entities_[entity.id()] = entity;
         }
+        entities_[entity.id()] = entity;
+        return true;
     }
-    else {
-        auto archetype = getArchetypeOf(entity);
-        final_mask = archetype->componentMask();
-        shared = archetype->sharedComponentInfo();
+    if (!isEntityValid(entity)) {
+        return false;
     }
-    initial_mask = final_mask;
+    const auto archetype_index = locations_[entity.id()].archetype;
+    entry.source = archetype_index.isValid() ? archetypes_[archetype_index].get() : nullptr;
+    entry.target = entry.source != nullptr ? entry.source : &getArchetype<>();
+    return true;
+}
 
-    for (size_t i = create ? begin + 1 : begin; i < end; ++i) {
-        const auto& command = storage.actions_[i];
-        switch (command.action) {
-        case TemporalStorage::Action::kDestroyEntityNow:
-            if (create) {
-                releaseEntityIdUnsafe(entity);
-            }
-            else {
-                destroyNow(entity);
-            }
-            return;
-        case TemporalStorage::Action::kCreateEntity:
-            throw std::runtime_error("Create command should be first command for entity: " + std::to_string(entity.id().toInt()));
-            break;
-        case TemporalStorage::Action::kDestroyEntity:
-            destroy(command.entity);
-            break;
-        case TemporalStorage::Action::kRemoveComponent:
-            final_mask.set(command.component_id, false);
-            break;
-        case TemporalStorage::Action::kAssignComponent:
-            final_mask.set(command.component_id, true);
-            break;
-        default:
-            break;
-        }
-    }
-
-    Archetype& archetype = getArchetype(final_mask, shared);
-    if (create) {
-        archetype.insert(entity, initial_mask.inverse());
-    }
-    else if (initial_mask != final_mask) {
-        const auto location = locations_[entity.id()];
-        archetype.externalMove(entity, getArchetype(location.archetype), location.index, final_mask);
+void EntityManager::replayCommand(ReplayEntry& entry, const TemporalStorage::ActionInfo& command) {
+    if (entry.destroy_now || command.entity != entry.entity) {
+        return;
     }
 
-    auto view = archetype.getElementView(locations_[entity.id()].index);
-    for (size_t i = begin; i < end; ++i) {
-        const auto& command = storage.actions_[i];
-        if (command.action != TemporalStorage::Action::kAssignComponent) {
-            continue;
+    // payloads are kept in command order, one per component
+    uint32_t prev = ReplayEntry::kNoPayload;
+    uint32_t payload = entry.first_payload;
+    const auto findPayload = [&] {
+        while (payload != ReplayEntry::kNoPayload &&
+               replay_payloads_[payload].command->component_id != command.component_id) {
+            prev = payload;
+            payload = replay_payloads_[payload].next;
+        }
+    };
+
+    switch (command.action) {
+    case TemporalStorage::Action::kDestroyEntityNow:
+        entry.destroy_now = true;
+        break;
+    case TemporalStorage::Action::kCreateEntity:
+        throw std::runtime_error("Create command should be first command for entity: " +
+                                 std::to_string(entry.entity.id().toInt()));
+    case TemporalStorage::Action::kDestroyEntity:
+        entry.destroy = true;
+        break;
+    case TemporalStorage::Action::kRemoveComponent:
+        entry.target = &getArchetypeWithout(*entry.target, command.component_id);
+        entry.assigned.set(command.component_id, false);
+        findPayload();
+        if (payload != ReplayEntry::kNoPayload) {
+            const auto next = replay_payloads_[payload].next;
+            (prev == ReplayEntry::kNoPayload ? entry.first_payload : replay_payloads_[prev].next) = next;
+        }
+        break;
+    case TemporalStorage::Action::kAssignComponent:
+        entry.target = &getArchetypeWith(*entry.target, command.component_id);
+        entry.assigned.add(command.component_id);
+        findPayload();
+        if (payload != ReplayEntry::kNoPayload) {
+            replay_payloads_[payload].command = &command;
+        } else {
+            const auto index = static_cast<uint32_t>(replay_payloads_.size());
+            replay_payloads_.push_back(ReplayPayload{&command, ReplayEntry::kNoPayload});
+            (prev == ReplayEntry::kNoPayload ? entry.first_payload : replay_payloads_[prev].next) = index;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void EntityManager::applyPayloads(const ReplayEntry& entry, Archetype& archetype, ArchetypeEntityIndex index,
+                                  std::vector<ReplayStamp>* stamps) {
+    for (auto payload = entry.first_payload; payload != ReplayEntry::kNoPayload;
+         payload = replay_payloads_[payload].next) {
+        const auto& command = *replay_payloads_[payload].command;
+        const auto& functions = command.type_info->functions;
+        const auto component_index = archetype.getComponentIndex<FunctionSafety::kUnsafe>(command.component_id);
+        auto dest = archetype.getComponent<FunctionSafety::kUnsafe>(component_index, index);
+        // component which was in source archetype is alive, others were skipped by constructor
+        const bool is_alive = entry.source != nullptr && entry.source->hasComponent(command.component_id);
+        if (is_alive) {
+            functions.move(dest, command.ptr);
+            if (stamps != nullptr) {
+                // version slots are shared by rows of a chunk and by the whole archetype
+                stamps->push_back(ReplayStamp{&archetype, component_index, index});
+            } else {
+                archetype.markComponentDirty(component_index, index, worldVersion());
+            }
+        } else if (command.type_info->is_tag) {
+            // tag has no data, pointer of the row is shared with other columns
+        } else if (command.type_info->is_trivially_relocatable) {
+            memcpy(dest, command.ptr, command.type_info->size);
+        } else {
+            functions.move_constructor(dest, command.ptr);
         }
-        auto dest = view.getData(archetype.getComponentIndex(command.component_id));
-        const auto& component_functions = ComponentFactory::componentInfo(command.component_id).functions;
-        component_functions.move_constructor(dest, command.ptr);
-        if (component_functions.after_assign) {
-            component_functions.after_assign(dest, command.entity, world_);
+        if (functions.after_assign) {
+            functions.after_assign(dest, entry.entity, world_);
         }
     }
 }
 
-void EntityManager::applyCommandPackUnoptimized(TemporalStorage& storage, size_t begin, size_t end) {
-    MUSTACHE_PROFILER_BLOCK_LVL_2(__FUNCTION__);
+void EntityManager::applyStorages() {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__);
 
-    for (size_t i = begin; i < end; ++i) {
-        const auto& command = storage.actions_[i];
-        switch (command.action) {
-        case TemporalStorage::Action::kDestroyEntityNow:
-            destroyNow(command.entity);
-            break;
-        case TemporalStorage::Action::kCreateEntity:
-        {
-            const auto index = command.entity.id().toInt();
-            if (locations_.size() <= index) {
-                locations_.resize(index + 1);
-            }
-            if (entities_.size() <= index) {
-                entities_.resize(index + 1);
-            }
-            entities_[command.entity.id()] = command.entity;
-            if (storage.create_actions_.has(command.create_action_index)) {
-                const auto& [mask, shared] = storage.create_actions_[command.create_action_index];
-                getArchetype(mask, shared).insert(command.entity);
+    replay_entries_.clear();
+    replay_payloads_.clear();
+
+    // pass over commands of all threads: every entity gets one entry with its final archetype
+    for (const auto& storage : temporal_storages_) {
+        for (const auto& command : storage.actions_) {
+            const auto id = command.entity.id();
+            if (!replay_slots_.has(id)) {
+                replay_slots_.resize(id.next().toInt(), 0u);
             }
-            else {
-                getArchetype<>().insert(command.entity);
+            auto slot = replay_slots_[id];
+            if (slot == 0u) {
+                ReplayEntry entry;
+                if (!beginReplayEntry(storage, command, entry)) {
+                    continue;
+                }
+                replay_entries_.push_back(entry);
+                slot = static_cast<uint32_t>(replay_entries_.size());
+                replay_slots_[id] = slot;
+                if (entry.create) {
+                    continue;
+                }
             }
+            replayCommand(replay_entries_[slot - 1u], command);
         }
-        break;
-        case TemporalStorage::Action::kDestroyEntity:
-            destroy(command.entity);
-            break;
-        case TemporalStorage::Action::kRemoveComponent:
-            removeComponent(command.entity, command.component_id);
-            break;
-        case TemporalStorage::Action::kAssignComponent:
-            command.type_info->functions.move(assign(command.entity, command.component_id), command.ptr);
-            break;
-        default:
-            break;
+    }
+
+    if (!replay_entries_.empty()) {
+        applyReplayEntries();
+        for (const auto& entry : replay_entries_) {
+            replay_slots_[entry.entity.id()] = 0u;
+        }
+    }
+
+    // every payload was moved-from or dropped
+    for (const auto& storage : temporal_storages_) {
+        for (const auto& command : storage.actions_) {
+            if (command.action == TemporalStorage::Action::kAssignComponent && command.type_info->functions.destroy) {
+                command.type_info->functions.destroy(command.ptr);
+            }
         }
     }
 }
 
-void EntityManager::applyStorage(TemporalStorage& storage) { // optimized version
-    // TODO: this version iterates over commands 3 times, it is possible to merge 1-st and 2-nd iterations.
-    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__);
+void EntityManager::applyReplayEntries() {
+    MUSTACHE_PROFILER_BLOCK_LVL_1(__FUNCTION__);
+    constexpr uint32_t kReplayRowsPerTask = 1024u;
+
+    constexpr auto kNoSource = std::numeric_limits<uint32_t>::max();
+    std::vector<Entity> destroy_now;
+    std::vector<std::pair<uint64_t, uint32_t> > order; // (target, source) key and entry index
+    order.reserve(replay_entries_.size());
+    for (uint32_t i = 0; i < replay_entries_.size(); ++i) {
+        const auto& entry = replay_entries_[i];
+        if (entry.destroy_now) {
+            if (entry.create) {
+                releaseEntityIdUnsafe(entry.entity);
+            } else {
+                destroy_now.push_back(entry.entity);
+            }
+            continue;
+        }
+        if (entry.source == entry.target && entry.first_payload == ReplayEntry::kNoPayload) {
+            continue;
+        }
+        const uint64_t source = entry.source != nullptr ? entry.source->id().toInt() : kNoSource;
+        order.emplace_back((static_cast<uint64_t>(entry.target->id().toInt()) << 32u) | source, i);
+    }
+    destroyBatchNow(destroy_now.data(), destroy_now.size());
+    std::sort(order.begin(), order.end());
+
+    struct Bucket {
+        Archetype* source;
+        Archetype* target;
+        uint32_t begin;
+        uint32_t end;
+        ArchetypeEntityIndex first;
+    };
+    std::vector<Bucket> buckets;
+    std::vector<ArchetypeEntityIndex> source_indices(order.size());
+    std::vector<ComponentIdMask> skip_constructor(order.size());
+
+    // rows of every target are reserved once per bucket, source rows are captured before any removal
+    for (uint32_t begin = 0; begin < order.size();) {
+        uint32_t end = begin + 1u;
+        while (end < order.size() && order[end].first == order[begin].first) {
+            ++end;
+        }
+        const auto& head = replay_entries_[order[begin].second];
+        Bucket bucket{head.source, head.target, begin, end, ArchetypeEntityIndex::null()};
+        if (bucket.source != bucket.target) {
+            bucket.first = bucket.target->appendRows(end - begin);
+            for (uint32_t i = begin; i < end; ++i) {
+                const auto& entry = replay_entries_[order[i].second];
+                const auto row = ArchetypeEntityIndex::make(bucket.first.toInt() + i - begin);
+                bucket.target->entities_[row] = entry.entity;
+                skip_constructor[i] = entry.assigned;
+                if (bucket.source != nullptr) {
+                    source_indices[i] = locations_[entry.entity.id()].index;
+                }
+            }
+        }
+        buckets.push_back(bucket);
+        begin = end;
+    }
 
-    if (storage.actions_.empty()) {
-        return;
+    // rows of different tasks never overlap, source archetypes are not changed until every task is done
+    const auto fill = [&](const Bucket& bucket, uint32_t begin, uint32_t end, std::vector<ReplayStamp>* stamps) {
+        if (bucket.source == bucket.target) {
+            for (uint32_t i = begin; i < end; ++i) {
+                const auto& entry = replay_entries_[order[i].second];
+                applyPayloads(entry, *bucket.target, locations_[entry.entity.id()].index, stamps);
+            }
+            return;
+        }
+        const auto first = ArchetypeEntityIndex::make(bucket.first.toInt() + begin - bucket.begin);
+        if (bucket.source == nullptr) {
+            bucket.target->initRows(first, end - begin, skip_constructor.data() + begin);
+        } else {
+            bucket.target->moveRows(*bucket.source, source_indices.data() + begin, first, end - begin,
+                                    skip_constructor.data() + begin);
+        }
+        for (uint32_t i = begin; i < end; ++i) {
+            const auto row = ArchetypeEntityIndex::make(first.toInt() + i - begin);
+            applyPayloads(replay_entries_[order[i].second], *bucket.target, row, stamps);
+        }
+    };
+
+    auto& dispatcher = world_.dispatcher();
+    const bool parallel = parallel_command_apply_ && dispatcher.threadCount() > 0u &&
+            dispatcher.currentThreadId().toInt() == 0u && order.size() > kReplayRowsPerTask;
+    if (!parallel) {
+        for (const auto& bucket : buckets) {
+            fill(bucket, bucket.begin, bucket.end, nullptr);
+        }
+    } else {
+        struct Task {
+            uint32_t bucket;
+            uint32_t begin;
+            uint32_t end;
+        };
+        std::vector<Task> tasks;
+        std::vector<uint32_t> serial_buckets;
+        for (uint32_t i = 0; i < buckets.size(); ++i) {
+            const auto& bucket = buckets[i];
+            if (bucket.target->usesWorld()) {
+                // callbacks may change entities, it is only allowed on the unlocking thread
+                serial_buckets.push_back(i);
+                continue;
+            }
+            if (bucket.source != nullptr && bucket.source != bucket.target) {
+                // plan is created lazily, so it must exist before tasks are started
+                static_cast<void>(bucket.target->transitionPlan(*bucket.source));
+            }
+            for (uint32_t begin = bucket.begin; begin < bucket.end; begin += kReplayRowsPerTask) {
+                tasks.push_back(Task{i, begin, std::min(bucket.end, begin + kReplayRowsPerTask)});
+            }
+        }
+        std::vector<std::vector<ReplayStamp> > stamps(tasks.size());
+        dispatcher.parallelFor([&](size_t index, ParallelTaskId) {
+            const auto& task = tasks[index];
+            fill(buckets[task.bucket], task.begin, task.end, &stamps[index]);
+        }, 0u, tasks.size());
+        const auto world_version = worldVersion();
+        for (const auto& task_stamps : stamps) {
+            for (const auto& stamp : task_stamps) {
+                stamp.archetype->markComponentDirty(stamp.component, stamp.index, world_version);
+            }
+        }
+        for (auto index : serial_buckets) {
+            fill(buckets[index], buckets[index].begin, buckets[index].end, nullptr);
+        }
     }
 
-    size_t begin = 0;
-    size_t end = begin + 1;
-    Entity prev_entity = storage.actions_[begin].entity;
-    for (; end < storage.actions_.size(); ++end) {
-        const auto& action = storage.actions_[end];
-        if (action.entity == prev_entity) {
+    // moved-out rows are released with one batched remove per source archetype,
+    // entities point to their new rows first, so remove() keeps their locations
+    std::vector<std::pair<uint64_t, ArchetypeEntityIndex> > removed;
+    for (const auto& bucket : buckets) {
+        if (bucket.source == bucket.target) {
             continue;
         }
-        applyCommandPack(storage, begin, end);
+        const auto to_be_removed = bucket.source != nullptr ?
+                bucket.source->componentMask().intersection(bucket.target->componentMask().inverse()) :
+                ComponentIdMask{};
+        for (uint32_t i = bucket.begin; i < bucket.end; ++i) {
+            const auto& entity = replay_entries_[order[i].second].entity;
+            updateLocation(entity, bucket.target->id(), ArchetypeEntityIndex::make(bucket.first.toInt() + i - bucket.begin));
+            if (bucket.source != nullptr) {
+                const auto index = source_indices[i];
+                bucket.source->callOnRemove(index, to_be_removed);
+                removed.emplace_back(bucket.source->id().toInt(), index);
+            }
+        }
+    }
+    std::sort(removed.begin(), removed.end());
+    std::vector<ArchetypeEntityIndex> indices;
+    for (size_t begin = 0; begin < removed.size();) {
+        size_t end = begin;
+        indices.clear();
+        while (end < removed.size() && removed[end].first == removed[begin].first) {
+            indices.push_back(removed[end].second);
+            ++end;
+        }
+        auto& source = *archetypes_[ArchetypeIndex::make(static_cast<uint32_t>(removed[begin].first))];
+        source.remove(indices, source.componentMask());
         begin = end;
-        prev_entity = storage.actions_[end].entity;
     }
-    applyCommandPack(storage, begin, end);
 
-    for (auto& command : storage.actions_) {
-        if (command.action == TemporalStorage::Action::kAssignComponent) {
-            const auto& info = ComponentFactory::componentInfo(command.component_id);
-            if (info.functions.destroy) {
-                info.functions.destroy(command.ptr);
-            }
+    for (const auto& entry : replay_entries_) {
+        if (entry.destroy && !entry.destroy_now) {
+            destroy(entry.entity);
         }
     }
 }
@@ -11,9 +11,12 @@
 #include <mustache/ecs/entity_builder.hpp>
 #include <mustache/ecs/temporal_storage.hpp>
 #include <mustache/ecs/component_factory.hpp>
+#include <mustache/ecs/default_component_data_storage.hpp>
 
 #include <map>
-#include <set>
+#include <atomic>
+#include <mutex>
+#include <limits>
 #include <memory>
 
 namespace mustache {
@@ -27,6 +30,7 @@ namespace mustache {
     struct ArchetypeChunkSize {
         uint32_t min = 0u;
         uint32_t max = 0u;
+        uint32_t initial_capacity = 0u; // rows in first data chunk, it doubles up to full chunk. 0 - not specified
     };
 
     using ArchetypeChunkSizeFunction = std::function<ArchetypeChunkSize (const ComponentIdMask&)>;
@@ -59,8 +63,33 @@ namespace mustache {
         template<typename... Components>
         [[nodiscard]] MUSTACHE_INLINE Entity create();
 
+        /**
+         * Creates count entities in archetype.
+         * Free ids are reused first, the rest of ids are reserved as one contiguous range.
+         * Archetype storage grows once, components are initialized per column.
+         * iteration safe (falls back to per-entity creation if EntityManager is locked)
+         */
+        [[nodiscard]] EntityGroup createBatch(Archetype& archetype, uint32_t count);
+
+        template<typename... Components>
+        [[nodiscard]] MUSTACHE_INLINE EntityGroup createBatch(uint32_t count) {
+            return createBatch(getArchetype<Components...>(), count);
+        }
+
         void clear();
 
+        /// releases all unused data chunks of all archetypes
+        void shrinkToFit();
+
+        /**
+         * Releases at most max_chunks unused data chunks, continues from the archetype where previous call stopped.
+         * One spare chunk per archetype is kept, so archetype with oscillating size does not reallocate every frame.
+         */
+        uint32_t trim(uint32_t max_chunks);
+
+        /// max number of chunks released by every update(), 0 disables trimming
+        void setTrimBudget(uint32_t max_chunks_per_update) noexcept;
+
         void clearArchetype(Archetype& archetype);
 
         /// iteration safe
@@ -73,8 +102,25 @@ namespace mustache {
         template<FunctionSafety _Safety = FunctionSafety::kSafe>
         MUSTACHE_INLINE void destroyNow(Entity entity);
 
+        /**
+         * Destroys entities immediately.
+         * Entities are grouped by archetype, holes are filled from the archetype tail
+         * and ids are returned to the free list at once. Invalid and duplicated entities are skipped.
+         * iteration safe
+         */
+        void destroyBatchNow(const Entity* entities, size_t count);
+
         Archetype& getArchetype(const ComponentIdMask&, const SharedComponentsInfo& shared_component_mask);
 
+        /// archetype with the same components as archetype plus component, the result is cached in archetype
+        Archetype& getArchetypeWith(Archetype& archetype, ComponentId component);
+
+        /// archetype with the same components as archetype without component, the result is cached in archetype
+        Archetype& getArchetypeWithout(Archetype& archetype, ComponentId component);
+
+        /// archetype with the same components as archetype without shared component, the result is cached in archetype
+        Archetype& getArchetypeWithout(Archetype& archetype, SharedComponentId component);
+
         /// iteration safe
         Archetype* getArchetypeOf(Entity entity) const noexcept;
 
@@ -84,6 +130,22 @@ namespace mustache {
         /// iteration safe
         [[nodiscard]] size_t MUSTACHE_INLINE getArchetypesCount() const noexcept;
 
+        /**
+         * Appends indices of archetypes having all components of mask and shared, starting at first, in ascending order.
+         * Candidates are taken from the shortest per-component list of archetypes, the rest is checked by masks.
+         */
+        void findArchetypes(const ComponentIdMask& mask, const SharedComponentIdMask& shared,
+                            std::vector<ArchetypeIndex>& out, ArchetypeIndex first = ArchetypeIndex::make(0u)) const;
+
+        /**
+         * Unique for every EntityManager.
+         * Archetypes are never removed, so instanceId() and getArchetypesCount() work as generation of archetype list,
+         * jobs use it to check only new archetypes.
+         */
+        [[nodiscard]] uint64_t instanceId() const noexcept {
+            return instance_id_;
+        }
+
         /// iteration safe
         template<FunctionSafety _Safety = FunctionSafety::kDefault>
         [[nodiscard]] MUSTACHE_INLINE  Archetype& getArchetype(ArchetypeIndex index) noexcept (!isSafe(_Safety));
@@ -119,6 +181,32 @@ namespace mustache {
         template<typename T, typename... _ARGS>
         MUSTACHE_INLINE decltype(auto) assign(Entity e, _ARGS&&... args);
 
+        /**
+         * Adds component to every entity with all components from mask and shared components from shared.
+         * Whole archetypes are moved at once, column by column.
+         * iteration safe (applied on unlock if EntityManager is locked)
+         */
+        void addComponentToAll(ComponentId component, const ComponentIdMask& mask = ComponentIdMask::null(),
+                               const SharedComponentIdMask& shared = SharedComponentIdMask::null());
+
+        /// iteration safe (applied on unlock if EntityManager is locked)
+        void removeComponentFromAll(ComponentId component, const ComponentIdMask& mask = ComponentIdMask::null(),
+                                    const SharedComponentIdMask& shared = SharedComponentIdMask::null());
+
+        /// Adds T to every entity which has all of _Filter components
+        template<typename T, typename... _Filter>
+        MUSTACHE_INLINE void addComponentToAll() {
+            addComponentToAll(ComponentFactory::registerComponent<T>(), ComponentFactory::makeMask<_Filter...>(),
+                              ComponentFactory::makeSharedMask<_Filter...>());
+        }
+
+        /// Removes T from every entity which has all of _Filter components
+        template<typename T, typename... _Filter>
+        MUSTACHE_INLINE void removeComponentFromAll() {
+            removeComponentFromAll(ComponentFactory::registerComponent<T>(), ComponentFactory::makeMask<_Filter...>(),
+                                   ComponentFactory::makeSharedMask<_Filter...>());
+        }
+
         /// iteration safe
         MUSTACHE_INLINE void* assign(Entity e, ComponentId id) {
             return assign<false>(e, id);
@@ -189,8 +277,29 @@ namespace mustache {
             });
         }
 
+        template <typename... ARGS>
+        void addInitialChunkCapacity(uint32_t rows) {
+            const auto check_mask = ComponentFactory::makeMask<ARGS...>();
+            addChunkSizeFunction([rows, check_mask](const ComponentIdMask& arch_mask) noexcept {
+                ArchetypeChunkSize result;
+                if (arch_mask.isMatch(check_mask)) {
+                    result.initial_capacity = rows;
+                }
+                return result;
+            });
+        }
+
         void setDefaultArchetypeVersionChunkSize(uint32_t value) noexcept;
 
+        /**
+         * Rows in the first data chunk of archetypes created after the call, 0 means full chunk.
+         * Small first chunk grows twice on overflow, pointers to components are invalidated by the growth.
+         */
+        void setDefaultInitialChunkCapacity(uint32_t rows) noexcept;
+
+        /// target size of data chunk in bytes, used for archetypes created after the call
+        void setArchetypeChunkBytes(uint32_t value) noexcept;
+
         template<typename T, typename... _ARGS>
         MUSTACHE_INLINE const T& assignShared(Entity e, _ARGS&&... args);
 
@@ -209,25 +318,91 @@ namespace mustache {
         /// iteration safe
         void markDirty(Entity entity, ComponentId component_id) noexcept;
 
+        /**
+         * Disabled component keeps its value and archetype, jobs requiring it skip the entity.
+         * O(1) without structural changes, iteration and thread safe, enabling marks component dirty.
+         * Entities created while EntityManager is locked can be toggled after unlock.
+         */
+        template<typename T>
+        void setEnabled(Entity entity, bool value) noexcept {
+            setEnabled(entity, ComponentFactory::registerComponent<T>(), value);
+        }
+        void setEnabled(Entity entity, ComponentId component_id, bool value) noexcept;
+
+        /// false if entity has no such component or it is disabled
+        template<typename T>
+        [[nodiscard]] bool isEnabled(Entity entity) const noexcept {
+            return isEnabled(entity, ComponentFactory::registerComponent<T>());
+        }
+        [[nodiscard]] bool isEnabled(Entity entity, ComponentId component_id) const noexcept;
+
+        /// payload arena usage summed over temporal storages of all threads
+        [[nodiscard]] TemporalStorage::Statistics temporalStorageStatistics() const noexcept;
+
+        /**
+         * True if commands were recorded while locked and are not applied yet.
+         * May be called while other threads record, commands of finished ones are seen.
+         */
+        [[nodiscard]] bool hasRecordedCommands() const noexcept {
+            return commands_recorded_.load(std::memory_order_acquire);
+        }
+
+        /**
+         * Commands recorded while locked are applied by Dispatcher threads on unlock, one task per range of rows.
+         * Id and location bookkeeping stays on the unlocking thread.
+         * Rows of archetypes with a component getting World in constructor or afterAssign are filled
+         * by the unlocking thread after the parallel part, so these callbacks may change entities.
+         * Other constructors and move functions of affected components must be thread safe.
+         */
+        void setParallelCommandApply(bool on) noexcept {
+            parallel_command_apply_ = on;
+        }
+
+        [[nodiscard]] bool isParallelCommandApply() const noexcept {
+            return parallel_command_apply_;
+        }
+
         [[nodiscard]] MUSTACHE_INLINE bool isLocked() const noexcept {
-            return lock_counter_ > 0u;
+            return lock_counter_.load(std::memory_order_acquire) > 0u;
         }
 
+        /**
+         * Jobs may be run from parallel tasks, only the outermost lock / unlock calls onLock / onUnlock.
+         * Nested lock / unlock only change the counter, transitions from / to zero are serialized.
+         */
         MUSTACHE_INLINE void lock() noexcept {
-            ++lock_counter_;
-            if (lock_counter_ == 1u) {
+            auto value = lock_counter_.load(std::memory_order_acquire);
+            while (value > 0u && !lock_counter_.compare_exchange_weak(value, value + 1u, std::memory_order_acq_rel,
+                                                                       std::memory_order_acquire)) {
+            }
+            if (value > 0u) {
+                return;
+            }
+            std::lock_guard<std::recursive_mutex> guard{lock_mutex_};
+            if (lock_counter_.load(std::memory_order_acquire) == 0u) {
                 onLock();
             }
+            lock_counter_.fetch_add(1u, std::memory_order_acq_rel);
         }
 
         MUSTACHE_INLINE bool unlock() noexcept {
-            if (lock_counter_ > 0u) {
-                --lock_counter_;
+            auto value = lock_counter_.load(std::memory_order_acquire);
+            while (value > 1u && !lock_counter_.compare_exchange_weak(value, value - 1u, std::memory_order_acq_rel,
+                                                                       std::memory_order_acquire)) {
+            }
+            if (value > 1u) {
+                return false;
+            }
+            std::lock_guard<std::recursive_mutex> guard{lock_mutex_};
+            value = lock_counter_.load(std::memory_order_acquire);
+            while (value > 0u && !lock_counter_.compare_exchange_weak(value, value - 1u, std::memory_order_acq_rel,
+                                                                       std::memory_order_acquire)) {
             }
-            if (lock_counter_ == 0u) {
-                onUnlock();
+            if (value > 1u) {
+                return false;
             }
-            return lock_counter_ < 1u;
+            onUnlock();
+            return true;
         }
     private:
         /// iteration safe
@@ -242,14 +417,71 @@ namespace mustache {
             entities_[id].reset(empty_slots_ ? next_slot_ : id.next(), entity.version().next());
             next_slot_ = id;
             ++empty_slots_;
+            setMarkedForDestroy(id, false);
+        }
+
+        /// links all ids into one list and prepends it to the free list, entities must be valid and unique
+        void releaseEntityIdsUnsafe(const Entity* entities, size_t count) noexcept;
+
+        [[nodiscard]] MUSTACHE_INLINE bool isMarkedForDestroy(EntityId id) const noexcept {
+            const auto word = id.toInt() / 64u;
+            return word < marked_for_delete_mask_.size() &&
+                (marked_for_delete_mask_[word] & (1ull << (id.toInt() % 64u))) != 0u;
+        }
+
+        MUSTACHE_INLINE void setMarkedForDestroy(EntityId id, bool value) noexcept {
+            const auto word = id.toInt() / 64u;
+            const auto bit = 1ull << (id.toInt() % 64u);
+            if (value) {
+                if (word >= marked_for_delete_mask_.size()) {
+                    marked_for_delete_mask_.resize(word + 1u, 0u);
+                }
+                marked_for_delete_mask_[word] |= bit;
+            } else if (word < marked_for_delete_mask_.size()) {
+                marked_for_delete_mask_[word] &= ~bit;
+            }
         }
 
         void onLock();
         void onUnlock();
 
-        void applyStorage(TemporalStorage& storage);
-        void applyCommandPack(TemporalStorage& storage, size_t begin, size_t end);
-        void applyCommandPackUnoptimized(TemporalStorage& storage, size_t begin, size_t end);
+        // commands of one entity recorded while locked, folded into the final archetype
+        struct ReplayEntry {
+            static constexpr uint32_t kNoPayload = std::numeric_limits<uint32_t>::max();
+            Entity entity;
+            Archetype* source = nullptr; // null for entities created while locked
+            Archetype* target = nullptr;
+            ComponentIdMask assigned; // components initialized from payloads
+            uint32_t first_payload = kNoPayload;
+            bool create = false;
+            bool destroy = false;
+            bool destroy_now = false;
+        };
+
+        struct ReplayPayload {
+            const TemporalStorage::ActionInfo* command;
+            uint32_t next;
+        };
+
+        // version of a component assigned over the alive one, stamped by the unlocking thread after parallel apply
+        struct ReplayStamp {
+            Archetype* archetype;
+            ComponentIndex component;
+            ArchetypeEntityIndex index;
+        };
+
+        /**
+         * Applies commands of all temporal storages.
+         * Target archetype of every entity is resolved in one pass, entities are bucketed by (target, source),
+         * every bucket reserves rows once and moves components column by column.
+         */
+        void applyStorages();
+        void applyReplayEntries();
+        bool beginReplayEntry(const TemporalStorage& storage, const TemporalStorage::ActionInfo& command,
+                              ReplayEntry& entry);
+        void replayCommand(ReplayEntry& entry, const TemporalStorage::ActionInfo& command);
+        void applyPayloads(const ReplayEntry& entry, Archetype& archetype, ArchetypeEntityIndex index,
+                           std::vector<ReplayStamp>* stamps = nullptr);
 
         Entity createLocked(const ComponentIdMask& components, const SharedComponentsInfo& shared) noexcept {
             // you need to store this entity in entities_ in onUnlock()
@@ -270,6 +502,9 @@ namespace mustache {
 
         [[nodiscard]] TemporalStorage& getTemporalStorage() noexcept {
             static thread_local const auto thread_id = threadId();
+            if (!commands_recorded_.load(std::memory_order_relaxed)) {
+                commands_recorded_.store(true, std::memory_order_relaxed);
+            }
             return temporal_storages_[thread_id];
         }
 
@@ -336,6 +571,17 @@ namespace mustache {
             }
         }
 
+        /// resets location only if entity is still at index of archetype, it may be moved already
+        void resetLocation(Entity e, ArchetypeIndex archetype, ArchetypeEntityIndex index) noexcept {
+            if (e.id().isValid()) {
+                auto& location = locations_[e.id()];
+                if (location.archetype == archetype && location.index == index) {
+                    location.archetype = ArchetypeIndex::null();
+                    location.index = ArchetypeEntityIndex::null();
+                }
+            }
+        }
+
         struct EntityLocationInWorld {
             constexpr static ArchetypeIndex kDefaultArchetype = ArchetypeIndex::null();
             EntityLocationInWorld() = default;
@@ -349,9 +595,11 @@ namespace mustache {
         };
 
         World& world_;
-        uint32_t lock_counter_{0u};
+        std::atomic<uint32_t> lock_counter_{0u};
+        std::recursive_mutex lock_mutex_;
         std::atomic<uint32_t > next_entity_id_; // for create entity with locked EntityManager
         ArrayWrapper<TemporalStorage, ThreadId, false> temporal_storages_;
+        std::atomic<bool> commands_recorded_{false}; // storages are not read while other threads record
         ArrayWrapper<SharedComponentsData, SharedComponentId, false> shared_components_;
         using ArchetypeMap = std::map<SharedComponentsData, Archetype*>;
         std::map<ArchetypeComponents, ArchetypeMap> mask_to_arch_;
@@ -361,7 +609,16 @@ namespace mustache {
         uint32_t empty_slots_{0};
         ArrayWrapper<Entity, EntityId, true> entities_;
         ArrayWrapper<EntityLocationInWorld, EntityId, true> locations_;
-        std::set<Entity, std::less<Entity>, Allocator<Entity> > marked_for_delete_;
+        std::vector<Entity, Allocator<Entity> > marked_for_delete_;
+        std::vector<uint64_t, Allocator<uint64_t> > marked_for_delete_mask_; // bit per EntityId
+        ArrayWrapper<uint32_t, EntityId, true> replay_slots_; // index of ReplayEntry + 1, zero if entity has no entry
+        std::vector<ReplayEntry> replay_entries_;
+        std::vector<ReplayPayload> replay_payloads_;
+        bool parallel_command_apply_{false};
+        const uint64_t instance_id_;
+        // indices of archetypes containing component, sorted
+        ArrayWrapper<std::vector<ArchetypeIndex>, ComponentId, false> component_archetypes_;
+        ArrayWrapper<std::vector<ArchetypeIndex>, SharedComponentId, false> shared_component_archetypes_;
         WorldId this_world_id_;
         WorldVersion world_version_;
         // TODO: replace shared pointed with some kind of unique_ptr but with deleter calling clearArchetype
@@ -375,6 +632,10 @@ namespace mustache {
             uint32_t max_size = 0u;
         };
         ArchetypeVersionChunkSize archetype_chunk_size_info_;
+        uint32_t archetype_chunk_bytes_ = DefaultComponentDataStorage::kDefaultChunkBytes;
+        uint32_t archetype_initial_chunk_capacity_ = 0u;
+        uint32_t trim_budget_ = 0u;
+        ArchetypeIndex trim_cursor_ = ArchetypeIndex::make(0u);
         std::vector<ArchetypeChunkSizeFunction> get_chunk_size_functions_;
     };
 
@@ -453,13 +714,14 @@ namespace mustache {
     void EntityManager::destroy(Entity entity) {
         if (isLocked()) {
             getTemporalStorage().destroy(entity);
-        } else {
-            marked_for_delete_.insert(entity);
+        } else if (isEntityValid(entity) && !isMarkedForDestroy(entity.id())) {
+            setMarkedForDestroy(entity.id(), true);
+            marked_for_delete_.push_back(entity);
         }
     }
 
     bool EntityManager::isMarkedForDestroy(Entity entity) const noexcept {
-        return marked_for_delete_.count(entity) > 0u;
+        return isEntityValid(entity) && isMarkedForDestroy(entity.id());
     }
 
     template<FunctionSafety _Safety>
@@ -590,11 +852,13 @@ namespace mustache {
         if (!isLocked()) {
             const auto& location = locations_[e.id()];
             auto& prev_arch = *archetypes_[location.archetype];
-            ComponentIdMask mask = prev_arch.mask_;
-            mask.add(component_id);
-            auto& arch = getArchetype(mask, prev_arch.sharedComponentInfo());
+            auto& arch = getArchetypeWith(prev_arch, component_id);
             const auto prev_index = location.index;
-            arch.externalMove(e, prev_arch, prev_index, _SkipConstructor ? mask : ComponentIdMask::null());
+            ComponentIdMask skip_constructor;
+            if constexpr (_SkipConstructor) {
+                skip_constructor.add(component_id);
+            }
+            arch.externalMove(e, prev_arch, prev_index, skip_constructor);
             const auto component_index = arch.getComponentIndex<FunctionSafety::kUnsafe>(component_id);
             return arch.getComponent<FunctionSafety::kUnsafe>(component_index, location.index);
         } else {
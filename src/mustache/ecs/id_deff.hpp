@@ -39,6 +39,9 @@ namespace mustache {
     /// index of chunk in archetype
     struct MUSTACHE_EXPORT ChunkIndex : public IndexLike<uint32_t, ChunkIndex> {};
 
+    /// index of entity block (sub-range of chunk) in component version storage
+    struct MUSTACHE_EXPORT VersionBlockIndex : public IndexLike<uint32_t, VersionBlockIndex> {};
+
     /// index of element in component data storage
     struct MUSTACHE_EXPORT ComponentStorageIndex : public mustache::IndexLike<uint32_t, ComponentStorageIndex> {
         [[nodiscard]] static ComponentStorageIndex fromArchetypeIndex(ArchetypeEntityIndex index) noexcept {
@@ -23,6 +23,7 @@ namespace mustache {
         PerEntityJob() {
             filter_result_.mask = Info::componentMask();
             filter_result_.shared_component_mask = Info::sharedComponentMask();
+            Info::filterMasks(filter_result_.exclude_mask, filter_result_.any_of_masks);
         }
 
         ComponentIdMask checkMask() const noexcept override {
@@ -118,11 +119,13 @@ namespace mustache {
                         forEachArrayGenerated(world, array.arraySize(), invocation_index,
                                               RequiredComponent<Entity>(array.template getEntity<FunctionSafety::kUnsafe>()),
                                               getComponentHandler<_I>(array, component_indexes[_I])...,
-                                              makeShared(std::get<_SI>(shared_components))...);
+                                              makeShared(std::get<_SI>(shared_components))...,
+                                              JobArgFilter{});
                     } else {
                         forEachArrayGenerated(world, array.arraySize(), invocation_index,
                                               getComponentHandler<_I>(array, component_indexes[_I])...,
-                                              makeShared(std::get<_SI>(shared_components))...);
+                                              makeShared(std::get<_SI>(shared_components))...,
+                                              JobArgFilter{});
                     }
                 }
             }
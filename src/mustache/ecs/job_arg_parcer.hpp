@@ -45,6 +45,53 @@ namespace mustache {
         static constexpr bool value = IsOneOfTypes<T, World&, const World&>::value;
     };
 
+    /// value passed for filter arguments of job function, only their types are used
+    struct MUSTACHE_EXPORT JobArgFilter {
+        constexpr const JobArgFilter& operator[](size_t) const noexcept {
+            return *this;
+        }
+    };
+
+    /// job argument, archetypes with any of the components are skipped
+    template <typename... _C>
+    struct Without {
+        static_assert(sizeof...(_C) > 0u, "Without<> requires at least one component");
+        static_assert((!isComponentShared<_C>() && ...), "Without<> does not support shared components");
+        constexpr Without() noexcept = default;
+        constexpr Without(const JobArgFilter&) noexcept {}
+        static ComponentIdMask mask() noexcept {
+            return ComponentFactory::makeMask<_C...>();
+        }
+    };
+
+    /// job argument, only archetypes with at least one of the components are matched
+    template <typename... _C>
+    struct AnyOf {
+        static_assert(sizeof...(_C) > 0u, "AnyOf<> requires at least one component");
+        static_assert((!isComponentShared<_C>() && ...), "AnyOf<> does not support shared components");
+        constexpr AnyOf() noexcept = default;
+        constexpr AnyOf(const JobArgFilter&) noexcept {}
+        static ComponentIdMask mask() noexcept {
+            return ComponentFactory::makeMask<_C...>();
+        }
+    };
+
+    template <typename T>
+    struct IsArgWithout : std::false_type {};
+    template <typename... _C>
+    struct IsArgWithout<Without<_C...> > : std::true_type {};
+
+    template <typename T>
+    struct IsArgAnyOf : std::false_type {};
+    template <typename... _C>
+    struct IsArgAnyOf<AnyOf<_C...> > : std::true_type {};
+
+    template <typename T>
+    struct IsArgFilter {
+        using Type = typename std::remove_cv<typename std::remove_reference<T>::type>::type;
+        static constexpr bool value = IsArgWithout<Type>::value || IsArgAnyOf<Type>::value;
+    };
+
     template <typename Element, typename... ARGS>
     constexpr int32_t elementIndex(Element&& element, ARGS&&... args) {
         const std::array<bool, sizeof...(ARGS)> is_arg_match {
@@ -75,7 +122,8 @@ namespace mustache {
                 kEntity = 2,
                 kInvocationIndex = 3,
                 kArraySize = 4,
-                kWorld = 5
+                kWorld = 5,
+                kFilter = 6
             };
             ArgType type;
             uint32_t position;
@@ -100,6 +148,9 @@ namespace mustache {
             if constexpr(IsArgWorld<ArgType>::value) {
                 return ArgInfo(ArgInfo::kWorld, _I);
             }
+            if constexpr(IsArgFilter<ArgType>::value) {
+                return ArgInfo(ArgInfo::kFilter, _I);
+            }
 
             // Arg is component
             if constexpr (isComponentShared<ArgType>()) {
@@ -352,6 +403,25 @@ namespace mustache {
                 return updateMask(std::make_index_sequence<FunctionInfo::components_count>());
             }
         }
+
+        template<typename _Arg>
+        static void addFilterMask(ComponentIdMask& exclude_mask, std::vector<ComponentIdMask>& any_of_masks) noexcept {
+            using Type = typename IsArgFilter<_Arg>::Type;
+            if constexpr (IsArgWithout<Type>::value) {
+                exclude_mask = exclude_mask.merge(Type::mask());
+            } else if constexpr (IsArgAnyOf<Type>::value) {
+                any_of_masks.push_back(Type::mask());
+            }
+        }
+        template<size_t... _I>
+        static void filterMasks(ComponentIdMask& exclude_mask, std::vector<ComponentIdMask>& any_of_masks,
+                                const std::index_sequence<_I...>&) noexcept {
+            (addFilterMask<typename FunctionInfo::FC::template arg<_I>::type>(exclude_mask, any_of_masks), ...);
+        }
+        /// collects Without<...> and AnyOf<...> arguments of job function
+        static void filterMasks(ComponentIdMask& exclude_mask, std::vector<ComponentIdMask>& any_of_masks) noexcept {
+            filterMasks(exclude_mask, any_of_masks, FunctionInfo::args_indexes);
+        }
     };
 
 }
@@ -25,11 +25,11 @@ struct NewComponentDataStorage::ComponentDataHolder {
 
     void clear() {
         for (auto ptr : data) {
-            memory_manager->deallocate(ptr);
+            memory_manager->deallocateChunk(ptr, component_size * kComponentBlockSize);
         }
     }
     void allocate() {
-        auto* ptr = memory_manager->allocate(component_size * kComponentBlockSize, component_alignment);
+        auto* ptr = memory_manager->allocateChunk(component_size * kComponentBlockSize, component_alignment);
         data.push_back(static_cast<std::byte*>(ptr));
     }
 
@@ -102,6 +102,8 @@ uint32_t NonTemplateJob::applyFilter(World& world) noexcept {
     for (const auto& id : shared_component_ids) {
         filter_result_.shared_component_mask.set(id, true);
     }
+    filter_result_.exclude_mask = exclude_mask;
+    filter_result_.any_of_masks = any_of_masks;
 
     return BaseJob::applyFilter(world);
 }
@@ -55,6 +55,8 @@ namespace mustache {
 
         std::vector<ComponentRequest> component_requests;
         std::vector<SharedComponentId> shared_component_ids;
+        ComponentIdMask exclude_mask; // entities with any of these components are skipped
+        std::vector<ComponentIdMask> any_of_masks; // entity must have at least one component of every mask
         std::string job_name = "NonTemplateJob";
         bool require_entity = false;
     };
@@ -6,6 +6,20 @@
 
 using namespace mustache;
 
+void SystemConfig::access(const BaseJob& job) {
+    read_mask = read_mask.merge(job.componentMask());
+    write_mask = write_mask.merge(job.updateMask());
+    access_declared = true;
+}
+
+bool SystemConfig::conflictsWith(const SystemConfig& other) const noexcept {
+    if (!access_declared || !other.access_declared) {
+        return true;
+    }
+    return write_mask.isMatchAny(other.write_mask) || write_mask.isMatchAny(other.read_mask) ||
+            read_mask.isMatchAny(other.write_mask);
+}
+
 // TODO: make this functions execute all patch from current state to target state
 void ASystem::checkState(SystemState expected_state) const {
     [[maybe_unused]] const auto profiler_msg = name() + " | " + __FUNCTION__;
@@ -3,11 +3,14 @@
 #include <mustache/utils/uncopiable.hpp>
 #include <mustache/utils/type_info.hpp>
 
+#include <mustache/ecs/component_factory.hpp>
+
 #include <set>
 
 namespace mustache {
 
     class World;
+    class BaseJob;
 
     struct MUSTACHE_EXPORT SystemConfig {
         template <typename... ARGS>
@@ -18,10 +21,32 @@ namespace mustache {
         void updateAfter() {
             update_after.insert(ARGS::systemName()...);
         }
+
+        /// components read by onUpdate, see SystemManager::setParallelUpdate
+        template <typename... ARGS>
+        void reads() {
+            read_mask = read_mask.merge(ComponentFactory::makeMask<ARGS...>());
+            access_declared = true;
+        }
+        /// components modified by onUpdate, see SystemManager::setParallelUpdate
+        template <typename... ARGS>
+        void writes() {
+            write_mask = write_mask.merge(ComponentFactory::makeMask<ARGS...>());
+            access_declared = true;
+        }
+        /// components of the job are read, non-const arguments are modified
+        void access(const BaseJob& job);
+
+        /// true if systems can not run at the same time
+        [[nodiscard]] bool conflictsWith(const SystemConfig& other) const noexcept;
+
         std::set<std::string> update_before;
         std::set<std::string> update_after;
         std::string update_group = "";
         int32_t priority = 0;
+        ComponentIdMask read_mask;
+        ComponentIdMask write_mask;
+        bool access_declared = false; // system without declared access conflicts with any other system
     };
 
     enum class SystemState : uint32_t {
@@ -3,10 +3,14 @@
 #include <mustache/utils/profiler.hpp>
 
 #include <mustache/ecs/system.hpp>
+#include <mustache/ecs/world.hpp>
 
 #include <map>
+#include <mutex>
 #include <vector>
+#include <sstream>
 #include <algorithm>
+#include <exception>
 #include <stdexcept>
 
 using namespace mustache;
@@ -31,6 +35,76 @@ struct SystemManager::Data {
     std::vector<SystemPtr> ordered_systems;
     std::map<std::string, int32_t> group_priorities;
     std::map<std::string, SystemPtr > system_by_name;
+
+    /// node per system of ordered_systems, edges go from earlier systems to later ones only
+    struct SystemNode {
+        SystemPtr system;
+        bool exclusive = false;
+        uint32_t predecessors_count = 0u;
+        std::vector<uint32_t> successors;
+        std::vector<uint32_t> direct_predecessors; // without edges implied by other paths
+    };
+    std::vector<SystemNode> graph;
+    bool parallel_update = false;
+
+    struct {
+        std::mutex mutex;
+        std::vector<uint32_t> predecessors; // not finished yet
+        std::vector<uint32_t> pending; // ready systems left to the updating thread
+        std::exception_ptr exception; // first one thrown by a system
+    } update_state;
+
+    /// exception is kept for SystemManager::update to rethrow it
+    void updateSystem(uint32_t index) noexcept {
+        const auto& system = graph[index].system;
+        try {
+            if (system->state() == SystemState::kActive) {
+                system->update(world);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock{update_state.mutex};
+            if (!update_state.exception) {
+                update_state.exception = std::current_exception();
+            }
+        }
+    }
+
+    void startSystem(uint32_t index) {
+        world.dispatcher().addParallelTask([this, index] {
+            updateSystem(index);
+            onSystemFinished(index);
+        });
+    }
+
+    /**
+     * Starts ready successors at once if there are no recorded commands,
+     * otherwise they are left to the updating thread, which applies the commands first.
+     * Nothing is started after an exception.
+     */
+    void onSystemFinished(uint32_t index) noexcept {
+        std::vector<uint32_t> ready;
+        {
+            std::lock_guard<std::mutex> lock{update_state.mutex};
+            const bool start = !update_state.exception && !world.entities().hasRecordedCommands();
+            for (auto successor : graph[index].successors) {
+                if (--update_state.predecessors[successor] != 0u || update_state.exception) {
+                    continue;
+                }
+                auto& target = start && !graph[successor].exclusive ? ready : update_state.pending;
+                target.push_back(successor);
+            }
+        }
+        // started out of the lock, the task may run at once
+        for (auto it = ready.begin(); it != ready.end(); ++it) {
+            try {
+                startSystem(*it);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock{update_state.mutex};
+                update_state.pending.insert(update_state.pending.end(), it, ready.end());
+                break;
+            }
+        }
+    }
 };
 
 SystemManager::SystemManager(World& world) :
@@ -51,6 +125,11 @@ void SystemManager::update() {
         return;
     }
 
+    if (data_->parallel_update && data_->world.dispatcher().threadCount() > 0u) {
+        updateParallel();
+        return;
+    }
+
     for (const auto& system : data_->ordered_systems) {
         auto state = system->state();
 
@@ -111,7 +190,6 @@ void mustache::SystemManager::addSystem(SystemManager::SystemPtr system) {
 void mustache::SystemManager::reorderSystems() {
     MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
 
-    auto systems_cpy = data_->systems_info;
     std::set<std::string> unplaced_systems_names;
     {
         std::map<std::string, Data::SystemInfo*> map;
@@ -131,6 +209,8 @@ void mustache::SystemManager::reorderSystems() {
         }
     }
 
+    // copy after update_before is moved to update_after of the other system
+    auto systems_cpy = data_->systems_info;
     std::sort(systems_cpy.begin(), systems_cpy.end(),
               [this](const Data::SystemInfo& a, const Data::SystemInfo& b) {
                   const auto group_prior_a = getGroupPriority(a.config.update_group);
@@ -172,6 +252,142 @@ void mustache::SystemManager::reorderSystems() {
     }
 
     data_->ordered_systems = ordered_systems;
+    buildDependencyGraph();
+}
+
+void mustache::SystemManager::buildDependencyGraph() {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
+
+    std::map<SystemPtr, const SystemConfig*> configs;
+    for (const auto& info : data_->systems_info) {
+        configs[info.system] = &info.config;
+    }
+    std::map<std::string, uint32_t> index_by_name;
+    const auto count = static_cast<uint32_t>(data_->ordered_systems.size());
+    auto& graph = data_->graph;
+    graph.clear();
+    graph.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        graph[i].system = data_->ordered_systems[i];
+        index_by_name[graph[i].system->name()] = i;
+    }
+
+    // reachable[i][j]: system j is updated after system i
+    std::vector<std::vector<bool> > reachable(count, std::vector<bool>(count, false));
+    for (uint32_t j = 0; j < count; ++j) {
+        const auto& config = *configs[graph[j].system];
+        graph[j].exclusive = !config.access_declared;
+        std::vector<bool> depends_on(count, false);
+        for (const auto& name : config.update_after) {
+            const auto find_res = index_by_name.find(name);
+            if (find_res != index_by_name.end() && find_res->second < j) {
+                depends_on[find_res->second] = true;
+            }
+        }
+        for (uint32_t i = 0; i < j; ++i) {
+            if (config.conflictsWith(*configs[graph[i].system])) {
+                depends_on[i] = true;
+            }
+        }
+        // latest predecessors first, so edges implied by a path through a later predecessor are skipped
+        for (uint32_t i = j; i-- > 0u;) {
+            if (!depends_on[i] || reachable[i][j]) {
+                continue;
+            }
+            graph[i].successors.push_back(j);
+            graph[j].direct_predecessors.push_back(i);
+            ++graph[j].predecessors_count;
+            for (uint32_t k = 0; k <= i; ++k) {
+                if (k == i || reachable[k][i]) {
+                    reachable[k][j] = true;
+                }
+            }
+        }
+    }
+}
+
+void mustache::SystemManager::updateParallel() {
+    MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
+
+    auto& world = data_->world;
+    auto& graph = data_->graph;
+    auto& state = data_->update_state;
+    const auto count = static_cast<uint32_t>(graph.size());
+    for (const auto& node : graph) {
+        if (node.system->state() == SystemState::kConfigured) {
+            node.system->start(world);
+        }
+    }
+    state.predecessors.resize(count);
+    state.pending.clear();
+    state.exception = nullptr;
+    for (uint32_t i = 0; i < count; ++i) {
+        state.predecessors[i] = graph[i].predecessors_count;
+        if (state.predecessors[i] == 0u) {
+            state.pending.push_back(i);
+        }
+    }
+
+    auto& dispatcher = world.dispatcher();
+    auto& entities = world.entities();
+    entities.lock();
+    std::vector<uint32_t> pending;
+    while (true) {
+        // systems started by finished ones are joined here too, the calling thread helps to run them
+        dispatcher.waitForParallelFinish();
+        {
+            std::lock_guard<std::mutex> lock{state.mutex};
+            pending.swap(state.pending);
+        }
+        if (state.exception || pending.empty()) {
+            break;
+        }
+        if (entities.hasRecordedCommands()) {
+            entities.unlock();
+            entities.lock();
+        }
+        for (auto index : pending) {
+            if (graph[index].exclusive) {
+                // conflicts with every system, so all systems before it have finished and none after it is running
+                entities.unlock();
+                data_->updateSystem(index);
+                entities.lock();
+                data_->onSystemFinished(index);
+            } else {
+                data_->startSystem(index);
+            }
+        }
+        pending.clear();
+    }
+    entities.unlock();
+    if (state.exception) {
+        std::rethrow_exception(state.exception);
+    }
+}
+
+void mustache::SystemManager::setParallelUpdate(bool on) noexcept {
+    data_->parallel_update = on;
+}
+
+bool mustache::SystemManager::isParallelUpdate() const noexcept {
+    return data_->parallel_update;
+}
+
+std::string mustache::SystemManager::dependencyGraph() const {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+    std::stringstream stream;
+    stream << "digraph systems {\n";
+    for (const auto& node : data_->graph) {
+        stream << "    \"" << node.system->name() << "\"" << (node.exclusive ? " [shape=box]" : "") << ";\n";
+    }
+    for (const auto& node : data_->graph) {
+        for (auto predecessor : node.direct_predecessors) {
+            stream << "    \"" << data_->graph[predecessor].system->name() << "\" -> \"" << node.system->name()
+                   << "\";\n";
+        }
+    }
+    stream << "}\n";
+    return stream.str();
 }
 
 int32_t mustache::SystemManager::getGroupPriority(const std::string& group_name) const noexcept {
@@ -43,8 +43,25 @@ namespace mustache {
 
         [[nodiscard]] int32_t getGroupPriority(const std::string& group_name) const noexcept;
         void setGroupPriority(const std::string& group_name, int32_t priority) noexcept;
+
+        /**
+         * Systems are updated on World Dispatcher, systems without conflicting access (SystemConfig::reads / writes)
+         * run concurrently, conflicting systems and update_before / update_after keep sequential order.
+         * System without declared access runs alone with unlocked EntityManager, other systems run while it is locked,
+         * so their structural changes are applied before conflicting systems start, or after update.
+         * The first exception thrown by a system is rethrown by update() after running systems have finished,
+         * systems which have not started yet are skipped.
+         * Systems are started before update.
+         */
+        void setParallelUpdate(bool on) noexcept;
+        [[nodiscard]] bool isParallelUpdate() const noexcept;
+
+        /// dependency graph in graphviz dot format, edge A -> B: B is updated after A, implied edges are omitted
+        [[nodiscard]] std::string dependencyGraph() const;
     private:
         void reorderSystems();
+        void buildDependencyGraph();
+        void updateParallel();
         struct Data;
         std::unique_ptr<Data> data_;
     };
@@ -22,7 +22,7 @@ namespace mustache {
 
 
         void updateBlock() {
-            if (dist_to_end_ > 0) {
+            while (dist_to_end_ > 0) {
                 const auto index_in_archetype = globalIndex().toInt();
 
                 dist_to_block_end_ = filter_result_->blocks[current_block_].end.toInt() - index_in_archetype;
@@ -33,6 +33,21 @@ namespace mustache {
                     dist_to_block_end_ = block.end.toInt() - block.begin.toInt();
                 }
                 array_size_ = std::min(dist_to_block_end_, std::min(distToChunkEnd(), dist_to_end_));
+                const auto& disabled = filter_result_->disabled_components;
+                if (disabled.empty()) {
+                    return;
+                }
+                // rows with disabled required components are skipped, array ends at the next disabled row
+                const auto& enable_storage = filter_result_->archetype->enableStorage();
+                const auto index = globalIndex().toArchetypeIndex();
+                const auto count = static_cast<uint32_t>(disabled.size());
+                const auto num_disabled = enable_storage.countRows(disabled.data(), count, index, true, array_size_);
+                if (num_disabled == 0u) {
+                    array_size_ = enable_storage.countRows(disabled.data(), count, index, false, array_size_);
+                    return;
+                }
+                dist_to_end_ -= num_disabled;
+                *this += num_disabled;
             }
         }
 
@@ -1,7 +1,19 @@
 #include "temporal_storage.hpp"
 
+#include <algorithm>
+#include <cstdint>
+
 using namespace mustache;
 
+TemporalStorage::TemporalStorage(MemoryManager& memory_manager):
+        memory_manager_{&memory_manager},
+        create_actions_{memory_manager},
+        actions_{memory_manager},
+        bulk_actions_{memory_manager},
+        chunks_{memory_manager} {
+
+}
+
 TemporalStorage::~TemporalStorage() {
     for (const auto& action : actions_) {
         if (action.action == Action::kCreateEntity &&
@@ -10,19 +22,38 @@ TemporalStorage::~TemporalStorage() {
             action.type_info->functions.destroy(action.ptr);
         }
     }
+    releaseChunks();
     clear();
 }
 
+TemporalStorage::Statistics TemporalStorage::statistics() const noexcept {
+    Statistics result;
+    result.used = total_size_;
+    result.high_water_mark = std::max(high_water_mark_, total_size_);
+    result.chunk_count = static_cast<uint32_t>(chunks_.size());
+    result.chunk_allocations = chunk_allocations_;
+    for (const auto& chunk : chunks_) {
+        result.capacity += chunk.capacity;
+    }
+    return result;
+}
+
 void* TemporalStorage::assignComponent(World& world, Entity entity, ComponentId id, bool skip_constructor) {
     const auto& component_info = ComponentFactory::componentInfo(id);
-    auto& command = emplaceItem(entity, Action::kAssignComponent);
-    command.type_info = &component_info;
-    command.component_id = id;
-    command.ptr = allocate(static_cast<uint32_t>(component_info.size));
+    auto* command = findTailCommand(entity, id);
+    if (command != nullptr && command->action == Action::kAssignComponent) {
+        // repeated assign reuses payload of the previous one
+        destroyPayload(*command);
+    } else {
+        command = &emplaceItem(entity, Action::kAssignComponent);
+        command->type_info = &component_info;
+        command->component_id = id;
+        command->ptr = allocate(static_cast<uint32_t>(component_info.size), static_cast<uint32_t>(component_info.align));
+    }
     if (!skip_constructor && component_info.functions.create) {
-        component_info.functions.create(command.ptr, entity, world);
+        component_info.functions.create(command->ptr, entity, world);
     }
-    return command.ptr;
+    return command->ptr;
 }
 
 void TemporalStorage::create(Entity entity, const ComponentIdMask& mask, const SharedComponentsInfo& shared) {
@@ -37,6 +68,17 @@ void TemporalStorage::create(Entity entity, const ComponentIdMask& mask, const S
 }
 
 void TemporalStorage::removeComponent(Entity entity, ComponentId id) {
+    auto* prev = findTailCommand(entity, id);
+    if (prev != nullptr) {
+        if (prev->action == Action::kAssignComponent) {
+            // assign followed by remove: payload is dropped, component is removed if entity had it before
+            destroyPayload(*prev);
+            prev->action = Action::kRemoveComponent;
+            prev->type_info = nullptr;
+            prev->ptr = nullptr;
+        }
+        return;
+    }
     auto& command = emplaceItem(entity, Action::kRemoveComponent);
     command.component_id = id;
 }
@@ -46,35 +88,101 @@ void TemporalStorage::destroy(Entity entity) {
 }
 
 void TemporalStorage::destroyNow(Entity entity) {
+    // commands of the tail run are useless, create command is kept to release entity id on apply
+    auto begin = actions_.size();
+    while (begin > 0u && actions_[begin - 1u].entity == entity) {
+        --begin;
+    }
+    if (begin < actions_.size() && actions_[begin].action == Action::kCreateEntity) {
+        ++begin;
+    }
+    for (auto i = begin; i < actions_.size(); ++i) {
+        destroyPayload(actions_[i]);
+    }
+    actions_.resize(begin);
     emplaceItem(entity, Action::kDestroyEntityNow);
 }
 
+void TemporalStorage::addComponentToAll(ComponentId id, const ComponentIdMask& mask,
+                                        const SharedComponentIdMask& shared) {
+    bulk_actions_.push_back(BulkAction{id, mask, shared, true});
+}
+
+void TemporalStorage::removeComponentFromAll(ComponentId id, const ComponentIdMask& mask,
+                                             const SharedComponentIdMask& shared) {
+    bulk_actions_.push_back(BulkAction{id, mask, shared, false});
+}
+
 void TemporalStorage::clear() {
     actions_.clear();
+    bulk_actions_.clear();
     create_actions_.clear();
+    high_water_mark_ = std::max(high_water_mark_, total_size_);
+    total_size_ = 0u;
     if (chunks_.size() > 1u) {
-        chunks_.clear();
-    } else {
-        if (!chunks_.empty()) {
-            chunks_.front().free_space = chunks_.front().capacity;
-        }
+        // payloads did not fit into one chunk, replace chunks with one of high-water mark size
+        releaseChunks();
+        allocateChunk(high_water_mark_);
+    } else if (!chunks_.empty()) {
+        chunks_.front().used = 0u;
     }
-    target_chunk_size_ = total_size_;
-    total_size_ = 0u;
 }
 
-std::byte* TemporalStorage::allocate(uint32_t size) {
-    if (chunks_.empty() || chunks_.back().free_space < size) {
-        if (target_chunk_size_ < size) {
-            target_chunk_size_ = size;
-        }
-        chunks_.emplace_back(target_chunk_size_);
+std::byte* TemporalStorage::allocate(uint32_t size, uint32_t align) {
+    align = std::max(align, 1u);
+    const auto alignedOffset = [align](const DataChunk& chunk) {
+        const auto address = reinterpret_cast<uintptr_t>(chunk.data + chunk.used);
+        return chunk.used + static_cast<uint32_t>((align - address % align) % align);
+    };
+    if (chunks_.empty() || alignedOffset(chunks_.back()) + size > chunks_.back().capacity) {
+        const auto last_capacity = chunks_.empty() ? 0u : chunks_.back().capacity;
+        allocateChunk(std::max(last_capacity * 2u, size + align));
     }
     auto& chunk = chunks_.back();
-    const auto offset = chunk.capacity - chunk.free_space;
-    chunk.free_space -= size;
-    total_size_ += size;
-    return chunk.data.get() + offset;
+    const auto offset = alignedOffset(chunk);
+    // worst case padding is counted, so the high-water mark fits into one chunk regardless of chunk boundaries
+    total_size_ += size + align - 1u;
+    chunk.used = offset + size;
+    return chunk.data + offset;
+}
+
+void TemporalStorage::allocateChunk(uint32_t capacity) {
+    capacity = std::max(capacity, kMinChunkSize);
+    // aligned_alloc requires size to be multiple of alignment
+    capacity = (capacity + kChunkAlignment - 1u) / kChunkAlignment * kChunkAlignment;
+    DataChunk chunk;
+    chunk.data = static_cast<std::byte*>(memory_manager_->allocate(capacity, kChunkAlignment));
+    chunk.capacity = capacity;
+    chunks_.push_back(chunk);
+    ++chunk_allocations_;
+}
+
+void TemporalStorage::releaseChunks() noexcept {
+    for (const auto& chunk : chunks_) {
+        memory_manager_->deallocate(chunk.data);
+    }
+    chunks_.clear();
+}
+
+TemporalStorage::ActionInfo* TemporalStorage::findTailCommand(Entity entity, ComponentId id) noexcept {
+    for (auto it = actions_.rbegin(); it != actions_.rend() && it->entity == entity; ++it) {
+        const bool is_component_command = it->action == Action::kAssignComponent ||
+                it->action == Action::kRemoveComponent;
+        if (is_component_command && it->component_id == id) {
+            return &*it;
+        }
+        if (it->action == Action::kDestroyEntityNow) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+void TemporalStorage::destroyPayload(ActionInfo& command) noexcept {
+    if (command.action == Action::kAssignComponent && command.ptr != nullptr &&
+        command.type_info->functions.destroy) {
+        command.type_info->functions.destroy(command.ptr);
+    }
 }
 
 TemporalStorage::ActionInfo& TemporalStorage::emplaceItem(Entity entity, Action action) {
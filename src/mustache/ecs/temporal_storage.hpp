@@ -2,6 +2,7 @@
 
 #include <mustache/utils/dll_export.h>
 #include <mustache/utils/array_wrapper.hpp>
+#include <mustache/utils/memory_manager.hpp>
 
 #include <mustache/ecs/entity.hpp>
 #include <mustache/ecs/component_factory.hpp>
@@ -20,10 +21,21 @@ namespace mustache {
             kRemoveComponent = 3,
             kAssignComponent = 4,
         };
-        TemporalStorage() = default;
+        /// usage of payload arena
+        struct Statistics {
+            size_t used = 0u; // bytes used by payloads of recorded commands, including worst case alignment padding
+            size_t capacity = 0u; // bytes allocated for payloads
+            size_t high_water_mark = 0u; // max of used bytes between clears
+            uint32_t chunk_count = 0u;
+            uint32_t chunk_allocations = 0u; // total count of chunks allocated by MemoryManager
+        };
+
+        explicit TemporalStorage(MemoryManager& memory_manager);
         TemporalStorage(TemporalStorage&&) = default;
         ~TemporalStorage();
 
+        [[nodiscard]] Statistics statistics() const noexcept;
+
 
         void* assignComponent(World& world, Entity entity, ComponentId id, bool skip_constructor);
 
@@ -36,23 +48,18 @@ namespace mustache {
         // destroy after EntityManager::unlock()
         void destroyNow(Entity entity);
 
+        // add / remove component for every entity matching masks after EntityManager::unlock()
+        void addComponentToAll(ComponentId id, const ComponentIdMask& mask, const SharedComponentIdMask& shared);
+        void removeComponentFromAll(ComponentId id, const ComponentIdMask& mask, const SharedComponentIdMask& shared);
+
         void clear();
 
         struct DataChunk {
-            DataChunk(uint32_t size):
-                free_space{size},
-                capacity{size},
-                data{new std::byte[size]} {
-
-            }
-            DataChunk(DataChunk&&) = default;
-
-            uint32_t free_space;
-            uint32_t capacity;
-            std::unique_ptr<std::byte[]> data;
+            std::byte* data = nullptr; // allocated by MemoryManager with kChunkAlignment
+            uint32_t used = 0u;
+            uint32_t capacity = 0u;
         };
 
-
         struct CreateActionIndex : public IndexLike<size_t, CreateActionIndex> {};
 
         struct ActionInfo {
@@ -75,15 +82,39 @@ namespace mustache {
             ComponentIdMask mask;
             SharedComponentsInfo shared;
         };
-        ArrayWrapper<CreateAction, CreateActionIndex, false> create_actions_;
-        std::vector<ActionInfo> actions_;
+        struct BulkAction {
+            ComponentId component_id;
+            ComponentIdMask mask;
+            SharedComponentIdMask shared;
+            bool add;
+        };
+        MemoryManager* memory_manager_;
+        ArrayWrapper<CreateAction, CreateActionIndex, true> create_actions_;
+        std::vector<ActionInfo, Allocator<ActionInfo> > actions_;
+        std::vector<BulkAction, Allocator<BulkAction> > bulk_actions_;
 
         ActionInfo& emplaceItem(Entity enity, Action action);
 
-        std::byte* allocate(uint32_t size);
+        /**
+         * Commands of one entity are usually recorded one after another, so only this tail run is coalesced here,
+         * the rest is coalesced by EntityManager on apply.
+         * Returns the last assign / remove command of component in the tail run of entity.
+         */
+        ActionInfo* findTailCommand(Entity entity, ComponentId id) noexcept;
+
+        static void destroyPayload(ActionInfo& command) noexcept;
+
+        /// returns memory for payload aligned at align, chunks are kept between clears
+        std::byte* allocate(uint32_t size, uint32_t align);
+        void allocateChunk(uint32_t capacity);
+        void releaseChunks() noexcept;
+
+        static constexpr uint32_t kChunkAlignment = 64u;
+        static constexpr uint32_t kMinChunkSize = 4096u;
 
-        std::vector<DataChunk> chunks_;
-        uint32_t target_chunk_size_ = 4096u;
+        std::vector<DataChunk, Allocator<DataChunk> > chunks_;
         uint32_t total_size_ = 0u;
+        uint32_t high_water_mark_ = 0u;
+        uint32_t chunk_allocations_ = 0u;
     };
 }
@@ -2,6 +2,8 @@
 
 #include <mustache/utils/profiler.hpp>
 
+#include <set>
+
 using namespace mustache;
 
 namespace {
@@ -25,7 +27,7 @@ World::~World() {
 void World::init() {
     MUSTACHE_PROFILER_BLOCK_LVL_0("World::init()");
 
-    version_ = WorldVersion::make(0);
+    version_.store(0u, std::memory_order_release);
 
     if (systems_) {
         systems_->init();
@@ -9,6 +9,7 @@
 #include <mustache/ecs/entity_manager.hpp>
 #include <mustache/ecs/system_manager.hpp>
 
+#include <atomic>
 #include <cstdint>
 
 namespace mustache {
@@ -74,15 +75,16 @@ namespace mustache {
             return id_;
         }
         [[nodiscard]] WorldVersion version() const noexcept {
-            return version_;
+            return WorldVersion::make(version_.load(std::memory_order_acquire));
         }
 
         [[nodiscard]] WorldStorage& storage() noexcept {
             return world_storage_;
         }
 
+        /// jobs may be run from parallel tasks
         void incrementVersion() noexcept {
-            ++version_;
+            version_.fetch_add(1u, std::memory_order_acq_rel);
         }
     private:
         WorldId id_;
@@ -90,6 +92,6 @@ namespace mustache {
         std::unique_ptr<SystemManager> systems_;
         EntityManager entities_;
         WorldStorage world_storage_;
-        WorldVersion version_ = WorldVersion::make(0u);
+        std::atomic<uint32_t> version_{0u};
     };
 }
@@ -42,6 +42,7 @@ namespace mustache {
             uint32_t entities_count {0};
             void addBlock(const EntityBlock& block) noexcept;
             ArrayWrapper<EntityBlock, BlockIndex, false> blocks; // TODO: use memory manager
+            std::vector<ComponentIndex> disabled_components; // required components having disabled rows
         };
 
         void clear() noexcept;
@@ -49,6 +50,8 @@ namespace mustache {
         std::vector<ArchetypeFilterResult> filtered_archetypes;
         ComponentIdMask mask;
         SharedComponentIdMask shared_component_mask;
+        ComponentIdMask exclude_mask; // archetypes with any of these components are skipped
+        std::vector<ComponentIdMask> any_of_masks; // archetype must have at least one component of every mask
         uint32_t total_entity_count{0u};
     };
 }
@@ -1,5 +1,10 @@
 #include "dispatch.hpp"
 #include <queue>
+#include <mutex>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <unordered_map>
 #include <map>
 #include <set>
 #include <string>
@@ -11,7 +16,26 @@
 #define NUMBER_OF_CORES std::thread::hardware_concurrency()
 #endif
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define DISPATCHER_HAS_FUTEX 1
+#else
+#define DISPATCHER_HAS_FUTEX 0
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define DISPATCHER_CPU_RELAX() _mm_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define DISPATCHER_CPU_RELAX() asm volatile("yield")
+#else
+#define DISPATCHER_CPU_RELAX() std::this_thread::yield()
+#endif
+
 #include <mustache/utils/profiler.hpp>
+#include <mustache/utils/work_stealing_deque.hpp>
 
 using namespace mustache;
 
@@ -67,15 +91,184 @@ namespace {
     };
 
     thread_local ThreadId g_thread_id;
+    thread_local const void* g_thread_dispatcher = nullptr;
+
+    constexpr uint32_t kStealAttemptsBeforeSleep = 64u;
+    constexpr uint32_t kSpinsBeforePark = 2048u;
+
+    std::atomic<uint64_t> g_next_dispatcher_generation{1u};
+
+    /// number of unfinished jobs, waiting thread spins for a while and then parks in futex (or condition variable)
+    class CompletionCounter {
+    public:
+        void add(uint32_t count) noexcept {
+            pending_.fetch_add(count, std::memory_order_relaxed);
+        }
+
+        void done() noexcept {
+            if (pending_.fetch_sub(1u, std::memory_order_seq_cst) == 1u &&
+                waiters_.load(std::memory_order_seq_cst) > 0u) {
+                wake();
+            }
+        }
+
+        [[nodiscard]] bool finished() const noexcept {
+            return pending_.load(std::memory_order_acquire) == 0u;
+        }
+
+        void wait() noexcept {
+            MUSTACHE_PROFILER_BLOCK_LVL_3("Wait other threads");
+            for (uint32_t i = 0; i < kSpinsBeforePark; ++i) {
+                if (finished()) {
+                    return;
+                }
+                DISPATCHER_CPU_RELAX();
+            }
+            waiters_.fetch_add(1u, std::memory_order_seq_cst);
+            park();
+            waiters_.fetch_sub(1u, std::memory_order_relaxed);
+        }
+
+    private:
+        void park() noexcept {
+#if DISPATCHER_HAS_FUTEX
+            static_assert(sizeof(pending_) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free);
+            for (auto value = pending_.load(std::memory_order_seq_cst); value != 0u;
+                 value = pending_.load(std::memory_order_seq_cst)) {
+                // returns at once if counter has been changed
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&pending_), FUTEX_WAIT_PRIVATE, value,
+                        nullptr, nullptr, 0);
+            }
+#else
+            std::unique_lock<std::mutex> lock{mutex_};
+            while (pending_.load(std::memory_order_seq_cst) != 0u) {
+                condition_.wait(lock);
+            }
+#endif
+        }
+
+        void wake() noexcept {
+#if DISPATCHER_HAS_FUTEX
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&pending_), FUTEX_WAKE_PRIVATE, INT_MAX,
+                    nullptr, nullptr, 0);
+#else
+            { std::lock_guard<std::mutex> lock{mutex_}; }
+            condition_.notify_all();
+#endif
+        }
+
+        std::atomic<uint32_t> pending_{0u};
+        std::atomic<uint32_t> waiters_{0u};
+#if !DISPATCHER_HAS_FUTEX
+        std::mutex mutex_;
+        std::condition_variable condition_;
+#endif
+    };
+
+    /// tasks of a batch, memory is reused once all tasks of the batch are finished
+    class TaskArena {
+    public:
+        Task* allocate(uint32_t count, bool reuse) {
+            if (reuse) {
+                chunk_ = 0u;
+                offset_ = 0u;
+            }
+            while (chunk_ < chunks_.size() && chunks_[chunk_].size - offset_ < count) {
+                ++chunk_;
+                offset_ = 0u;
+            }
+            if (chunk_ == chunks_.size()) {
+                const auto size = count > kChunkSize ? count : kChunkSize;
+                chunks_.push_back(Chunk{std::make_unique<Task[]>(size), size});
+            }
+            auto result = chunks_[chunk_].tasks.get() + offset_;
+            offset_ += count;
+            return result;
+        }
+    private:
+        static constexpr uint32_t kChunkSize = 256u;
+        struct Chunk {
+            std::unique_ptr<Task[]> tasks;
+            uint32_t size;
+        };
+        std::vector<Chunk> chunks_;
+        size_t chunk_ = 0u;
+        uint32_t offset_ = 0u;
+    };
+
+    struct Batch {
+        CompletionCounter counter;
+        TaskArena arena;
+        uint32_t unpublished = 0u; // allocated tasks are not counted until publish
+    };
+
+    /// a task running on the thread opens a new level, so waits inside of the task are scoped to its own batch
+    struct ThreadBatches {
+        Batch& current() {
+            while (levels.size() <= depth) {
+                levels.emplace_back(std::make_unique<Batch>());
+            }
+            return *levels[depth];
+        }
+        [[nodiscard]] bool currentFinished() const noexcept {
+            return depth >= levels.size() || (levels[depth]->counter.finished() && levels[depth]->unpublished == 0u);
+        }
+        std::vector<std::unique_ptr<Batch> > levels;
+        uint32_t depth = 0u;
+    };
+
+    // generations of alive Dispatchers, threads drop their batches of destroyed ones lazily
+    std::mutex g_dispatchers_mutex;
+    std::set<uint64_t> g_alive_dispatchers;
+    std::atomic<uint64_t> g_destroyed_dispatchers{0u};
+
+    /// batches of the thread per Dispatcher generation, released with the thread
+    struct ThreadBatchesMap {
+        ThreadBatches& get(uint64_t generation) {
+            if (generation == cached_generation) {
+                return *cached;
+            }
+            const auto destroyed = g_destroyed_dispatchers.load(std::memory_order_acquire);
+            if (destroyed != seen_destroyed) {
+                seen_destroyed = destroyed;
+                std::lock_guard<std::mutex> lock{g_dispatchers_mutex};
+                for (auto it = map.begin(); it != map.end();) {
+                    it = g_alive_dispatchers.count(it->first) > 0u ? std::next(it) : map.erase(it);
+                }
+            }
+            auto& result = map[generation];
+            if (!result) {
+                result = std::make_unique<ThreadBatches>();
+            }
+            cached_generation = generation;
+            cached = result.get();
+            return *result;
+        }
+        std::unordered_map<uint64_t, std::unique_ptr<ThreadBatches> > map;
+        uint64_t cached_generation = 0u;
+        ThreadBatches* cached = nullptr;
+        uint64_t seen_destroyed = 0u;
+    };
+    thread_local ThreadBatchesMap g_thread_batches;
 }
 
 struct Dispatcher::Data {
-    JobQueue parallel_jobs;
+    // deques[0] is shared by threads outside of Dispatcher, deques[i] is owned by worker i
+    struct Worker {
+        WorkStealingDeque<Task*> deque;
+        std::mutex external_mutex; // guards owner side of deques[0] only
+    };
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::atomic<uint32_t> extra_jobs{0u};
+
+    // jobs added by a thread since its last waitForParallelFinish are kept in g_thread_batches by generation
+    const uint64_t generation{g_next_dispatcher_generation.fetch_add(1u, std::memory_order_relaxed)};
+
     mutable std::mutex mutex;
     std::condition_variable jobs_available;
+    std::condition_variable queue_unlocked;
     std::vector<std::thread> threads;
-    std::set<std::thread::id> thread_ids;
-    uint32_t threads_waiting{0u};
+    std::atomic<uint32_t> threads_waiting{0u};
 
     struct {
         std::vector<std::unique_ptr<JobQueue> > array;
@@ -83,14 +276,11 @@ struct Dispatcher::Data {
         std::map<std::string, QueueId> by_name;
     } extra;
 
-    bool terminate {false};
+    std::atomic<bool> terminate {false};
     bool single_thread_mode{false};
 
     JobQueue* findQueue() {
         MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
-        if(parallel_jobs.isOk()) {
-            return &parallel_jobs;
-        }
         for(auto& pair : extra.by_priority) {
             JobQueue* ptr = extra.array[pair.second].get();
             if(ptr->isOk()) {
@@ -100,58 +290,186 @@ struct Dispatcher::Data {
         return nullptr;
     }
 
-    [[nodiscard]] ThreadId currentThreadId() noexcept {
+    [[nodiscard]] bool isDispatcherThread() const noexcept {
+        return g_thread_dispatcher == this && !g_thread_id.isNull();
+    }
+
+    [[nodiscard]] ThreadId currentThreadId() const noexcept {
         MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
-        auto thread_id = g_thread_id;
-        if (thread_id.isNull() || thread_ids.count(std::this_thread::get_id()) < 1) {
-            thread_id = ThreadId::make(0);
+        return isDispatcherThread() ? g_thread_id : ThreadId::make(0);
+    }
+
+    ThreadBatches& threadBatches() {
+        return g_thread_batches.get(generation);
+    }
+
+    Batch& currentBatch() {
+        return threadBatches().current();
+    }
+
+    void push(Task* tasks, uint32_t count) {
+        auto& batch = currentBatch();
+        batch.unpublished -= count < batch.unpublished ? count : batch.unpublished;
+        batch.counter.add(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            tasks[i].batch_ = &batch.counter;
         }
-        return thread_id;
+        if (isDispatcherThread()) {
+            auto& deque = workers[g_thread_id.toInt()]->deque;
+            for (uint32_t i = 0; i < count; ++i) {
+                deque.push(tasks + i);
+            }
+        } else {
+            auto& external = *workers[0];
+            std::lock_guard<std::mutex> lock{external.external_mutex};
+            for (uint32_t i = 0; i < count; ++i) {
+                external.deque.push(tasks + i);
+            }
+        }
+        wakeUp(count);
     }
 
-#define DOUBLE_LOCK 1
+    void wakeUp(uint32_t count) {
+        // pairs with increment of threads_waiting in sleep(), so either the job is seen or the thread is notified
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (threads_waiting.load(std::memory_order_relaxed) > 0u) {
+            { std::lock_guard<std::mutex> lock{mutex}; }
+            if (count > 1u) {
+                jobs_available.notify_all();
+            } else {
+                jobs_available.notify_one();
+            }
+        }
+    }
+
+    /// own deque first (LIFO), then steal from the others starting from the next one (FIFO)
+    Task* takeParallelJob(uint32_t self) noexcept {
+        Task* job = nullptr;
+        if (self == 0u) {
+            auto& external = *workers[0];
+            std::lock_guard<std::mutex> lock{external.external_mutex};
+            if (external.deque.pop(job)) {
+                return job;
+            }
+        } else if (workers[self]->deque.pop(job)) {
+            return job;
+        }
+        const auto count = static_cast<uint32_t>(workers.size());
+        for (uint32_t i = 1u; i < count; ++i) {
+            auto& victim = workers[(self + i) % count]->deque;
+            if (victim.steal(job)) {
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] bool hasParallelJobs() const noexcept {
+        for (const auto& worker : workers) {
+            if (!worker->deque.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void runParallelJob(Task* job, ThreadId thread_id) {
+        // level is closed and the job is counted as done even if it throws
+        struct LevelScope {
+            ThreadBatches& thread_batches;
+            CompletionCounter* counter;
+            ~LevelScope() {
+                --thread_batches.depth;
+                counter->done();
+            }
+        } level_scope{threadBatches(), static_cast<CompletionCounter*>(job->batch_)};
+        ++level_scope.thread_batches.depth;
+        {
+            MUSTACHE_PROFILER_BLOCK_LVL_3("Run task");
+            job->run(thread_id);
+        }
+        // tasks spawned by the job are joined before the level is reused
+        if (!level_scope.thread_batches.currentFinished()) {
+            waitParallel();
+        }
+    }
+
+    /// returns false if there was nothing to run
+    bool runExtraJob(ThreadId thread_id) {
+        if (extra_jobs.load(std::memory_order_acquire) < 1u) {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock{ mutex };
+        auto queue = findQueue();
+        if (!queue) {
+            return false;
+        }
+        auto job = std::move(queue->front());
+        queue->pop();
+        queue->onTaskBegin();
+        extra_jobs.fetch_sub(1u, std::memory_order_relaxed);
+        lock.unlock();
+        {
+            MUSTACHE_PROFILER_BLOCK_LVL_3("Run task");
+            job(thread_id);
+        }
+        lock.lock();
+        queue->onTaskEnd();
+        queue_unlocked.notify_all();
+        return true;
+    }
+
+    void sleep() {
+        MUSTACHE_PROFILER_BLOCK_LVL_3("Wait for job");
+        std::unique_lock<std::mutex> lock{ mutex };
+        threads_waiting.fetch_add(1u, std::memory_order_seq_cst);
+        while (!terminate && !hasParallelJobs() && !findQueue()) {
+            jobs_available.wait(lock);
+        }
+        threads_waiting.fetch_sub(1u, std::memory_order_relaxed);
+    }
 
     void threadTask(ThreadId thread_id) noexcept {
         [[maybe_unused]] const std::string thread_name = "Worker: " + std::to_string(thread_id.toInt());
         MUSTACHE_PROFILER_THREAD(thread_name.c_str());
 
         g_thread_id = thread_id;
-        JobQueue* queue = nullptr;
+        g_thread_dispatcher = this;
+        const auto self = thread_id.toInt();
+        uint32_t attempts = 0u;
         while (!terminate) {
-            std::unique_lock<std::mutex> lock{ mutex };
-#if !DOUBLE_LOCK
-            if(queue) {
-                queue->onTaskEnd();
+            if (auto job = takeParallelJob(self)) {
+                runParallelJob(job, thread_id);
+                attempts = 0u;
+                continue;
             }
-#endif
-            queue = findQueue();
-            {
-                MUSTACHE_PROFILER_BLOCK_LVL_3("Wait for job");
-                while (!terminate && !queue) {
-                    ++threads_waiting;
-                    {
-                        jobs_available.wait(lock);
-                    }
-                    --threads_waiting;
-                    queue = findQueue();
-                }
+            if (runExtraJob(thread_id)) {
+                attempts = 0u;
+                continue;
             }
-            if (terminate) {
-                break;
+            if (++attempts < kStealAttemptsBeforeSleep) {
+                std::this_thread::yield();
+                continue;
             }
+            attempts = 0u;
+            sleep();
+        }
+    }
 
-            auto job = std::move(queue->front());
-            queue->pop();
-            queue->onTaskBegin();
-            lock.unlock();
-            {
-                MUSTACHE_PROFILER_BLOCK_LVL_3("Run task");
-                job(thread_id);
+    /**
+     * Helps with any parallel job while there is one, then waits only for jobs of the current thread batch.
+     * Jobs run while helping open nested levels, so waiting inside of a job does not wait for the outer batch.
+     */
+    void waitParallel() {
+        MUSTACHE_PROFILER_BLOCK_LVL_3("Wait parallel jobs");
+        auto& counter = currentBatch().counter;
+        const auto thread_id = currentThreadId();
+        while (!counter.finished()) {
+            if (auto job = takeParallelJob(thread_id.toInt())) {
+                runParallelJob(job, thread_id);
+            } else {
+                counter.wait();
             }
-#if DOUBLE_LOCK
-            lock.lock();
-            queue->onTaskEnd();
-#endif
         }
     }
 
@@ -166,6 +484,7 @@ struct Dispatcher::Data {
 
             queue.pop();
             queue.onTaskBegin();
+            extra_jobs.fetch_sub(1u, std::memory_order_relaxed);
             lock.unlock();
             {
                 MUSTACHE_PROFILER_BLOCK_LVL_3("Run task");
@@ -176,15 +495,20 @@ struct Dispatcher::Data {
         }
         {
             MUSTACHE_PROFILER_BLOCK_LVL_3("Wait other threads");
-            if (queue.state == JobState::kParallelQueue) {
-                const auto num_threads = threads.size();
-                while (threads_waiting != num_threads) {
-                    std::this_thread::yield();
-                }
-            } else {
-                while (queue.isLocked()) {
-                    std::this_thread::yield();
-                }
+            std::unique_lock<std::mutex> lock{mutex};
+            queue_unlocked.wait(lock, [&queue] {
+                return !queue.isLocked();
+            });
+        }
+    }
+
+    void clearParallelJobs() noexcept {
+        Task* job = nullptr;
+        for (auto& worker : workers) {
+            while (worker->deque.steal(job)) {
+                auto counter = static_cast<CompletionCounter*>(job->batch_);
+                job->discard();
+                counter->done();
             }
         }
     }
@@ -198,12 +522,20 @@ Dispatcher::Dispatcher(uint32_t thread_count):
         thread_count = maxThreadCount() - 1; // one core for main thread
     }
 
+    {
+        std::lock_guard<std::mutex> lock{g_dispatchers_mutex};
+        g_alive_dispatchers.insert(data_->generation);
+    }
+
+    data_->workers.reserve(thread_count + 1u);
+    for(uint32_t i = 0; i <= thread_count; ++i) {
+        data_->workers.emplace_back(std::make_unique<Data::Worker>());
+    }
     data_->threads.reserve(thread_count);
     for(uint32_t i = 0; i < thread_count; ++i) {
-        auto& thread = data_->threads.emplace_back([this, i]() noexcept {
-            data_->threadTask(ThreadId::make(i + 1));
+        data_->threads.emplace_back([data = data_.get(), i]() noexcept {
+            data->threadTask(ThreadId::make(i + 1));
         });
-        data_->thread_ids.insert(thread.get_id());
     }
 }
 
@@ -215,40 +547,60 @@ Dispatcher::~Dispatcher() {
     if(!data_) {
         return;
     }
-    data_->terminate = true;
+    {
+        std::lock_guard<std::mutex> lock{data_->mutex};
+        data_->terminate = true;
+    }
     clear();
     data_->jobs_available.notify_all();
     for (auto& thread : data_->threads)  {
         if (thread.joinable())
             thread.join();
     }
+    // batches of workers are released with their threads, other threads drop theirs on next lookup
+    {
+        std::lock_guard<std::mutex> lock{g_dispatchers_mutex};
+        g_alive_dispatchers.erase(data_->generation);
+    }
+    g_destroyed_dispatchers.fetch_add(1u, std::memory_order_release);
 }
 
 void Dispatcher::clear() noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_0(__FUNCTION__ );
-    // TODO: ?
-    std::lock_guard<std::mutex> lock { data_->mutex };
-    data_->parallel_jobs.clear();
+    data_->clearParallelJobs();
 }
 
 void Dispatcher::waitForParallelFinish() const noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
-    data_->wait(data_->parallel_jobs);
+    data_->waitParallel();
 }
 
-void Dispatcher::addJob(Job&& job) {
+Task* Dispatcher::allocateTasks(uint32_t count) {
     MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
-
     if(data_->single_thread_mode) {
-        MUSTACHE_PROFILER_BLOCK_LVL_3("Run task");
-        job(ThreadId::make(0));
+        return nullptr;
+    }
+    auto& batch = data_->currentBatch();
+    const bool reuse = batch.unpublished == 0u && batch.counter.finished();
+    batch.unpublished += count;
+    return batch.arena.allocate(count, reuse);
+}
+
+void Dispatcher::publishTasks(Task* tasks, uint32_t count) {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+    data_->push(tasks, count);
+}
+
+void Dispatcher::cancelTasks(Task* tasks, uint32_t count) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3(__FUNCTION__ );
+    if (tasks == nullptr) {
         return;
     }
-    {
-        std::unique_lock<std::mutex> lock{ data_->mutex };
-        data_->parallel_jobs.push(std::move(job));
+    for (uint32_t i = 0; i < count; ++i) {
+        tasks[i].discard();
     }
-    data_->jobs_available.notify_one();
+    auto& batch = data_->currentBatch();
+    batch.unpublished -= count < batch.unpublished ? count : batch.unpublished;
 }
 
 Queue Dispatcher::createQueue(const std::string& name, int32_t priority) {
@@ -271,6 +623,7 @@ void Dispatcher::async(QueueId queue_id, Job &&job) {
     {
         std::lock_guard<std::mutex> lock{data_->mutex};
         data_->extra.array[queue_id]->jobs.emplace(std::move(job));
+        data_->extra_jobs.fetch_add(1u, std::memory_order_release);
     }
     data_->jobs_available.notify_one();
 }
@@ -2,12 +2,18 @@
 
 #include <mustache/utils/uncopiable.hpp>
 #include <mustache/utils/index_like.hpp>
+#include <mustache/utils/invoke.hpp>
 
+#include <algorithm>
 #include <cstdint>
+#include <cstddef>
 #include <vector>
 #include <thread>
 #include <memory>
 #include <future>
+#include <new>
+#include <iterator>
+#include <type_traits>
 
 namespace mustache {
 
@@ -37,6 +43,77 @@ namespace mustache {
         QueueId id_{static_cast<QueueId>(-1)};
     };
 
+    /**
+     * Type-erased callable for parallel tasks: void() or void(ThreadId).
+     * Callables up to kInlineSize bytes are stored in place, larger ones are moved to heap.
+     */
+    class alignas(64) Task {
+    public:
+        static constexpr size_t kInlineSize = 96u;
+
+        Task() = default;
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        template<typename _F>
+        void assign(_F&& function) {
+            using Function = std::decay_t<_F>;
+            if constexpr (sizeof(Function) <= kInlineSize && alignof(Function) <= alignof(std::max_align_t)) {
+                new (storage_) Function(std::forward<_F>(function));
+                invoke_ = [](void* ptr, ThreadId thread_id) {
+                    call(*static_cast<Function*>(ptr), thread_id);
+                };
+                destroy_ = [](void* ptr) noexcept {
+                    static_cast<Function*>(ptr)->~Function();
+                };
+            } else {
+                *reinterpret_cast<Function**>(storage_) = new Function(std::forward<_F>(function));
+                invoke_ = [](void* ptr, ThreadId thread_id) {
+                    call(**static_cast<Function**>(ptr), thread_id);
+                };
+                destroy_ = [](void* ptr) noexcept {
+                    delete *static_cast<Function**>(ptr);
+                };
+            }
+        }
+
+        /// invokes and destroys the callable, callable is destroyed if it throws too
+        void run(ThreadId thread_id) {
+            struct DiscardOnExit {
+                Task& task;
+                ~DiscardOnExit() {
+                    task.discard();
+                }
+            } discard_on_exit{*this};
+            invoke_(storage_, thread_id);
+        }
+
+        /// destroys the callable without invoking, does nothing if there is no callable
+        void discard() noexcept {
+            if (destroy_ != nullptr) {
+                destroy_(storage_);
+                destroy_ = nullptr;
+                invoke_ = nullptr;
+            }
+        }
+
+        template<typename _F>
+        static void call(_F& function, ThreadId thread_id) {
+            if constexpr (std::is_invocable_v<_F&, ThreadId>) {
+                function(thread_id);
+            } else {
+                function();
+            }
+        }
+
+    private:
+        friend Dispatcher;
+        alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+        void (*invoke_)(void*, ThreadId) = nullptr;
+        void (*destroy_)(void*) noexcept = nullptr;
+        void* batch_ = nullptr;
+    };
+
     struct ParallelTaskId : public IndexLike<uint32_t , ParallelTaskId> {};
     struct ParallelTaskItemIndexInTask : public IndexLike<uint32_t , ParallelTaskItemIndexInTask> {};
     struct ParallelTaskGlobalItemIndex : public IndexLike<uint32_t , ParallelTaskGlobalItemIndex> {};
@@ -61,43 +138,125 @@ namespace mustache {
 
         void clear() noexcept;
 
-        // blocks calling thread until job queue is empty
+        // blocks calling thread until parallel tasks added by this thread are finished,
+        // runs queued tasks meanwhile, then spins for a short time and sleeps.
+        // Can be called from a parallel task: waits for tasks added by that task only.
         void waitForParallelFinish() const noexcept;
 
         template<typename _F>
         void parallelFor(_F&& function, size_t begin, size_t end, uint32_t task_count = 0u) {
             const size_t size = end - begin;
+            if (size < 1u) {
+                return;
+            }
             if (task_count < 1u) {
-                task_count = size < threadCount() ? static_cast<uint32_t>(size) : threadCount();
+                // without Dispatcher threads the only task is run by the calling thread while it waits
+                task_count = size < threadCount() ? static_cast<uint32_t>(size) : std::max(threadCount(), 1u);
             }
             const size_t ept = size / task_count;
             const size_t tasks_with_extra_item = size - task_count * ept;
 
-            size_t task_begin = begin;
-            for (uint32_t task = 0; task < task_count; ++task) {
-                const auto task_size = task < tasks_with_extra_item ? ept + 1 : ept;
-                const auto task_id = ParallelTaskId::make(task);
-                addParallelTask([task_id, &function, task_end = task_begin + task_size, task_begin]{
-                    for (size_t i = task_begin; i < task_end; ++i) {
-                        invoke(function, i, task_id);
+            auto tasks = allocateTasks(task_count);
+            try {
+                size_t task_begin = begin;
+                for (uint32_t task = 0; task < task_count; ++task) {
+                    const auto task_size = task < tasks_with_extra_item ? ept + 1 : ept;
+                    const auto task_id = ParallelTaskId::make(task);
+                    auto task_function = [task_id, &function, task_end = task_begin + task_size, task_begin]{
+                        for (size_t i = task_begin; i < task_end; ++i) {
+                            invoke(function, i, task_id);
+                        }
+                    };
+                    if (tasks != nullptr) {
+                        tasks[task].assign(std::move(task_function));
+                    } else {
+                        task_function();
                     }
-                });
 
-                task_begin += task_size;
+                    task_begin += task_size;
+                }
+            } catch (...) {
+                cancelTasks(tasks, task_count);
+                throw;
+            }
+            if (tasks != nullptr) {
+                publishTasks(tasks, task_count);
             }
             waitForParallelFinish();
         }
 
-        void addParallelTask(Job&& job) {
-            addJob(std::move(job));
+        /// function: void() or void(ThreadId), stored without allocation if it fits into Task::kInlineSize
+        template<typename _F>
+        void addParallelTask(_F&& function) {
+            if (auto task = allocateTasks(1u)) {
+                try {
+                    task->assign(std::forward<_F>(function));
+                } catch (...) {
+                    cancelTasks(task, 1u);
+                    throw;
+                }
+                publishTasks(task, 1u);
+            } else {
+                Task::call(function, ThreadId::make(0));
+            }
         }
 
-        void addParallelTask(std::function<void()>&& job) {
-            addParallelTask([no_arg_job_job = std::move(job)](ThreadId) {
-                no_arg_job_job();
-            });
+        /// enqueues copies of all callables in [begin, end) and wakes workers once
+        template<typename _It>
+        void addParallelTasks(_It begin, _It end) {
+            const auto count = static_cast<uint32_t>(std::distance(begin, end));
+            auto tasks = count > 0u ? allocateTasks(count) : nullptr;
+            try {
+                for (uint32_t i = 0; begin != end; ++begin, ++i) {
+                    if (tasks != nullptr) {
+                        tasks[i].assign(*begin);
+                    } else {
+                        Task::call(*begin, ThreadId::make(0));
+                    }
+                }
+            } catch (...) {
+                cancelTasks(tasks, count);
+                throw;
+            }
+            if (tasks != nullptr) {
+                publishTasks(tasks, count);
+            }
         }
 
+        /// enqueues task_count tasks calling function(ParallelTaskId, ThreadId), function must outlive the tasks
+        template<typename _F>
+        void addParallelTasks(uint32_t task_count, _F& function) {
+            auto tasks = task_count > 0u ? allocateTasks(task_count) : nullptr;
+            try {
+                for (uint32_t i = 0; i < task_count; ++i) {
+                    const auto task_id = ParallelTaskId::make(i);
+                    if (tasks != nullptr) {
+                        tasks[i].assign([&function, task_id](ThreadId thread_id) {
+                            invoke(function, task_id, thread_id);
+                        });
+                    } else {
+                        invoke(function, task_id, ThreadId::make(0));
+                    }
+                }
+            } catch (...) {
+                cancelTasks(tasks, task_count);
+                throw;
+            }
+            if (tasks != nullptr) {
+                publishTasks(tasks, task_count);
+            }
+        }
+
+        /**
+         * Low level batch submission: returns count tasks from arena of the calling thread,
+         * or nullptr in single thread mode (callables must be invoked in place then).
+         * Every task must be assigned before publishTasks. Arena is reused after waitForParallelFinish.
+         */
+        [[nodiscard]] Task* allocateTasks(uint32_t count);
+        void publishTasks(Task* tasks, uint32_t count);
+        /// gives back allocated tasks which will not be published (e.g. assign has thrown), callables are destroyed
+        void cancelTasks(Task* tasks, uint32_t count) noexcept;
+
         Queue createQueue(const std::string& name, int32_t priority = CommonQueuePriority::kDefault);
 
         void async(uint32_t queue_id, Job&& job);
@@ -115,7 +274,6 @@ namespace mustache {
         // 1..threadCount for Dispatcher threads.
         [[nodiscard]] ThreadId currentThreadId() const noexcept;
     private:
-        void addJob(Job&& job);
         struct Data;
         std::unique_ptr<Data> data_;
     };
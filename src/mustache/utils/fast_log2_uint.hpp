@@ -25,4 +25,9 @@ namespace mustache {
     MUSTACHE_INLINE constexpr uint32_t fastLog2_2(uint32_t value) noexcept {
         return value == 0u ? 0u : static_cast<uint32_t>(31 - __builtin_clz(value));
     }
+
+    /// value must be non zero
+    MUSTACHE_INLINE constexpr uint32_t countTrailingZeros(uint64_t value) noexcept {
+        return static_cast<uint32_t>(__builtin_ctzll(value));
+    }
 }
@@ -3,6 +3,11 @@
 #include <mustache/utils/profiler.hpp>
 
 #include <map>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include <cstdlib>
 #include <cstring>
 #ifdef __APPLE__
@@ -10,6 +15,13 @@
 #else
 #include <malloc.h>
 #endif
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define MEMORY_MANAGER_HAS_MADVISE 1
+#else
+#define MEMORY_MANAGER_HAS_MADVISE 0
+#endif
 
 #if MEMORY_MANAGER_COLLECT_STATISTICS
 #define MEMORY_MANAGER_STATISTICS_ARG_DECL , const char* file, uint32_t line
@@ -22,6 +34,254 @@ namespace {
 #define MEMORY_MANAGER_STATISTICS_ARG_DECL
 #endif
 
+namespace {
+    using mustache::MemoryManager;
+
+    constexpr uint32_t kThreadCacheSize = 4u; // blocks of every cached size class
+    constexpr size_t kMaxThreadCacheBlockSize = 64u * 1024u; // larger blocks go to shared pool at once
+
+    // changed by flushThreadCache, other threads flush their caches on their next chunk operation
+    std::atomic<uint64_t> g_thread_cache_epoch{0u};
+    constexpr size_t kDefaultChunkPoolLimit = 16u * 1024u * 1024u;
+
+    /// page multiples, up to 4 classes per power of two, so a block wastes at most 20% above 16KB
+    constexpr std::array<size_t, MemoryManager::kChunkClassCount> makeChunkClassSizes() noexcept {
+        std::array<size_t, MemoryManager::kChunkClassCount> result{};
+        uint32_t count = 0u;
+        for (size_t octave = MemoryManager::kMinChunkClassSize; count < result.size(); octave *= 2u) {
+            for (size_t step = 0u; step < 4u && count < result.size(); ++step) {
+                const auto size = octave + step * (octave / 4u);
+                if (size % MemoryManager::kMinChunkClassSize == 0u) {
+                    result[count++] = size;
+                }
+            }
+        }
+        return result;
+    }
+    constexpr auto kChunkClassSizes = makeChunkClassSizes();
+    static_assert(kChunkClassSizes.back() == 8u * 1024u * 1024u, "the largest class must be 8MB");
+
+    /// kChunkClassCount for blocks larger than the largest class
+    uint32_t chunkClass(size_t size) noexcept {
+        const auto it = std::lower_bound(kChunkClassSizes.begin(), kChunkClassSizes.end(), size);
+        return static_cast<uint32_t>(it - kChunkClassSizes.begin());
+    }
+
+    void* allocateBlock(size_t size, size_t align) noexcept {
+#ifdef _MSC_BUILD
+        return _aligned_malloc(size, align);
+#elif defined(ANDROID)
+        return memalign(align, size);
+#else
+        return aligned_alloc(align, size);
+#endif
+    }
+
+    void freeBlock(void* ptr) noexcept {
+#ifdef _MSC_BUILD
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+
+    // blocks are not bound to MemoryManager, so the cache is shared by all managers used by the thread
+    struct ThreadChunkCache {
+        ~ThreadChunkCache() {
+            for (uint32_t i = 0; i < MemoryManager::kChunkClassCount; ++i) {
+                for (uint32_t j = 0; j < counts[i]; ++j) {
+                    freeBlock(blocks[i][j]);
+                }
+            }
+        }
+        std::array<std::array<void*, kThreadCacheSize>, MemoryManager::kChunkClassCount> blocks{};
+        std::array<uint32_t, MemoryManager::kChunkClassCount> counts{};
+        uint64_t epoch = 0u;
+    };
+    thread_local ThreadChunkCache thread_chunk_cache;
+}
+
+struct mustache::MemoryManager::ChunkPool {
+    struct Arena {
+        void* mapping = nullptr;
+        size_t mapping_size = 0u;
+        uintptr_t begin = 0u;
+        uintptr_t end = 0u;
+        uintptr_t used = 0u;
+    };
+
+    ~ChunkPool() {
+        release();
+        for (const auto& arena : arenas) {
+            unmapArena(arena);
+        }
+    }
+    void release() noexcept {
+        std::lock_guard<std::mutex> lock{mutex};
+        for (uint32_t i = 0; i < kChunkClassCount; ++i) {
+            auto& class_blocks = blocks[i];
+            const auto class_size = kChunkClassSizes[i];
+            auto last = class_blocks.begin();
+            for (auto ptr : class_blocks) {
+                if (ownsBlock(ptr)) {
+                    // arena blocks can not be freed, only their pages are returned to the system
+                    decommitBlock(ptr, class_size);
+                    *last++ = ptr;
+                } else {
+                    freeBlock(ptr);
+                    pooled_bytes -= class_size;
+                }
+            }
+            class_blocks.erase(last, class_blocks.end());
+        }
+    }
+
+    /// cache of the calling thread, flushed first if flushThreadCache was called since its last use
+    ThreadChunkCache& threadCache() noexcept {
+        auto& cache = thread_chunk_cache;
+        const auto epoch = g_thread_cache_epoch.load(std::memory_order_relaxed);
+        if (cache.epoch != epoch) {
+            cache.epoch = epoch;
+            adopt(cache);
+        }
+        return cache;
+    }
+
+    /// moves blocks of thread cache to the pool, blocks over the limit are freed
+    void adopt(ThreadChunkCache& cache) noexcept {
+        // arena pool keeps only its own blocks
+        const auto keep = !useArena();
+        std::lock_guard<std::mutex> lock{mutex};
+        for (uint32_t i = 0; i < kChunkClassCount; ++i) {
+            const auto class_size = kChunkClassSizes[i];
+            auto& class_blocks = blocks[i];
+            for (uint32_t j = 0; j < cache.counts[i]; ++j) {
+                if (keep && (class_blocks.size() + 1u) * class_size <= limit) {
+                    class_blocks.push_back(cache.blocks[i][j]);
+                    pooled_bytes += class_size;
+                } else {
+                    freeBlock(cache.blocks[i][j]);
+                }
+            }
+            cache.counts[i] = 0u;
+        }
+    }
+
+    [[nodiscard]] bool useArena() const noexcept {
+        return backend != ChunkBackend::kMalloc;
+    }
+
+    [[nodiscard]] bool ownsBlock(void* ptr) const noexcept {
+        const auto address = reinterpret_cast<uintptr_t>(ptr);
+        for (const auto& arena : arenas) {
+            if (address >= arena.begin && address < arena.end) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// mutex must be locked, returns nullptr if memory can not be mapped
+    void* carve(size_t size, size_t align) noexcept {
+        if (!arenas.empty()) {
+            auto& arena = arenas.back();
+            const auto begin = (arena.used + align - 1u) & ~(align - 1u);
+            if (begin + size <= arena.end) {
+                arena.used = begin + size;
+                return reinterpret_cast<void*>(begin);
+            }
+        }
+        if (!mapArena(size > arena_size ? size : arena_size)) {
+            return nullptr;
+        }
+        auto& arena = arenas.back();
+        arena.used = arena.begin + size;
+        return reinterpret_cast<void*>(arena.begin);
+    }
+
+    bool mapArena(size_t size) noexcept {
+#ifdef __linux__
+        size = (size + kHugePageSize - 1u) & ~(kHugePageSize - 1u);
+        Arena arena;
+        if (backend == ChunkBackend::kHugeTlb) {
+            // no MAP_NORESERVE: huge pages must be reserved up front, otherwise page fault raises SIGBUS
+            auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (ptr != MAP_FAILED) {
+                arena.mapping = ptr;
+                arena.mapping_size = size;
+                arena.begin = reinterpret_cast<uintptr_t>(ptr);
+            } else {
+                Logger{}.warn("MAP_HUGETLB failed for %zu bytes, transparent huge pages are used instead", size);
+                backend = ChunkBackend::kMmap;
+            }
+        }
+        if (arena.mapping == nullptr) {
+            // extra huge page to align the arena, so THP can back it from the very beginning
+            const auto mapping_size = size + kHugePageSize;
+            auto ptr = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (ptr == MAP_FAILED) {
+                Logger{}.error("Can not reserve arena of %zu bytes", size);
+                return false;
+            }
+            arena.mapping = ptr;
+            arena.mapping_size = mapping_size;
+            arena.begin = (reinterpret_cast<uintptr_t>(ptr) + kHugePageSize - 1u) & ~(kHugePageSize - 1u);
+            madvise(reinterpret_cast<void*>(arena.begin), size, MADV_HUGEPAGE);
+        }
+        arena.end = arena.begin + size;
+        arena.used = arena.begin;
+        arenas.push_back(arena);
+        arena_bytes += arena.mapping_size;
+        return true;
+#else
+        (void) size;
+        return false;
+#endif
+    }
+
+    void unmapArena(const Arena& arena) noexcept {
+#ifdef __linux__
+        munmap(arena.mapping, arena.mapping_size);
+#else
+        (void) arena;
+#endif
+    }
+
+    void decommitBlock(void* ptr, size_t size) noexcept {
+#ifdef __linux__
+        if (backend != ChunkBackend::kHugeTlb) {
+            madvise(ptr, size, MADV_DONTNEED);
+        }
+#else
+        (void) ptr;
+        (void) size;
+#endif
+    }
+
+    static constexpr size_t kHugePageSize = 2u * 1024u * 1024u;
+
+    mutable std::mutex mutex;
+    std::array<std::vector<void*>, kChunkClassCount> blocks;
+    std::vector<Arena> arenas;
+    ChunkBackend backend = ChunkBackend::kMalloc;
+    size_t arena_size = kDefaultArenaSize;
+    size_t arena_bytes = 0u;
+    size_t limit = kDefaultChunkPoolLimit;
+    size_t pooled_bytes = 0u;
+    std::atomic<size_t> chunk_bytes{0u};
+    std::atomic<uint64_t> hits{0u};
+    std::atomic<uint64_t> misses{0u};
+};
+
+mustache::MemoryManager::MemoryManager(ChunkBackend backend, size_t arena_size):
+        chunk_pool_{std::make_unique<ChunkPool>()} {
+    chunk_pool_->backend = backend;
+    chunk_pool_->arena_size = arena_size;
+}
+
+mustache::MemoryManager::~MemoryManager() = default;
+
 void* mustache::MemoryManager::allocate(size_t size, size_t align MEMORY_MANAGER_STATISTICS_ARG_DECL) noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3("MemoryManager::allocate");
 #ifdef _MSC_BUILD
@@ -76,6 +336,166 @@ void mustache::MemoryManager::deallocate(void* ptr MEMORY_MANAGER_STATISTICS_ARG
     }
 }
 
+bool mustache::MemoryManager::decommit(void* ptr, size_t size) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3("MemoryManager::decommit");
+#if MEMORY_MANAGER_HAS_MADVISE
+    if (ptr == nullptr || decommit_min_size_ == 0u || size < decommit_min_size_) {
+        return false;
+    }
+    // only whole pages inside of the block can be released
+    static const auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const auto begin = (reinterpret_cast<uintptr_t>(ptr) + page_size - 1u) & ~(page_size - 1u);
+    const auto end = (reinterpret_cast<uintptr_t>(ptr) + size) & ~(page_size - 1u);
+    if (end > begin) {
+        return madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED) == 0;
+    }
+    return true;
+#else
+    (void) ptr;
+    (void) size;
+    return false;
+#endif
+}
+
+size_t mustache::MemoryManager::chunkBlockSize(size_t size) noexcept {
+    const auto chunk_class = chunkClass(size);
+    return chunk_class < kChunkClassCount ? kChunkClassSizes[chunk_class] : size;
+}
+
+void* mustache::MemoryManager::allocateChunk(size_t size, size_t align) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3("MemoryManager::allocateChunk");
+    chunk_pool_->chunk_bytes.fetch_add(chunkBlockSize(size), std::memory_order_relaxed);
+    const auto chunk_class = chunkClass(size);
+    if (chunk_class >= kChunkClassCount) {
+        return allocate(size, align);
+    }
+    const auto use_arena = chunk_pool_->useArena();
+    const auto class_size = kChunkClassSizes[chunk_class];
+    const auto block_align = align < kChunkAlign ? kChunkAlign : align;
+    if (align <= kChunkAlign) {
+        // arena blocks must not outlive the manager, so they bypass the thread cache
+        if (!use_arena && class_size <= kMaxThreadCacheBlockSize) {
+            auto& cache = chunk_pool_->threadCache();
+            if (cache.counts[chunk_class] > 0u) {
+                chunk_pool_->hits.fetch_add(1u, std::memory_order_relaxed);
+                return cache.blocks[chunk_class][--cache.counts[chunk_class]];
+            }
+        }
+        std::lock_guard<std::mutex> lock{chunk_pool_->mutex};
+        auto& pooled = chunk_pool_->blocks[chunk_class];
+        if (!pooled.empty()) {
+            auto ptr = pooled.back();
+            pooled.pop_back();
+            chunk_pool_->pooled_bytes -= class_size;
+            chunk_pool_->hits.fetch_add(1u, std::memory_order_relaxed);
+            return ptr;
+        }
+    }
+    chunk_pool_->misses.fetch_add(1u, std::memory_order_relaxed);
+    if (use_arena) {
+        std::lock_guard<std::mutex> lock{chunk_pool_->mutex};
+        if (auto ptr = chunk_pool_->carve(class_size, block_align)) {
+            return ptr;
+        }
+    }
+    return allocateBlock(class_size, block_align);
+}
+
+void mustache::MemoryManager::deallocateChunk(void* ptr, size_t size) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3("MemoryManager::deallocateChunk");
+    if (ptr == nullptr) {
+        return;
+    }
+    chunk_pool_->chunk_bytes.fetch_sub(chunkBlockSize(size), std::memory_order_relaxed);
+    const auto chunk_class = chunkClass(size);
+    if (chunk_class >= kChunkClassCount) {
+        deallocate(ptr);
+        return;
+    }
+    const auto class_size = kChunkClassSizes[chunk_class];
+    if (chunk_pool_->useArena()) {
+        // arena blocks can not be freed, so pool limit is ignored for them
+        std::lock_guard<std::mutex> lock{chunk_pool_->mutex};
+        if (chunk_pool_->ownsBlock(ptr)) {
+            chunk_pool_->blocks[chunk_class].push_back(ptr);
+            chunk_pool_->pooled_bytes += class_size;
+            return;
+        }
+    }
+    if (class_size <= kMaxThreadCacheBlockSize) {
+        auto& cache = chunk_pool_->threadCache();
+        if (cache.counts[chunk_class] < kThreadCacheSize) {
+            cache.blocks[chunk_class][cache.counts[chunk_class]++] = ptr;
+            return;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock{chunk_pool_->mutex};
+        auto& pooled = chunk_pool_->blocks[chunk_class];
+        if ((pooled.size() + 1u) * class_size <= chunk_pool_->limit) {
+            pooled.push_back(ptr);
+            chunk_pool_->pooled_bytes += class_size;
+            return;
+        }
+    }
+    freeBlock(ptr);
+}
+
+void mustache::MemoryManager::reserveChunks(size_t size, uint32_t count) noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3("MemoryManager::reserveChunks");
+    const auto chunk_class = chunkClass(size);
+    if (chunk_class >= kChunkClassCount) {
+        return;
+    }
+    const auto class_size = kChunkClassSizes[chunk_class];
+    std::lock_guard<std::mutex> lock{chunk_pool_->mutex};
+    auto& pooled = chunk_pool_->blocks[chunk_class];
+    for (uint32_t i = 0; i < count; ++i) {
+        void* ptr = chunk_pool_->useArena() ? chunk_pool_->carve(class_size, kChunkAlign) : nullptr;
+        if (ptr == nullptr) {
+            ptr = allocateBlock(class_size, kChunkAlign);
+        }
+        if (ptr == nullptr) {
+            return;
+        }
+        pooled.push_back(ptr);
+        chunk_pool_->pooled_bytes += class_size;
+    }
+}
+
+void mustache::MemoryManager::setChunkPoolLimit(size_t bytes_per_class) noexcept {
+    std::lock_guard<std::mutex> lock{chunk_pool_->mutex};
+    chunk_pool_->limit = bytes_per_class;
+}
+
+void mustache::MemoryManager::flushThreadCache() noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3("MemoryManager::flushThreadCache");
+    g_thread_cache_epoch.fetch_add(1u, std::memory_order_relaxed);
+    chunk_pool_->threadCache();
+}
+
+void mustache::MemoryManager::releaseChunkPool() noexcept {
+    MUSTACHE_PROFILER_BLOCK_LVL_3("MemoryManager::releaseChunkPool");
+    flushThreadCache();
+    chunk_pool_->release();
+}
+
+mustache::MemoryManager::ChunkPoolStatistics mustache::MemoryManager::chunkPoolStatistics() const noexcept {
+    ChunkPoolStatistics result;
+    result.hits = chunk_pool_->hits.load(std::memory_order_relaxed);
+    result.misses = chunk_pool_->misses.load(std::memory_order_relaxed);
+    result.chunk_bytes = chunk_pool_->chunk_bytes.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock{chunk_pool_->mutex};
+    result.pooled_bytes = chunk_pool_->pooled_bytes;
+    result.arena_bytes = chunk_pool_->arena_bytes;
+    return result;
+}
+
+mustache::MemoryManager::ChunkBackend mustache::MemoryManager::chunkBackend() const noexcept {
+    std::lock_guard<std::mutex> lock{chunk_pool_->mutex};
+    return chunk_pool_->backend;
+}
+
 void mustache::MemoryManager::showStatistic() const noexcept {
     MUSTACHE_PROFILER_BLOCK_LVL_3("MemoryManager::showStatistic");
 #if MEMORY_MANAGER_COLLECT_STATISTICS
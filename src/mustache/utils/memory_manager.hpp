@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <mustache/utils/uncopiable.hpp>
 #include <mustache/utils/default_settings.hpp>
 
@@ -19,10 +21,79 @@ class Allocator;
 #endif
 class MUSTACHE_EXPORT MemoryManager : mustache::Uncopiable {
     public:
+        struct ChunkPoolStatistics {
+            uint64_t hits = 0u; // chunks taken from thread cache or shared pool
+            uint64_t misses = 0u; // chunks allocated by system allocator or carved from arena
+            size_t pooled_bytes = 0u; // bytes in shared pool, thread caches are not counted
+            size_t chunk_bytes = 0u; // bytes of blocks reserved for chunks in use
+            size_t arena_bytes = 0u; // virtual memory reserved by arenas
+        };
+
+        /// where chunks come from
+        enum class ChunkBackend : uint32_t {
+            kMalloc, // aligned_alloc
+            kMmap, // large mmap ranges with transparent huge pages (MADV_HUGEPAGE)
+            kHugeTlb, // mmap with MAP_HUGETLB, falls back to kMmap if there are no reserved huge pages
+        };
+
+        static constexpr size_t kChunkAlign = 64u;
+        static constexpr size_t kMinChunkClassSize = 4096u;
+        static constexpr uint32_t kChunkClassCount = 40u; // page multiples from 4KB to 8MB, up to 4 per power of two
+        static constexpr size_t kDefaultArenaSize = 1024u * 1024u * 1024u;
+
+        /**
+         * Arena backends reserve arena_size bytes of virtual memory at once and carve chunks from it,
+         * free chunks of arenas are kept in shared pool only and memory is unmapped by destructor.
+         * Backend is selected per World by WorldContext::memory_manager. Arenas are supported on Linux only.
+         */
+        explicit MemoryManager(ChunkBackend backend = ChunkBackend::kMalloc, size_t arena_size = kDefaultArenaSize);
+        ~MemoryManager();
+
         void* allocate(size_t size, size_t align = 0 MEMORY_MANAGER_STATISTICS_ARG_DECL) noexcept;
         void* allocateAndClear(size_t size, size_t align = 0) noexcept;
         void deallocate(void* ptr MEMORY_MANAGER_STATISTICS_ARG_DECL) noexcept;
         void showStatistic() const noexcept;
+
+        /**
+         * Returns physical pages of unused block to the system, block stays allocated and can be reused.
+         * Returns false if block is smaller than decommit size or decommit is not supported, block must be freed then.
+         */
+        bool decommit(void* ptr, size_t size) noexcept;
+
+        /// min size of block to decommit instead of free, 0 disables decommit
+        void setDecommitSize(size_t min_size) noexcept {
+            decommit_min_size_ = min_size;
+        }
+
+        /// bytes reserved for chunk of size: size rounded up to size class, size itself if larger than 8MB
+        [[nodiscard]] static size_t chunkBlockSize(size_t size) noexcept;
+
+        /**
+         * Block for storage chunk, size is rounded up to size class (see chunkBlockSize).
+         * Free blocks up to 64KB are cached per thread first (4 per class), others go to pool shared by all archetypes.
+         * Must be returned by deallocateChunk with the same size.
+         */
+        void* allocateChunk(size_t size, size_t align = kChunkAlign) noexcept;
+        void deallocateChunk(void* ptr, size_t size) noexcept;
+
+        /// allocates count chunks of size into shared pool, so following allocations do not call system allocator
+        void reserveChunks(size_t size, uint32_t count) noexcept;
+
+        /// max bytes of every size class in shared pool, blocks over the limit are freed
+        void setChunkPoolLimit(size_t bytes_per_class) noexcept;
+
+        /**
+         * Moves blocks cached by the calling thread to shared pool, blocks over the pool limit are freed.
+         * Caches of other threads are flushed lazily, by their next allocateChunk or deallocateChunk.
+         */
+        void flushThreadCache() noexcept;
+
+        /// flushes cache of the calling thread and frees all blocks of shared pool
+        void releaseChunkPool() noexcept;
+
+        [[nodiscard]] ChunkPoolStatistics chunkPoolStatistics() const noexcept;
+
+        [[nodiscard]] ChunkBackend chunkBackend() const noexcept;
     template<typename T>
     Allocator<T> allocator() {
         return Allocator<T>{*this};
@@ -34,6 +105,10 @@ class MUSTACHE_EXPORT MemoryManager : mustache::Uncopiable {
     }
 
     private:
+        struct ChunkPool;
+
+        size_t decommit_min_size_ = 0u;
+        std::unique_ptr<ChunkPool> chunk_pool_;
     };
 
     template<typename T>
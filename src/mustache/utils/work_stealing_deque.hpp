@@ -0,0 +1,131 @@
+#pragma once
+
+#include <mustache/utils/uncopiable.hpp>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+namespace mustache {
+
+    /**
+     * Chase-Lev work-stealing deque (Le, Pop, Cohen, Nardelli: "Correct and Efficient Work-Stealing for Weak Memory Models").
+     * Owner thread pushes and pops at the bottom, any other thread steals from the top.
+     * push/pop must not be called concurrently, steal can be called from any thread.
+     */
+    template<typename T>
+    class WorkStealingDeque : public Uncopiable {
+    public:
+        static_assert(std::is_trivially_copyable_v<T>, "Items must be trivially copyable, pointer is expected");
+
+        explicit WorkStealingDeque(uint32_t capacity = 256u):
+                buffer_{new Buffer{capacity < 2u ? 2u : capacity}} {
+            buffers_.emplace_back(buffer_.load(std::memory_order_relaxed));
+        }
+
+        void push(T item) {
+            const auto bottom = bottom_.load(std::memory_order_relaxed);
+            const auto top = top_.load(std::memory_order_acquire);
+            auto buffer = buffer_.load(std::memory_order_relaxed);
+            if (bottom - top > buffer->capacity() - 1) {
+                buffer = grow(buffer, top, bottom);
+            }
+            buffer->put(bottom, item);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+
+        /// returns false if deque is empty or the last item was stolen
+        bool pop(T& item) noexcept {
+            const auto bottom = bottom_.load(std::memory_order_relaxed) - 1;
+            auto buffer = buffer_.load(std::memory_order_relaxed);
+            bottom_.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto top = top_.load(std::memory_order_relaxed);
+            if (top > bottom) {
+                bottom_.store(bottom + 1, std::memory_order_relaxed);
+                return false;
+            }
+            item = buffer->get(bottom);
+            if (top == bottom) {
+                // the last item, race with thieves
+                const bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                              std::memory_order_relaxed);
+                bottom_.store(bottom + 1, std::memory_order_relaxed);
+                return won;
+            }
+            return true;
+        }
+
+        /// returns false if deque is empty or other thread took the item
+        bool steal(T& item) noexcept {
+            auto top = top_.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const auto bottom = bottom_.load(std::memory_order_acquire);
+            if (top >= bottom) {
+                return false;
+            }
+            item = buffer_.load(std::memory_order_acquire)->get(top);
+            return top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            const auto top = top_.load(std::memory_order_seq_cst);
+            const auto bottom = bottom_.load(std::memory_order_seq_cst);
+            return top >= bottom;
+        }
+
+        [[nodiscard]] uint32_t size() const noexcept {
+            const auto top = top_.load(std::memory_order_seq_cst);
+            const auto bottom = bottom_.load(std::memory_order_seq_cst);
+            return bottom > top ? static_cast<uint32_t>(bottom - top) : 0u;
+        }
+
+    private:
+        class Buffer {
+        public:
+            explicit Buffer(uint32_t capacity):
+                    mask_{static_cast<int64_t>(roundUp(capacity)) - 1},
+                    items_{new std::atomic<T>[static_cast<size_t>(mask_ + 1)]} {
+
+            }
+            [[nodiscard]] int64_t capacity() const noexcept {
+                return mask_ + 1;
+            }
+            void put(int64_t index, T item) noexcept {
+                items_[static_cast<size_t>(index & mask_)].store(item, std::memory_order_relaxed);
+            }
+            [[nodiscard]] T get(int64_t index) const noexcept {
+                return items_[static_cast<size_t>(index & mask_)].load(std::memory_order_relaxed);
+            }
+        private:
+            static uint32_t roundUp(uint32_t value) noexcept {
+                uint32_t result = 1u;
+                while (result < value) {
+                    result <<= 1u;
+                }
+                return result;
+            }
+            int64_t mask_;
+            std::unique_ptr<std::atomic<T>[]> items_;
+        };
+
+        Buffer* grow(Buffer* buffer, int64_t top, int64_t bottom) {
+            auto result = new Buffer{static_cast<uint32_t>(buffer->capacity() * 2)};
+            for (auto i = top; i < bottom; ++i) {
+                result->put(i, buffer->get(i));
+            }
+            // thieves may still read the old buffer, so it is kept until the deque is destroyed
+            buffers_.emplace_back(result);
+            buffer_.store(result, std::memory_order_release);
+            return result;
+        }
+
+        alignas(64) std::atomic<int64_t> top_{0};
+        alignas(64) std::atomic<int64_t> bottom_{0};
+        std::atomic<Buffer*> buffer_;
+        std::vector<std::unique_ptr<Buffer> > buffers_;
+    };
+}
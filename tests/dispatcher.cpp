@@ -1,5 +1,13 @@
 #include <gtest/gtest.h>
 #include <mustache/utils/dispatch.hpp>
+#include <mustache/utils/work_stealing_deque.hpp>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 TEST(Dispatcher, currentThreadId) {
     using namespace mustache;
@@ -29,3 +37,248 @@ TEST(Dispatcher, currentThreadId) {
         dispatcher1.waitForParallelFinish();
     }
 }
+
+TEST(Dispatcher, work_stealing_deque) {
+    using namespace mustache;
+    constexpr uint32_t kItemCount = 200000u;
+    constexpr uint32_t kThiefCount = 3u;
+    WorkStealingDeque<uint32_t*> deque{4u}; // small capacity to test growing
+    std::vector<uint32_t> items(kItemCount, 0u);
+    std::vector<std::atomic<uint32_t> > taken(kItemCount);
+    std::atomic<bool> done{false};
+    std::vector<std::thread> thieves;
+    for (uint32_t i = 0; i < kThiefCount; ++i) {
+        thieves.emplace_back([&] {
+            uint32_t* item = nullptr;
+            while (!done || !deque.empty()) {
+                if (deque.steal(item)) {
+                    taken[static_cast<size_t>(item - items.data())].fetch_add(1u);
+                }
+            }
+        });
+    }
+    uint32_t* item = nullptr;
+    for (uint32_t i = 0; i < kItemCount; ++i) {
+        deque.push(&items[i]);
+        if (i % 3u == 0u && deque.pop(item)) {
+            taken[static_cast<size_t>(item - items.data())].fetch_add(1u);
+        }
+    }
+    while (deque.pop(item)) {
+        taken[static_cast<size_t>(item - items.data())].fetch_add(1u);
+    }
+    done = true;
+    for (auto& thread : thieves) {
+        thread.join();
+    }
+    for (const auto& count : taken) {
+        ASSERT_EQ(count.load(), 1u);
+    }
+}
+
+TEST(Dispatcher, parallel_jobs_and_queues) {
+    using namespace mustache;
+    Dispatcher dispatcher{4u};
+    auto queue = dispatcher.createQueue("serial");
+    std::atomic<uint32_t> running{0u};
+    std::atomic<uint32_t> serial_count{0u};
+    for (uint32_t i = 0; i < 1000u; ++i) {
+        queue.async([&running, &serial_count](ThreadId) {
+            // jobs of a queue never run concurrently
+            ASSERT_EQ(running.fetch_add(1u), 0u);
+            ++serial_count;
+            running.fetch_sub(1u);
+        });
+    }
+    std::atomic<uint64_t> sum{0u};
+    for (uint32_t iteration = 0; iteration < 100u; ++iteration) {
+        dispatcher.parallelFor([&sum](size_t index, ParallelTaskId) {
+            sum += index;
+        }, 0u, 1000u, 16u);
+    }
+    ASSERT_EQ(sum.load(), 100u * 999u * 1000u / 2u);
+    queue.wait();
+    ASSERT_EQ(serial_count.load(), 1000u);
+}
+
+TEST(Dispatcher, wait_only_for_own_tasks) {
+    using namespace mustache;
+    Dispatcher dispatcher{2u};
+    std::atomic<bool> started{false};
+    std::atomic<bool> release{false};
+    std::thread other{[&dispatcher, &started, &release] {
+        dispatcher.addParallelTask([&started, &release] {
+            started = true;
+            while (!release) {
+                std::this_thread::yield();
+            }
+        });
+        dispatcher.waitForParallelFinish();
+        ASSERT_TRUE(release);
+    }};
+    while (!started) {
+        std::this_thread::yield();
+    }
+    std::atomic<uint32_t> count{0u};
+    for (uint32_t i = 0; i < 100u; ++i) {
+        dispatcher.addParallelTask([&count] {
+            ++count;
+        });
+    }
+    // task of the other thread is still running
+    dispatcher.waitForParallelFinish();
+    ASSERT_EQ(count.load(), 100u);
+    ASSERT_FALSE(release);
+    release = true;
+    other.join();
+}
+
+TEST(Dispatcher, inline_tasks) {
+    using namespace mustache;
+    Dispatcher dispatcher{3u};
+    auto shared = std::make_shared<uint32_t>(0u);
+    std::atomic<uint32_t> small_count{0u};
+    std::atomic<uint32_t> large_count{0u};
+    std::array<uint64_t, 32> large_payload{}; // does not fit into Task, stored on heap
+    large_payload.back() = 1u;
+    for (uint32_t i = 0; i < 100u; ++i) {
+        dispatcher.addParallelTask([shared, &small_count](ThreadId) {
+            ++small_count;
+        });
+        dispatcher.addParallelTask([shared, large_payload, &large_count] {
+            large_count += static_cast<uint32_t>(large_payload.back());
+        });
+    }
+    dispatcher.waitForParallelFinish();
+    ASSERT_EQ(small_count.load(), 100u);
+    ASSERT_EQ(large_count.load(), 100u);
+    ASSERT_EQ(shared.use_count(), 1); // every callable has been destroyed
+
+    std::atomic<uint32_t> batch_count{0u};
+    std::vector<std::function<void()> > functions(50u, [&batch_count] {
+        ++batch_count;
+    });
+    dispatcher.addParallelTasks(functions.begin(), functions.end());
+    std::array<std::atomic<uint32_t>, 64> calls{};
+    auto function = [&calls](ParallelTaskId task_id) {
+        ++calls[task_id.toInt()];
+    };
+    dispatcher.addParallelTasks(static_cast<uint32_t>(calls.size()), function);
+    dispatcher.waitForParallelFinish();
+    ASSERT_EQ(batch_count.load(), 50u);
+    for (const auto& count : calls) {
+        ASSERT_EQ(count.load(), 1u);
+    }
+
+    dispatcher.setSingleThreadMode(true);
+    dispatcher.addParallelTasks(functions.begin(), functions.end());
+    ASSERT_EQ(batch_count.load(), 100u);
+}
+
+TEST(Dispatcher, nested_parallel_for) {
+    using namespace mustache;
+    Dispatcher dispatcher{3u};
+    std::array<std::atomic<uint32_t>, 16> counts{};
+    for (uint32_t iteration = 0; iteration < 20u; ++iteration) {
+        dispatcher.parallelFor([&dispatcher, &counts, iteration](size_t outer) {
+            dispatcher.parallelFor([&counts, outer](size_t) {
+                ++counts[outer];
+            }, 0u, 100u, 4u);
+            // wait inside of a task is scoped to its own tasks
+            ASSERT_EQ(counts[outer].load(), 100u * (iteration + 1u));
+        }, 0u, counts.size(), 8u);
+    }
+    for (const auto& count : counts) {
+        ASSERT_EQ(count.load(), 2000u);
+    }
+}
+
+TEST(Dispatcher, parallel_for_without_threads) {
+    using namespace mustache;
+    Dispatcher dispatcher{0u};
+    ASSERT_EQ(dispatcher.threadCount(), 0u);
+    std::vector<uint32_t> calls(100u, 0u);
+    // the only task is run by the calling thread
+    dispatcher.parallelFor([&calls](size_t index) {
+        ++calls[index];
+    }, 0u, calls.size());
+    for (auto count : calls) {
+        ASSERT_EQ(count, 1u);
+    }
+    dispatcher.parallelFor([](size_t) {
+        FAIL();
+    }, 0u, 0u);
+}
+
+TEST(Dispatcher, cancel_tasks_on_exception) {
+    using namespace mustache;
+    struct ThrowOnCopy {
+        ThrowOnCopy(std::shared_ptr<std::atomic<uint32_t> > counter, bool throw_on_copy):
+                counter_{std::move(counter)},
+                throw_on_copy_{throw_on_copy} {
+
+        }
+        ThrowOnCopy(const ThrowOnCopy& other):
+                counter_{other.counter_},
+                throw_on_copy_{other.throw_on_copy_} {
+            if (throw_on_copy_) {
+                throw std::runtime_error("copy failed");
+            }
+        }
+        void operator()() const {
+            ++*counter_;
+        }
+        std::shared_ptr<std::atomic<uint32_t> > counter_;
+        bool throw_on_copy_;
+    };
+    Dispatcher dispatcher{3u};
+    auto counter = std::make_shared<std::atomic<uint32_t> >(0u);
+    std::vector<ThrowOnCopy> functions;
+    functions.reserve(4u);
+    functions.emplace_back(counter, false);
+    functions.emplace_back(counter, false);
+    functions.emplace_back(counter, true);
+    functions.emplace_back(counter, false);
+    ASSERT_THROW(dispatcher.addParallelTasks(functions.begin(), functions.end()), std::runtime_error);
+    // callables of tasks assigned before the exception are destroyed, none of them is run
+    ASSERT_EQ(counter.use_count(), 5);
+    dispatcher.waitForParallelFinish();
+    ASSERT_EQ(counter->load(), 0u);
+
+    functions.pop_back();
+    functions.pop_back();
+    dispatcher.addParallelTasks(functions.begin(), functions.end());
+    dispatcher.waitForParallelFinish();
+    ASSERT_EQ(counter->load(), 2u);
+    ASSERT_EQ(counter.use_count(), 3);
+}
+
+TEST(Dispatcher, external_threads_and_many_dispatchers) {
+    using namespace mustache;
+    auto first = std::make_unique<Dispatcher>(2u);
+    Dispatcher second{2u};
+    std::atomic<uint32_t> count{0u};
+    const auto work = [&count](Dispatcher& dispatcher) {
+        dispatcher.parallelFor([&count](size_t) {
+            ++count;
+        }, 0u, 100u);
+    };
+    // short-lived threads submit work, their batches are released with them
+    for (uint32_t i = 0; i < 8u; ++i) {
+        std::thread{[&] {
+            work(*first);
+            work(second);
+        }}.join();
+    }
+    for (uint32_t i = 0; i < 8u; ++i) {
+        work(*first);
+        work(second);
+    }
+    ASSERT_EQ(count.load(), 3200u);
+
+    // batches of destroyed Dispatcher are dropped, new one gets its own
+    first = std::make_unique<Dispatcher>(2u);
+    work(*first);
+    work(second);
+    ASSERT_EQ(count.load(), 3400u);
+}
@@ -2,7 +2,10 @@
 
 #include <gtest/gtest.h>
 
+#include <array>
 #include <map>
+#include <set>
+#include <string>
 
 namespace {
     std::map<void*, std::string> created_components;
@@ -931,3 +934,543 @@ TEST(EntityManager, custom_constructor) {
         }
     });
 }
+
+TEST(EntityManager, createBatch) {
+    struct CreateWithEntity {
+        CreateWithEntity(mustache::Entity e):
+                entity{e} {
+
+        }
+        mustache::Entity entity;
+    };
+    ASSERT_EQ(created_components.size(), 0);
+    {
+        mustache::World world{mustache::WorldId::make(1)};
+        auto& entities = world.entities();
+        auto& archetype = entities.getArchetype<ComponentWithCheck<0>, CreateWithEntity, PodComponent<0> >();
+
+        std::vector<mustache::Entity> to_destroy;
+        for (uint32_t i = 0; i < 100; ++i) {
+            to_destroy.push_back(entities.create(archetype));
+        }
+        for (uint32_t i = 0; i < 100; i += 2) {
+            entities.destroyNow(to_destroy[i]);
+        }
+        ASSERT_EQ(created_components.size(), 50);
+
+        constexpr uint32_t kCount = 50000;
+        const auto group = entities.createBatch(archetype, kCount);
+        ASSERT_EQ(group.size(), kCount);
+        ASSERT_EQ(group.numFragmented(), 50);
+        ASSERT_EQ(archetype.size(), kCount + 50);
+        ASSERT_EQ(created_components.size(), kCount + 50);
+
+        std::set<uint32_t> ids;
+        for (const auto entity : group) {
+            ASSERT_TRUE(entities.isEntityValid(entity));
+            ASSERT_EQ(entity.worldId(), world.id());
+            ASSERT_EQ(entities.getArchetypeOf(entity), &archetype);
+            ASSERT_EQ(entities.getComponent<CreateWithEntity>(entity)->entity, entity);
+            ids.insert(entity.id().toInt());
+        }
+        ASSERT_EQ(ids.size(), kCount);
+        ASSERT_EQ(group.at(group.size() - 1).id().toInt(), kCount + 49);
+
+        const auto created_by_archetype = archetype.createGroup(10);
+        ASSERT_EQ(created_by_archetype.size(), 10);
+        ASSERT_EQ(created_by_archetype.numFragmented(), 0);
+        ASSERT_EQ(archetype.size(), kCount + 60);
+    }
+    ASSERT_EQ(created_components.size(), 0);
+}
+
+TEST(EntityManager, destroyBatchNow) {
+    struct Value {
+        uint32_t value = 0;
+    };
+    ASSERT_EQ(created_components.size(), 0);
+    {
+        mustache::World world;
+        auto& entities = world.entities();
+        auto& arch0 = entities.getArchetype<ComponentWithCheck<0>, Value>();
+        auto& arch1 = entities.getArchetype<ComponentWithCheck<0>, ComponentWithCheck<1>, Value>();
+
+        constexpr uint32_t kCount = 10000;
+        std::vector<mustache::Entity> all;
+        for (uint32_t i = 0; i < kCount; ++i) {
+            auto entity = entities.create(i % 2 ? arch0 : arch1);
+            entities.getComponent<Value>(entity)->value = i;
+            all.push_back(entity);
+        }
+        ASSERT_EQ(created_components.size(), kCount + kCount / 2);
+
+        std::vector<mustache::Entity> to_destroy;
+        std::vector<uint32_t> alive;
+        for (uint32_t i = 0; i < kCount; ++i) {
+            if (i % 10 < 3 || i > kCount - 100) {
+                to_destroy.push_back(all[i]);
+            } else {
+                alive.push_back(i);
+            }
+        }
+        to_destroy.push_back(to_destroy.front()); // duplicate is ignored
+        entities.destroyBatchNow(to_destroy.data(), to_destroy.size());
+
+        ASSERT_EQ(arch0.size() + arch1.size(), alive.size());
+        uint32_t expected_components = 0;
+        for (auto i : alive) {
+            const auto entity = all[i];
+            ASSERT_TRUE(entities.isEntityValid(entity));
+            ASSERT_EQ(entities.getComponent<Value>(entity)->value, i);
+            expected_components += i % 2 ? 1 : 2;
+        }
+        ASSERT_EQ(created_components.size(), expected_components);
+        for (size_t i = 0; i + 1 < to_destroy.size(); ++i) {
+            ASSERT_FALSE(entities.isEntityValid(to_destroy[i]));
+        }
+
+        // released ids are reused
+        for (size_t i = 0; i + 1 < to_destroy.size(); ++i) {
+            const auto entity = entities.create<Value>();
+            ASSERT_LT(entity.id().toInt(), kCount);
+            ASSERT_EQ(entity.version().toInt(), 1);
+        }
+        ASSERT_EQ(entities.create().id().toInt(), kCount);
+
+        // deferred destroy goes through the same path
+        for (auto i : alive) {
+            entities.destroy(all[i]);
+            entities.destroy(all[i]);
+            ASSERT_TRUE(entities.isMarkedForDestroy(all[i]));
+        }
+        entities.update();
+        ASSERT_EQ(arch0.size() + arch1.size(), 0);
+        ASSERT_EQ(created_components.size(), 0);
+        for (auto i : alive) {
+            ASSERT_FALSE(entities.isMarkedForDestroy(all[i]));
+        }
+    }
+    ASSERT_EQ(created_components.size(), 0);
+}
+
+TEST(EntityManager, archetype_transition_edges) {
+    mustache::World world;
+    auto& entities = world.entities();
+    const auto id0 = mustache::ComponentFactory::registerComponent<PodComponent<0> >();
+    const auto id1 = mustache::ComponentFactory::registerComponent<PodComponent<1> >();
+
+    auto& empty = entities.getArchetype<>();
+    auto& arch0 = entities.getArchetypeWith(empty, id0);
+    ASSERT_EQ(&arch0, &entities.getArchetype<PodComponent<0> >());
+    ASSERT_EQ(&arch0, &entities.getArchetypeWith(empty, id0));
+
+    auto& arch01 = entities.getArchetypeWith(arch0, id1);
+    ASSERT_EQ(&arch01, (&entities.getArchetype<PodComponent<0>, PodComponent<1> >()));
+    ASSERT_EQ(&entities.getArchetypeWithout(arch01, id1), &arch0);
+    ASSERT_EQ(&entities.getArchetypeWithout(arch0, id0), &empty);
+    ASSERT_EQ(&entities.getArchetypeWithout(arch0, id1), &arch0);
+
+    auto entity = entities.create();
+    entities.assign<PodComponent<0> >(entity);
+    entities.assign<PodComponent<1> >(entity);
+    ASSERT_EQ(entities.getArchetypeOf(entity), &arch01);
+    entities.removeComponent<PodComponent<1> >(entity);
+    ASSERT_EQ(entities.getArchetypeOf(entity), &arch0);
+
+    // new dependency invalidates cached edges
+    entities.addDependency<PodComponent<0>, PodComponent<1> >();
+    ASSERT_EQ(&entities.getArchetypeWith(empty, id0), &arch01);
+}
+
+TEST(EntityManager, transition_keeps_component_values) {
+    struct Name {
+        std::string value;
+    };
+    struct Index {
+        uint32_t value = 0;
+    };
+    struct Tag {
+        uint32_t value = 0;
+    };
+    mustache::World world;
+    auto& entities = world.entities();
+    std::vector<mustache::Entity> created;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        auto entity = entities.create<Name, Index>();
+        entities.getComponent<Name>(entity)->value = "entity with long name to avoid sso #" + std::to_string(i);
+        entities.getComponent<Index>(entity)->value = i;
+        created.push_back(entity);
+    }
+    for (uint32_t i = 0; i < 1000; i += 2) {
+        entities.assign<Tag>(created[i], i * 2);
+    }
+    for (uint32_t i = 0; i < 1000; i += 4) {
+        entities.removeComponent<Tag>(created[i]);
+        entities.removeComponent<Name>(created[i]);
+    }
+    for (uint32_t i = 0; i < 1000; ++i) {
+        const auto entity = created[i];
+        ASSERT_EQ(entities.getComponent<Index>(entity)->value, i);
+        if (i % 4 == 0) {
+            ASSERT_FALSE(entities.hasComponent<Name>(entity));
+            ASSERT_FALSE(entities.hasComponent<Tag>(entity));
+            continue;
+        }
+        ASSERT_EQ(entities.getComponent<Name>(entity)->value,
+                  "entity with long name to avoid sso #" + std::to_string(i));
+        if (i % 2 == 0) {
+            ASSERT_EQ(entities.getComponent<Tag>(entity)->value, i * 2);
+        } else {
+            ASSERT_FALSE(entities.hasComponent<Tag>(entity));
+        }
+    }
+}
+
+TEST(EntityManager, add_remove_component_to_all) {
+    struct Position {
+        uint32_t value = 0;
+    };
+    struct Name {
+        std::string value;
+    };
+    struct Stunned {
+        uint32_t frames = 3;
+    };
+    mustache::World world;
+    auto& entities = world.entities();
+    std::vector<mustache::Entity> with_name;
+    std::vector<mustache::Entity> without_name;
+    std::vector<mustache::Entity> not_matched;
+    for (uint32_t i = 0; i < 50000; ++i) {
+        if (i % 3 == 0) {
+            auto entity = entities.create<Position, Name>();
+            entities.getComponent<Position>(entity)->value = i;
+            entities.getComponent<Name>(entity)->value = "long enough name to be allocated #" + std::to_string(i);
+            with_name.push_back(entity);
+        } else if (i % 3 == 1) {
+            auto entity = entities.create<Position>();
+            entities.getComponent<Position>(entity)->value = i;
+            without_name.push_back(entity);
+        } else {
+            not_matched.push_back(entities.create<Name>());
+        }
+    }
+    const auto check_values = [&] {
+        for (auto entity : with_name) {
+            const auto i = entities.getComponent<Position>(entity)->value;
+            ASSERT_EQ(entities.getComponent<Name>(entity)->value,
+                      "long enough name to be allocated #" + std::to_string(i));
+        }
+    };
+
+    entities.addComponentToAll<Stunned, Position>();
+    for (auto entity : with_name) {
+        ASSERT_TRUE(entities.hasComponent<Stunned>(entity));
+        ASSERT_EQ(entities.getComponent<Stunned>(entity)->frames, 3);
+    }
+    for (auto entity : without_name) {
+        ASSERT_TRUE(entities.hasComponent<Stunned>(entity));
+    }
+    for (auto entity : not_matched) {
+        ASSERT_FALSE(entities.hasComponent<Stunned>(entity));
+    }
+    check_values();
+    ASSERT_EQ((entities.getArchetype<Position, Name>().size()), 0);
+    ASSERT_EQ((entities.getArchetype<Position, Name, Stunned>().size()), with_name.size());
+
+    entities.removeComponentFromAll<Stunned, Name>();
+    for (auto entity : with_name) {
+        ASSERT_FALSE(entities.hasComponent<Stunned>(entity));
+    }
+    for (auto entity : without_name) {
+        ASSERT_TRUE(entities.hasComponent<Stunned>(entity));
+    }
+    check_values();
+
+    entities.lock();
+    entities.removeComponentFromAll<Stunned>();
+    ASSERT_TRUE(entities.hasComponent<Stunned>(without_name.front()));
+    entities.unlock();
+    for (auto entity : without_name) {
+        ASSERT_FALSE(entities.hasComponent<Stunned>(entity));
+    }
+}
+
+TEST(EntityManager, find_archetypes) {
+    struct C0 {};
+    struct C1 {};
+    struct C2 {};
+    struct Shared : public mustache::SharedComponentTag {
+        uint32_t value = 0u;
+    };
+    mustache::World world;
+    auto& entities = world.entities();
+    (void) entities.getArchetype<C0>();
+    (void) entities.getArchetype<C0, C1>();
+    (void) entities.getArchetype<C1, C2>();
+    (void) entities.getArchetype<C0, C1, C2>();
+    (void) entities.create<C0, C1>();
+    entities.assignShared<Shared>(entities.create<C0, C1>());
+
+    const auto linear = [&entities](const mustache::ComponentIdMask& mask, const mustache::SharedComponentIdMask& shared) {
+        std::vector<mustache::ArchetypeIndex> result;
+        for (uint32_t i = 0; i < entities.getArchetypesCount(); ++i) {
+            auto& archetype = entities.getArchetype(mustache::ArchetypeIndex::make(i));
+            if (archetype.isMatch(mask) && archetype.isMatch(shared)) {
+                result.push_back(archetype.id());
+            }
+        }
+        return result;
+    };
+    const auto shared_mask = mustache::ComponentFactory::makeSharedMask<Shared>();
+    const std::vector<mustache::ComponentIdMask> masks {
+            mustache::ComponentIdMask{},
+            mustache::ComponentFactory::makeMask<C0>(),
+            mustache::ComponentFactory::makeMask<C1, C2>(),
+            mustache::ComponentFactory::makeMask<C0, C2>(),
+            mustache::ComponentFactory::makeMask<UnusedComponent>(),
+    };
+    for (const auto& mask : masks) {
+        for (const auto& shared : {mustache::SharedComponentIdMask{}, shared_mask}) {
+            std::vector<mustache::ArchetypeIndex> found;
+            entities.findArchetypes(mask, shared, found);
+            ASSERT_EQ(found, linear(mask, shared));
+        }
+    }
+
+    std::vector<mustache::ArchetypeIndex> found;
+    entities.findArchetypes(mustache::ComponentFactory::makeMask<C1>(), {}, found, mustache::ArchetypeIndex::make(2));
+    for (const auto& index : found) {
+        ASSERT_GE(index.toInt(), 2u);
+    }
+    ASSERT_EQ(found.size(), 3u);
+}
+
+TEST(EntityManager, tag_components) {
+    struct Tag {};
+    struct OtherTag {};
+    struct Value {
+        uint32_t value = 0u;
+    };
+    static_assert(mustache::ComponentInfo::isTag<Tag>());
+    static_assert(!mustache::ComponentInfo::isTag<Value>());
+    struct EmptyWithConstructor {
+        EmptyWithConstructor() {}
+    };
+    static_assert(!mustache::ComponentInfo::isTag<EmptyWithConstructor>());
+
+    mustache::World world;
+    auto& entities = world.entities();
+    constexpr uint32_t kCount = 20000u; // more than one chunk
+    std::vector<mustache::Entity> all;
+    std::vector<mustache::Entity> tagged;
+    for (uint32_t i = 0; i < kCount; ++i) {
+        const auto entity = all.emplace_back(entities.create<Value, Tag>());
+        entities.getComponent<Value>(entity)->value = i;
+        if (i % 3u == 0u) {
+            entities.assign<OtherTag>(entity);
+            tagged.push_back(entity);
+        }
+    }
+    const auto only_tags = entities.create<Tag, OtherTag>();
+    ASSERT_NE(entities.getComponent<Tag>(only_tags), nullptr);
+    ASSERT_TRUE(entities.hasComponent<OtherTag>(only_tags));
+
+    entities.setEnabled<Tag>(tagged.front(), false);
+    entities.removeComponent<OtherTag>(tagged.front());
+    ASSERT_FALSE(entities.isEnabled<Tag>(tagged.front()));
+    entities.setEnabled<Tag>(tagged.front(), true);
+
+    uint32_t count = 0u;
+    uint64_t sum = 0u;
+    entities.forEach([&count, &sum](const Value& value, const Tag&, const OtherTag&) {
+        ++count;
+        sum += value.value;
+    });
+    ASSERT_EQ(count, tagged.size() - 1u);
+    uint64_t expected = 0u;
+    for (uint32_t i = 1; i < tagged.size(); ++i) {
+        expected += entities.getComponent<const Value>(tagged[i])->value;
+    }
+    ASSERT_EQ(sum, expected);
+
+    for (uint32_t i = 0; i < kCount; i += 2u) {
+        entities.removeComponent<Tag>(all[i]);
+    }
+    for (uint32_t i = 0; i < kCount; ++i) {
+        const auto entity = all[i];
+        ASSERT_EQ(entities.getComponent<const Value>(entity)->value, i);
+        ASSERT_EQ(entities.hasComponent<Tag>(entity), i % 2u != 0u);
+    }
+}
+
+TEST(EntityManager, archetype_data_chunk_capacity) {
+    struct Small {
+        uint32_t value = 0u;
+    };
+    struct Large {
+        uint32_t value = 0u;
+        std::array<std::byte, 396> payload;
+    };
+    struct Tag {};
+    mustache::World world;
+    auto& entities = world.entities();
+    ASSERT_EQ(entities.getArchetype<Small>().dataChunkCapacity().toInt(), 16384u);
+    ASSERT_EQ(entities.getArchetype<Tag>().dataChunkCapacity().toInt(), 16384u);
+    auto& large = entities.getArchetype<Large>();
+    ASSERT_EQ(large.dataChunkCapacity().toInt(), 128u);
+    ASSERT_EQ(large.chunkCapacity().toInt(), 128u); // version chunk stays inside data chunk
+
+    entities.setArchetypeChunkBytes(16u * 1024u);
+    auto& small = entities.getArchetype<Small, Tag>();
+    ASSERT_EQ(small.dataChunkCapacity().toInt(), 4096u);
+
+    constexpr uint32_t kCount = 1000u;
+    for (uint32_t i = 0; i < kCount; ++i) {
+        const auto entity = entities.create<Large>();
+        entities.getComponent<Large>(entity)->value = i;
+    }
+    uint32_t count = 0u;
+    entities.forEach([&count](const Large& component, mustache::JobInvocationIndex invocation_index) {
+        ASSERT_EQ(component.value, invocation_index.entity_index.toInt());
+        ++count;
+    });
+    ASSERT_EQ(count, kCount);
+}
+
+TEST(EntityManager, small_archetype_growth) {
+    struct Value {
+        uint32_t value = 0u;
+    };
+    struct Name {
+        std::string value;
+    };
+    struct Rare {};
+    mustache::World world;
+    auto& entities = world.entities();
+    entities.setDefaultInitialChunkCapacity(4u);
+    entities.addInitialChunkCapacity<Rare>(1u);
+
+    auto& archetype = entities.getArchetype<Value, Name>();
+    ASSERT_EQ(archetype.capacity(), 0u);
+    std::vector<mustache::Entity> created;
+    for (uint32_t i = 0; i < 100u; ++i) {
+        const auto entity = created.emplace_back(entities.create<Value, Name>());
+        entities.getComponent<Value>(entity)->value = i;
+        entities.getComponent<Name>(entity)->value = "long enough name to be stored on heap " + std::to_string(i);
+        if (i == 0u) {
+            ASSERT_EQ(archetype.capacity(), 4u);
+        }
+        if (i == 4u) {
+            ASSERT_EQ(archetype.capacity(), 8u);
+        }
+    }
+    ASSERT_EQ(archetype.capacity(), 128u);
+    for (uint32_t i = 0; i < created.size(); ++i) {
+        ASSERT_EQ(entities.getComponent<const Value>(created[i])->value, i);
+        ASSERT_EQ(entities.getComponent<const Name>(created[i])->value,
+                  "long enough name to be stored on heap " + std::to_string(i));
+    }
+
+    auto& rare = entities.getArchetype<Value, Rare>();
+    (void) entities.create<Value, Rare>();
+    ASSERT_EQ(rare.capacity(), 1u);
+    (void) entities.createBatch<Value, Rare>(100u);
+    ASSERT_EQ(rare.capacity(), 128u);
+
+    entities.clear(); // chunks are kept
+    ASSERT_EQ(archetype.capacity(), 128u);
+}
+
+TEST(EntityManager, shrink_to_fit) {
+    struct Large {
+        uint32_t value = 0u;
+        std::array<std::byte, 396> payload;
+    };
+    mustache::World world;
+    world.memoryManager().setDecommitSize(16u * 1024u);
+    auto& entities = world.entities();
+    auto& archetype = entities.getArchetype<Large>();
+    ASSERT_EQ(archetype.dataChunkCapacity().toInt(), 128u);
+
+    std::vector<mustache::Entity> created;
+    for (uint32_t i = 0; i < 1000u; ++i) {
+        created.push_back(entities.create<Large>());
+        entities.getComponent<Large>(created.back())->value = i;
+    }
+    ASSERT_EQ(archetype.capacity(), 1024u);
+    for (uint32_t i = 10; i < created.size(); ++i) {
+        entities.destroyNow(created[i]);
+    }
+    created.resize(10u);
+    ASSERT_EQ(archetype.capacity(), 1024u);
+
+    ASSERT_EQ(entities.trim(2u), 2u);
+    ASSERT_EQ(archetype.capacity(), 768u);
+
+    entities.setTrimBudget(1u);
+    entities.update();
+    ASSERT_EQ(archetype.capacity(), 640u);
+    entities.setTrimBudget(0u);
+
+    entities.shrinkToFit();
+    ASSERT_EQ(archetype.capacity(), 128u);
+    for (uint32_t i = 0; i < created.size(); ++i) {
+        ASSERT_EQ(entities.getComponent<const Large>(created[i])->value, i);
+    }
+
+    // released chunks are reused
+    for (uint32_t i = 0; i < 300u; ++i) {
+        entities.getComponent<Large>(entities.create<Large>())->value = i;
+    }
+    ASSERT_EQ(archetype.capacity(), 384u);
+    uint32_t count = 0u;
+    entities.forEach([&count](const Large&) {
+        ++count;
+    });
+    ASSERT_EQ(count, 310u);
+
+    entities.clear();
+    entities.shrinkToFit();
+    ASSERT_EQ(archetype.capacity(), 0u);
+}
+
+TEST(EntityManager, shrink_to_fit_enable_bits) {
+    struct Value {
+        uint32_t value = 0u;
+    };
+    mustache::World world;
+    auto& entities = world.entities();
+    auto& archetype = entities.getArchetype<Value>();
+    const auto& enable_storage = archetype.enableStorage();
+    const auto chunk_size = archetype.chunkCapacity().toInt();
+
+    std::vector<mustache::Entity> created;
+    for (uint32_t i = 0; i < 4u * chunk_size; ++i) {
+        created.push_back(entities.create<Value>());
+    }
+    entities.setEnabled<Value>(created[1], false);
+    entities.setEnabled<Value>(created.back(), false);
+    ASSERT_EQ(enable_storage.chunkCount(), 4u);
+    for (uint32_t i = 10; i < created.size(); ++i) {
+        entities.destroyNow(created[i]);
+    }
+    created.resize(10u);
+
+    // bit chunks are released together with data chunks
+    entities.shrinkToFit();
+    ASSERT_EQ(enable_storage.chunkCount(), 1u);
+    for (uint32_t i = 0; i < created.size(); ++i) {
+        ASSERT_EQ(entities.isEnabled<Value>(created[i]), i != 1u);
+    }
+
+    // rows of new chunks are enabled
+    for (uint32_t i = 0; i < 2u * chunk_size; ++i) {
+        ASSERT_TRUE(entities.isEnabled<Value>(entities.create<Value>()));
+    }
+    ASSERT_EQ(enable_storage.chunkCount(), 3u);
+
+    entities.clear();
+    entities.shrinkToFit();
+    ASSERT_EQ(enable_storage.chunkCount(), 0u);
+}
@@ -4,6 +4,8 @@
 #include <mustache/ecs/non_template_job.hpp>
 #include <gtest/gtest.h>
 #include <map>
+#include <set>
+#include <atomic>
 
 namespace {
     struct Position {
@@ -631,3 +633,198 @@ TEST(Job, NonTemplate) {
 
     }
 }
+
+TEST(Job, cached_archetypes) {
+    struct CountJob : public mustache::PerEntityJob<CountJob> {
+        uint32_t count = 0u;
+        void operator()(const Position&, const Velocity&) {
+            ++count;
+        }
+    };
+
+    CountJob job;
+    {
+        mustache::World world;
+        auto& entities = world.entities();
+        for (uint32_t i = 0; i < kNumObjects; ++i) {
+            (void) entities.create<Position, Velocity>();
+            (void) entities.create<Position>();
+        }
+        job.run(world);
+        ASSERT_EQ(job.count, kNumObjects);
+
+        // archetypes created after the first run are found
+        for (uint32_t i = 0; i < kNumObjects; ++i) {
+            (void) entities.create<Position, Velocity, Orientation>();
+            (void) entities.create<Velocity, Orientation>();
+        }
+        job.count = 0u;
+        job.run(world);
+        ASSERT_EQ(job.count, 2u * kNumObjects);
+    }
+
+    // cache is rebuilt for another world
+    mustache::World world;
+    for (uint32_t i = 0; i < kNumObjects; ++i) {
+        (void) world.entities().create<Velocity, Position, Component0>();
+    }
+    job.count = 0u;
+    job.run(world);
+    ASSERT_EQ(job.count, kNumObjects);
+}
+
+TEST(Job, without_and_any_of_filters) {
+    struct FilterJob : public mustache::PerEntityJob<FilterJob> {
+        uint32_t count = 0u;
+        void operator()(const Position&, mustache::Without<Component0, Component1>,
+                        mustache::AnyOf<Velocity, Orientation>) {
+            ++count;
+        }
+    };
+
+    mustache::World world;
+    auto& entities = world.entities();
+    for (uint32_t i = 0; i < kNumObjects; ++i) {
+        (void) entities.create<Position>(); // no Velocity/Orientation
+        (void) entities.create<Position, Velocity>();
+        (void) entities.create<Position, Orientation>();
+        (void) entities.create<Position, Velocity, Orientation>();
+        (void) entities.create<Position, Velocity, Component0>();
+        (void) entities.create<Position, Orientation, Component1>();
+    }
+    FilterJob job;
+    job.run(world, mustache::JobRunMode::kParallel);
+    ASSERT_EQ(job.count, 3u * kNumObjects);
+
+    uint32_t count = 0u;
+    entities.forEach([&count](mustache::Entity, mustache::Without<Position>, const Velocity&) {
+        ++count;
+    });
+    ASSERT_EQ(count, 0u);
+
+    (void) entities.create<Velocity, Component2>();
+    entities.forEach([&count](mustache::Without<Position>, const Velocity&, mustache::AnyOf<Component2, Component3>) {
+        ++count;
+    });
+    ASSERT_EQ(count, 1u);
+
+    mustache::NonTemplateJob non_template_job;
+    non_template_job.component_requests = {
+            {mustache::ComponentFactory::registerComponent<Position>(), true, true},
+    };
+    non_template_job.exclude_mask = mustache::ComponentFactory::makeMask<Velocity>();
+    non_template_job.any_of_masks = {mustache::ComponentFactory::makeMask<Orientation, Component1>()};
+    uint32_t non_template_count = 0u;
+    non_template_job.callback = [&non_template_count](const mustache::NonTemplateJob::ForEachArrayArgs& args) {
+        non_template_count += args.count.toInt();
+    };
+    non_template_job.run(world);
+    ASSERT_EQ(non_template_count, 2u * kNumObjects);
+}
+
+TEST(Job, enableable_components) {
+    constexpr uint32_t kCount = 5000u;
+    struct VelocityJob : public mustache::PerEntityJob<VelocityJob> {
+        std::set<uint32_t> visited;
+        void operator()(mustache::Entity entity, const Velocity&, const Position&) {
+            visited.insert(entity.id().toInt());
+        }
+    };
+    struct PositionJob : public mustache::PerEntityJob<PositionJob> {
+        uint32_t count = 0u;
+        void operator()(const Position&) {
+            ++count;
+        }
+    };
+
+    mustache::World world;
+    auto& entities = world.entities();
+    std::vector<mustache::Entity> created;
+    std::set<uint32_t> expected;
+    for (uint32_t i = 0; i < kCount; ++i) {
+        created.push_back(entities.create<Position, Velocity>());
+        // every third entity and whole second chunk are disabled
+        if (i % 3u == 0u || (i >= 1024u && i < 2048u)) {
+            entities.setEnabled<Velocity>(created.back(), false);
+        } else {
+            expected.insert(created.back().id().toInt());
+        }
+    }
+    ASSERT_FALSE(entities.isEnabled<Velocity>(created[0]));
+    ASSERT_TRUE(entities.isEnabled<Position>(created[0]));
+    ASSERT_TRUE(entities.isEnabled<Velocity>(created[1]));
+    ASSERT_FALSE(entities.isEnabled<Orientation>(created[1]));
+
+    VelocityJob velocity_job;
+    velocity_job.run(world, mustache::JobRunMode::kParallel);
+    ASSERT_EQ(velocity_job.visited, expected);
+    PositionJob position_job;
+    position_job.run(world);
+    ASSERT_EQ(position_job.count, kCount);
+
+    // bits follow entities on structural changes
+    entities.assign<Orientation>(created[3]);
+    entities.assign<Orientation>(created[4]);
+    ASSERT_FALSE(entities.isEnabled<Velocity>(created[3]));
+    ASSERT_TRUE(entities.isEnabled<Velocity>(created[4]));
+    entities.destroyNow(created[1]); // last entity is moved to its row
+    expected.erase(created[1].id().toInt());
+    ASSERT_FALSE(entities.isEnabled<Velocity>(created[kCount - 2u]));
+    ASSERT_TRUE(entities.isEnabled<Velocity>(created[kCount - 1u]));
+    const auto new_entity = entities.create<Position, Velocity>();
+    ASSERT_TRUE(entities.isEnabled<Velocity>(new_entity));
+    expected.insert(new_entity.id().toInt());
+
+    velocity_job.visited.clear();
+    velocity_job.run(world);
+    ASSERT_EQ(velocity_job.visited, expected);
+
+    for (const auto& entity : created) {
+        entities.setEnabled<Velocity>(entity, true);
+    }
+    velocity_job.visited.clear();
+    velocity_job.run(world);
+    ASSERT_EQ(velocity_job.visited.size(), kCount);
+}
+
+namespace {
+    template<typename _Region>
+    struct RegionJob : public mustache::PerEntityJob<RegionJob<_Region> > {
+        std::atomic<uint32_t> count{0u};
+        void operator()(Position& position, const _Region&) {
+            ++position.x;
+            ++count;
+        }
+    };
+}
+
+TEST(Job, nested_parallel_jobs) {
+    static constexpr uint32_t kCount = 10000u;
+    mustache::WorldContext context;
+    context.dispatcher = std::make_shared<mustache::Dispatcher>(3u);
+    mustache::World world{context};
+    auto& entities = world.entities();
+    for (uint32_t i = 0; i < kCount; ++i) {
+        (void) entities.create<Position, Component0>();
+        (void) entities.create<Position, Component1>();
+    }
+    RegionJob<Component0> job0;
+    RegionJob<Component1> job1;
+    // parallel job per region, every region job runs in parallel mode too
+    world.dispatcher().parallelFor([&world, &job0, &job1](size_t region) {
+        if (region == 0u) {
+            job0.run(world, mustache::JobRunMode::kParallel);
+            ASSERT_EQ(job0.count.load(), kCount);
+        } else {
+            job1.run(world, mustache::JobRunMode::kParallel);
+            ASSERT_EQ(job1.count.load(), kCount);
+        }
+    }, 0u, 2u);
+    ASSERT_FALSE(entities.isLocked());
+
+    uint32_t sum = 0u;
+    entities.forEach([&sum](const Position& position) {
+        sum += position.x;
+    });
+    ASSERT_EQ(sum, 2u * kCount);
+}
@@ -0,0 +1,176 @@
+#include <mustache/utils/memory_manager.hpp>
+#include <mustache/ecs/ecs.hpp>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <thread>
+#include <vector>
+
+TEST(MemoryManager, chunk_pool) {
+    constexpr size_t kSize = 3u * 1024u * 1024u; // exactly 3MB class
+    mustache::MemoryManager memory_manager;
+    auto ptr = memory_manager.allocateChunk(kSize);
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % mustache::MemoryManager::kChunkAlign, 0u);
+    auto statistics = memory_manager.chunkPoolStatistics();
+    ASSERT_EQ(statistics.hits + statistics.misses, 1u);
+    const auto hits = statistics.hits;
+
+    memory_manager.deallocateChunk(ptr, kSize);
+    ASSERT_EQ(memory_manager.allocateChunk(kSize - 1u), ptr); // same class, large blocks are taken from shared pool
+    ASSERT_EQ(memory_manager.chunkPoolStatistics().hits, hits + 1u);
+    memory_manager.deallocateChunk(ptr, kSize - 1u);
+
+    // new thread has empty cache, blocks come from shared pool
+    constexpr size_t kOtherSize = 2u * 1024u * 1024u;
+    memory_manager.reserveChunks(kOtherSize, 2u);
+    ASSERT_EQ(memory_manager.chunkPoolStatistics().pooled_bytes, kSize + 2u * kOtherSize);
+    std::thread{[&] {
+        const auto before = memory_manager.chunkPoolStatistics();
+        std::vector<void*> blocks;
+        for (uint32_t i = 0; i < 6u; ++i) {
+            blocks.push_back(memory_manager.allocateChunk(kOtherSize));
+        }
+        const auto after = memory_manager.chunkPoolStatistics();
+        ASSERT_EQ(after.hits - before.hits, 2u);
+        ASSERT_EQ(after.misses - before.misses, 4u);
+        ASSERT_EQ(after.pooled_bytes, kSize);
+        for (auto block : blocks) {
+            memory_manager.deallocateChunk(block, kOtherSize);
+        }
+        // large blocks are not cached by thread, all of them are returned to shared pool
+        ASSERT_EQ(memory_manager.chunkPoolStatistics().pooled_bytes, kSize + 6u * kOtherSize);
+    }}.join();
+
+    memory_manager.releaseChunkPool();
+    ASSERT_EQ(memory_manager.chunkPoolStatistics().pooled_bytes, 0u);
+}
+
+TEST(MemoryManager, flush_thread_cache) {
+    constexpr size_t kSize = 16u * 1024u;
+    mustache::MemoryManager memory_manager;
+    // new thread starts with empty cache
+    std::thread{[&memory_manager] {
+        std::vector<void*> blocks;
+        for (uint32_t i = 0; i < 6u; ++i) {
+            blocks.push_back(memory_manager.allocateChunk(kSize));
+        }
+        for (auto block : blocks) {
+            memory_manager.deallocateChunk(block, kSize);
+        }
+        // thread cache is full, the rest is returned to shared pool
+        ASSERT_EQ(memory_manager.chunkPoolStatistics().pooled_bytes, 2u * kSize);
+        memory_manager.flushThreadCache();
+        ASSERT_EQ(memory_manager.chunkPoolStatistics().pooled_bytes, 6u * kSize);
+    }}.join();
+
+    // cache of other thread is flushed by its next chunk operation
+    std::thread{[&memory_manager] {
+        memory_manager.deallocateChunk(memory_manager.allocateChunk(kSize), kSize);
+    }}.join();
+    ASSERT_EQ(memory_manager.chunkPoolStatistics().pooled_bytes, 5u * kSize);
+    std::thread{[&memory_manager] {
+        const auto ptr = memory_manager.allocateChunk(kSize);
+        memory_manager.flushThreadCache();
+        const auto pooled = memory_manager.chunkPoolStatistics().pooled_bytes;
+        memory_manager.deallocateChunk(ptr, kSize); // cached again
+        ASSERT_EQ(memory_manager.chunkPoolStatistics().pooled_bytes, pooled);
+    }}.join();
+
+    memory_manager.releaseChunkPool();
+    ASSERT_EQ(memory_manager.chunkPoolStatistics().pooled_bytes, 0u);
+}
+
+TEST(MemoryManager, chunk_size_classes) {
+    using mustache::MemoryManager;
+    ASSERT_EQ(MemoryManager::chunkBlockSize(1u), 4096u);
+    ASSERT_EQ(MemoryManager::chunkBlockSize(4096u), 4096u);
+    ASSERT_EQ(MemoryManager::chunkBlockSize(4097u), 8192u);
+    ASSERT_EQ(MemoryManager::chunkBlockSize(36u * 1024u), 40u * 1024u);
+    ASSERT_EQ(MemoryManager::chunkBlockSize(64u * 1024u + 64u), 80u * 1024u);
+    ASSERT_EQ(MemoryManager::chunkBlockSize(9u * 1024u * 1024u), 9u * 1024u * 1024u);
+    for (size_t size = 16u * 1024u; size <= 8u * 1024u * 1024u; size += 1000u) {
+        const auto block_size = MemoryManager::chunkBlockSize(size);
+        ASSERT_EQ(block_size % 4096u, 0u);
+        ASSERT_GE(block_size, size);
+        ASSERT_LE(block_size - size, size / 4u);
+    }
+
+    // 36 bytes row, every data chunk keeps waste of its block small
+    struct Row {
+        std::array<uint32_t, 9> values;
+    };
+    mustache::World world;
+    auto& entities = world.entities();
+    const auto before = world.memoryManager().chunkPoolStatistics().chunk_bytes;
+    for (uint32_t i = 0; i < 10000u; ++i) {
+        (void) entities.create<Row>();
+    }
+    const auto& archetype = entities.getArchetype<Row>();
+    const auto reserved = world.memoryManager().chunkPoolStatistics().chunk_bytes - before;
+    const auto used = static_cast<size_t>(archetype.capacity()) * sizeof(Row);
+    ASSERT_GE(reserved, used);
+    ASSERT_LE(reserved, used + used / 4u);
+}
+
+TEST(MemoryManager, chunk_reuse_between_archetypes) {
+    struct Value0 {
+        uint32_t value = 0u;
+    };
+    struct Value1 {
+        uint32_t value = 0u;
+    };
+    mustache::World world;
+    auto& entities = world.entities();
+    const auto entity = entities.create<Value0>();
+    entities.destroyNow(entity);
+    entities.shrinkToFit();
+
+    const auto before = world.memoryManager().chunkPoolStatistics();
+    (void) entities.create<Value1>(); // chunk of the same size
+    const auto after = world.memoryManager().chunkPoolStatistics();
+    ASSERT_EQ(after.misses, before.misses);
+    ASSERT_EQ(after.hits, before.hits + 1u);
+}
+
+TEST(MemoryManager, mmap_backend) {
+    using ChunkBackend = mustache::MemoryManager::ChunkBackend;
+    struct Value {
+        uint32_t value = 0u;
+    };
+    constexpr size_t kArenaSize = 16u * 1024u * 1024u;
+    mustache::WorldContext context;
+    context.memory_manager = std::make_shared<mustache::MemoryManager>(ChunkBackend::kMmap, kArenaSize);
+    mustache::World world{context};
+    auto& entities = world.entities();
+    constexpr uint32_t kCount = 100000u;
+    for (uint32_t i = 0; i < kCount; ++i) {
+        const auto entity = entities.create<Value>();
+        entities.getComponent<Value>(entity)->value = i;
+    }
+    uint64_t sum = 0u;
+    entities.forEach([&sum](const Value& value) {
+        sum += value.value;
+    });
+    ASSERT_EQ(sum, static_cast<uint64_t>(kCount) * (kCount - 1u) / 2u);
+
+    const auto statistics = world.memoryManager().chunkPoolStatistics();
+#ifdef __linux__
+    ASSERT_GE(statistics.arena_bytes, kArenaSize);
+#endif
+    entities.clear();
+    entities.shrinkToFit();
+    // arena chunks are kept by the pool, even above the limit
+    const auto pooled = world.memoryManager().chunkPoolStatistics().pooled_bytes;
+#ifdef __linux__
+    ASSERT_GT(pooled, 0u);
+#endif
+    world.memoryManager().releaseChunkPool();
+    ASSERT_EQ(world.memoryManager().chunkPoolStatistics().pooled_bytes, pooled);
+
+    const auto before = world.memoryManager().chunkPoolStatistics();
+    (void) entities.create<Value>();
+    const auto after = world.memoryManager().chunkPoolStatistics();
+    ASSERT_EQ(after.misses, before.misses);
+}
@@ -2,6 +2,10 @@
 
 #include <gtest/gtest.h>
 
+#include <set>
+#include <atomic>
+#include <thread>
+
 namespace {
     constexpr uint32_t N = 1024 * 1024;
 
@@ -321,3 +325,274 @@ TEST(EntityManager, lock_unlock) {
     ASSERT_EQ(0, count);
     ASSERT_FALSE(error);
 }
+
+TEST(EntityManager, replay_interleaved_commands) {
+    mustache::World world;
+    auto& entities = world.entities();
+
+    std::vector<mustache::Entity> existing;
+    for (uint32_t i = 0; i < 64; ++i) {
+        existing.push_back(i % 2 == 0 ? entities.create<Component0>() : entities.create<Component0, Component1>());
+    }
+
+    entities.lock();
+    std::vector<mustache::Entity> created;
+    for (uint32_t i = 0; i < 32; ++i) {
+        created.push_back(entities.create<Component1>());
+    }
+    // commands of different entities are interleaved, every entity ends up in one bucket
+    for (uint32_t i = 0; i < existing.size(); ++i) {
+        entities.assign<Component2>(existing[i], Component2::str(i));
+    }
+    for (uint32_t i = 0; i < existing.size(); ++i) {
+        if (i % 3 == 0) {
+            entities.removeComponent<Component0>(existing[i]);
+        }
+        entities.assign<Component0>(existing[i], i);
+        entities.assign<Component2>(existing[i], Component2::str(i + 1000u));
+    }
+    for (uint32_t i = 0; i < created.size(); ++i) {
+        entities.assign<Component2>(created[i], Component2::str(i));
+        if (i % 4 == 0) {
+            entities.destroyNow(created[i]);
+        }
+    }
+    entities.destroyNow(existing.back());
+    entities.unlock();
+
+    for (uint32_t i = 0; i + 1u < existing.size(); ++i) {
+        const auto entity = existing[i];
+        ASSERT_TRUE(entities.isEntityValid(entity));
+        ASSERT_EQ(entities.getComponent<const Component0>(entity)->value, i);
+        ASSERT_EQ(entities.getComponent<const Component2>(entity)->value, Component2::str(i + 1000u));
+        ASSERT_EQ(entities.hasComponent<Component1>(entity), i % 2 == 1);
+    }
+    ASSERT_FALSE(entities.isEntityValid(existing.back()));
+    for (uint32_t i = 0; i < created.size(); ++i) {
+        const auto entity = created[i];
+        ASSERT_EQ(entities.isEntityValid(entity), i % 4 != 0);
+        if (i % 4 != 0) {
+            ASSERT_NE(entities.getComponent<const Component1>(entity), nullptr);
+            ASSERT_EQ(entities.getComponent<const Component2>(entity)->value, Component2::str(i));
+        }
+    }
+}
+
+TEST(EntityManager, parallel_command_apply) {
+    mustache::WorldContext context;
+    context.dispatcher = std::make_shared<mustache::Dispatcher>(4u);
+    mustache::World world{context};
+    auto& entities = world.entities();
+    entities.setParallelCommandApply(true);
+    ASSERT_TRUE(entities.isParallelCommandApply());
+
+    constexpr uint32_t kCount = 10000;
+    for (uint32_t i = 0; i < kCount; ++i) {
+        (void) entities.create<Component0>();
+    }
+    entities.forEach([&entities](mustache::Entity entity, Component0& component) {
+        component.value = entity.id().toInt();
+        entities.assign<Component2>(entity, Component2::str(component.value));
+        const auto created = entities.create<Component1>();
+        entities.assign<Component0>(created, component.value + kCount);
+    }, mustache::JobRunMode::kParallel);
+
+    uint32_t moved = 0u;
+    uint32_t created = 0u;
+    entities.forEach([&](const Component0& c0, const Component1* c1, const Component2* c2) {
+        if (c1 != nullptr) {
+            ASSERT_GE(c0.value, kCount);
+            ASSERT_EQ(c2, nullptr);
+            ++created;
+        } else {
+            ASSERT_NE(c2, nullptr);
+            ASSERT_EQ(c2->value, Component2::str(c0.value));
+            ++moved;
+        }
+    }, mustache::JobRunMode::kCurrentThread);
+    ASSERT_EQ(moved, kCount);
+    ASSERT_EQ(created, kCount);
+}
+
+TEST(EntityManager, parallel_command_apply_in_place_assign) {
+    struct CheckJob : mustache::PerEntityJob<CheckJob> {
+        std::set<uint32_t> visited;
+        void operator() (mustache::Entity entity, const Component0&) {
+            visited.insert(entity.id().toInt());
+        }
+
+        mustache::ComponentIdMask checkMask() const noexcept {
+            return mustache::ComponentFactory::makeMask<Component0>();
+        }
+    };
+    mustache::WorldContext context;
+    context.dispatcher = std::make_shared<mustache::Dispatcher>(4u);
+    mustache::World world{context};
+    auto& entities = world.entities();
+    entities.setParallelCommandApply(true);
+
+    constexpr uint32_t kCount = 100000;
+    constexpr uint32_t kStep = 64;
+    std::vector<mustache::Entity> created;
+    for (uint32_t i = 0; i < kCount; ++i) {
+        created.push_back(entities.create<Component0>());
+    }
+    CheckJob job;
+    job.run(world, mustache::JobRunMode::kCurrentThread);
+    ASSERT_EQ(job.visited.size(), kCount);
+    world.update();
+
+    // components are assigned over alive ones, so rows stay in place and only versions are stamped
+    entities.forEach([&entities](mustache::Entity entity, const Component0&) {
+        if (entity.id().toInt() % kStep == 0u) {
+            entities.assign<Component0>(entity, kCount + entity.id().toInt());
+        }
+    }, mustache::JobRunMode::kParallel);
+
+    job.visited.clear();
+    job.run(world, mustache::JobRunMode::kCurrentThread);
+    ASSERT_LT(job.visited.size(), kCount);
+    for (uint32_t i = 0; i < kCount; i += kStep) {
+        ASSERT_EQ(job.visited.count(created[i].id().toInt()), 1u);
+        ASSERT_EQ(entities.getComponent<Component0>(created[i])->value, kCount + created[i].id().toInt());
+    }
+    ASSERT_LT(entities.getWorldVersionOfLastComponentUpdate<Component0>(created[mustache::VersionStorage::kBlockSize]),
+              entities.getWorldVersionOfLastComponentUpdate<Component0>(created[0]));
+}
+
+TEST(EntityManager, parallel_command_apply_world_callbacks) {
+    static std::thread::id unlocking_thread;
+    static std::atomic<bool> other_thread{false};
+    struct Spawner {
+        uint32_t value = 0u;
+        static void afterAssign(mustache::World& world) {
+            if (std::this_thread::get_id() != unlocking_thread) {
+                other_thread = true;
+            }
+            (void) world.entities().create<Component1>();
+        }
+    };
+    unlocking_thread = std::this_thread::get_id();
+    mustache::WorldContext context;
+    context.dispatcher = std::make_shared<mustache::Dispatcher>(4u);
+    mustache::World world{context};
+    auto& entities = world.entities();
+    entities.setParallelCommandApply(true);
+
+    constexpr uint32_t kCount = 10000;
+    for (uint32_t i = 0; i < kCount; ++i) {
+        (void) entities.create<Component0>();
+    }
+    // rows of Spawner archetype are filled by the unlocking thread, so afterAssign may create entities
+    entities.forEach([&entities](mustache::Entity entity, const Component0&) {
+        entities.assign<Spawner>(entity);
+        entities.assign<Component2>(entities.create<Component0>());
+    }, mustache::JobRunMode::kParallel);
+    ASSERT_FALSE(other_thread.load());
+
+    uint32_t spawners = 0u;
+    uint32_t spawned = 0u;
+    uint32_t moved = 0u;
+    entities.forEach([&](const Component1&) {
+        ++spawned;
+    }, mustache::JobRunMode::kCurrentThread);
+    entities.forEach([&](const Spawner&) {
+        ++spawners;
+    }, mustache::JobRunMode::kCurrentThread);
+    entities.forEach([&](const Component0&, const Component2&) {
+        ++moved;
+    }, mustache::JobRunMode::kCurrentThread);
+    ASSERT_EQ(spawners, kCount);
+    ASSERT_EQ(spawned, kCount);
+    ASSERT_EQ(moved, kCount);
+}
+
+TEST(EntityManager, coalesce_recorded_commands) {
+    static int32_t constructed = 0;
+    static int32_t moved = 0;
+    static int32_t destroyed = 0;
+    struct Counted {
+        Counted() {
+            ++constructed;
+        }
+        Counted(Counted&&) noexcept {
+            ++moved;
+        }
+        Counted& operator=(Counted&&) noexcept {
+            ++moved;
+            return *this;
+        }
+        ~Counted() {
+            ++destroyed;
+        }
+    };
+
+    {
+        mustache::World world;
+        auto& entities = world.entities();
+
+        entities.lock();
+        const auto assigned = entities.create();
+        for (uint32_t i = 0; i < 3; ++i) {
+            entities.assign<Counted>(assigned);
+        }
+        const auto removed = entities.create<Component0>();
+        entities.assign<Counted>(removed);
+        entities.removeComponent<Counted>(removed);
+        const auto destroyed_entity = entities.create<Component0>();
+        entities.assign<Counted>(destroyed_entity);
+        entities.destroyNow(destroyed_entity);
+        // every dropped payload is destroyed at record time
+        ASSERT_EQ(constructed - destroyed, 1);
+        entities.unlock();
+
+        ASSERT_EQ(moved, 1);
+        ASSERT_EQ(constructed + moved - destroyed, 1);
+        ASSERT_TRUE(entities.hasComponent<Counted>(assigned));
+        ASSERT_FALSE(entities.hasComponent<Counted>(removed));
+        ASSERT_TRUE(entities.hasComponent<Component0>(removed));
+        ASSERT_FALSE(entities.isEntityValid(destroyed_entity));
+        ASSERT_EQ(entities.getArchetype<Component0>().size(), 1u);
+    }
+    ASSERT_EQ(constructed + moved, destroyed);
+}
+
+TEST(EntityManager, temporal_storage_arena) {
+    struct alignas(64) Aligned {
+        uint32_t value = 7u;
+    };
+    mustache::World world;
+    auto& entities = world.entities();
+    std::vector<mustache::Entity> arr;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        arr.push_back(entities.create<Component0>());
+    }
+
+    const auto record = [&] {
+        entities.lock();
+        for (const auto entity : arr) {
+            auto& aligned = entities.assign<Aligned>(entity);
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(&aligned) % alignof(Aligned), 0u);
+            entities.assign<Component2>(entity);
+        }
+        ASSERT_GE(entities.temporalStorageStatistics().used, arr.size() * (sizeof(Aligned) + sizeof(Component2)));
+        entities.unlock();
+        for (const auto entity : arr) {
+            entities.removeComponent<Aligned>(entity);
+            entities.removeComponent<Component2>(entity);
+        }
+    };
+
+    record();
+    // chunks are coalesced into one chunk of high-water mark size
+    const auto after_first_frame = entities.temporalStorageStatistics();
+    ASSERT_EQ(after_first_frame.used, 0u);
+    ASSERT_EQ(after_first_frame.chunk_count, 1u);
+    ASSERT_GE(after_first_frame.capacity, after_first_frame.high_water_mark);
+
+    record();
+    record();
+    const auto steady = entities.temporalStorageStatistics();
+    ASSERT_EQ(steady.chunk_allocations, after_first_frame.chunk_allocations);
+    ASSERT_EQ(steady.capacity, after_first_frame.capacity);
+}
@@ -2,6 +2,8 @@
 #include <mustache/ecs/world.hpp>
 #include <mustache/ecs/system.hpp>
 #include <mustache/ecs/job.hpp>
+#include <atomic>
+#include <stdexcept>
 
 namespace {
     std::vector<size_t> systems_updated;
@@ -78,3 +80,192 @@ TEST(System, system_order) {
     };
     ASSERT_EQ(expected_order, systems_updated);
 }
+
+namespace {
+    template<size_t _I>
+    struct AccessComponent {
+        uint32_t value = 0u;
+    };
+
+    struct AccessLog {
+        std::atomic<uint32_t> first_written{0u};
+        std::atomic<uint32_t> observed{0u};
+        std::atomic<uint32_t> updates{0u};
+        std::atomic<bool> locked_in_declared{true};
+        std::atomic<bool> unlocked_in_exclusive{true};
+    };
+
+    template<size_t _Write, size_t _Read = 1024u>
+    struct AccessSystem : public mustache::System<AccessSystem<_Write, _Read> > {
+        explicit AccessSystem(AccessLog& log):
+            log_{log} {
+
+        }
+        void onConfigure(mustache::World&, mustache::SystemConfig& config) override {
+            config.priority = 3 - static_cast<int32_t>(_Write); // sequential order: writers, reader, exclusive
+            config.writes<AccessComponent<_Write> >();
+            if constexpr (_Read != 1024u) {
+                config.reads<AccessComponent<_Read> >();
+            }
+        }
+        void onUpdate(mustache::World& world) override {
+            if (_Write == 0u) {
+                log_.first_written = 1u;
+            }
+            if (_Read == 0u) {
+                log_.observed = log_.first_written.load();
+            }
+            if (!world.entities().isLocked()) {
+                log_.locked_in_declared = false;
+            }
+            ++log_.updates;
+        }
+        AccessLog& log_;
+    };
+
+    struct ExclusiveSystem : public mustache::System<ExclusiveSystem> {
+        explicit ExclusiveSystem(AccessLog& log):
+            log_{log} {
+
+        }
+        void onUpdate(mustache::World& world) override {
+            if (world.entities().isLocked()) {
+                log_.unlocked_in_exclusive = false;
+            }
+            ++log_.updates;
+        }
+        AccessLog& log_;
+    };
+
+    struct CreateLog {
+        mustache::Entity created;
+        std::atomic<uint32_t> seen{0u};
+    };
+
+    struct CreatorSystem : public mustache::System<CreatorSystem> {
+        explicit CreatorSystem(CreateLog& log):
+            log_{log} {
+
+        }
+        void onConfigure(mustache::World&, mustache::SystemConfig& config) override {
+            config.priority = 1;
+            config.writes<AccessComponent<5> >();
+        }
+        void onUpdate(mustache::World& world) override {
+            log_.created = world.entities().create<AccessComponent<5> >();
+        }
+        CreateLog& log_;
+    };
+
+    struct WatcherSystem : public mustache::System<WatcherSystem> {
+        explicit WatcherSystem(CreateLog& log):
+            log_{log} {
+
+        }
+        void onConfigure(mustache::World&, mustache::SystemConfig& config) override {
+            config.reads<AccessComponent<5> >();
+        }
+        void onUpdate(mustache::World& world) override {
+            if (world.entities().hasComponent<AccessComponent<5> >(log_.created)) {
+                ++log_.seen;
+            }
+        }
+        CreateLog& log_;
+    };
+
+    struct ThrowingSystem : public mustache::System<ThrowingSystem> {
+        void onConfigure(mustache::World&, mustache::SystemConfig& config) override {
+            config.priority = 1;
+            config.writes<AccessComponent<7> >();
+        }
+        void onUpdate(mustache::World& world) override {
+            (void) world.entities().create<AccessComponent<7> >();
+            throw std::runtime_error("system failed");
+        }
+    };
+}
+
+TEST(System, parallel_update) {
+    using namespace mustache;
+    using Writer0 = AccessSystem<0>;
+    using Writer1 = AccessSystem<1>;
+    using Reader0 = AccessSystem<2, 0>;
+
+    WorldContext context;
+    context.dispatcher = std::make_shared<Dispatcher>(3u);
+    World world{context};
+    AccessLog log;
+    world.systems().addSystem<Writer0>(log);
+    world.systems().addSystem<Writer1>(log);
+    world.systems().addSystem<Reader0>(log);
+    world.systems().addSystem<ExclusiveSystem>(log);
+    world.systems().setParallelUpdate(true);
+    ASSERT_TRUE(world.systems().isParallelUpdate());
+    world.systems().init();
+
+    const auto edge = [](const std::string& from, const std::string& to) {
+        return "\"" + from + "\" -> \"" + to + "\";";
+    };
+    const auto graph = world.systems().dependencyGraph();
+    ASSERT_NE(graph.find(edge(Writer0::systemName(), Reader0::systemName())), std::string::npos);
+    ASSERT_EQ(graph.find(edge(Writer0::systemName(), Writer1::systemName())), std::string::npos);
+    ASSERT_EQ(graph.find(edge(Writer1::systemName(), Reader0::systemName())), std::string::npos);
+    // system without declared access conflicts with every system
+    ASSERT_NE(graph.find(edge(Writer1::systemName(), ExclusiveSystem::systemName())), std::string::npos);
+    ASSERT_NE(graph.find(edge(Reader0::systemName(), ExclusiveSystem::systemName())), std::string::npos);
+    // implied by Writer0 -> Reader0 -> ExclusiveSystem
+    ASSERT_EQ(graph.find(edge(Writer0::systemName(), ExclusiveSystem::systemName())), std::string::npos);
+
+    constexpr uint32_t kFrames = 100u;
+    for (uint32_t i = 0; i < kFrames; ++i) {
+        log.first_written = 0u;
+        log.observed = 0u;
+        world.update();
+        ASSERT_EQ(log.observed.load(), 1u);
+    }
+    ASSERT_EQ(log.updates.load(), 4u * kFrames);
+    ASSERT_TRUE(log.locked_in_declared.load());
+    ASSERT_TRUE(log.unlocked_in_exclusive.load());
+    ASSERT_FALSE(world.entities().isLocked());
+}
+
+TEST(System, parallel_update_applies_commands) {
+    using namespace mustache;
+    WorldContext context;
+    context.dispatcher = std::make_shared<Dispatcher>(3u);
+    World world{context};
+    CreateLog log;
+    AccessLog access_log;
+    world.systems().addSystem<CreatorSystem>(log);
+    world.systems().addSystem<WatcherSystem>(log);
+    world.systems().addSystem<AccessSystem<6> >(access_log); // independent of both
+    world.systems().setParallelUpdate(true);
+    world.systems().init();
+
+    constexpr uint32_t kFrames = 100u;
+    for (uint32_t i = 0; i < kFrames; ++i) {
+        world.update();
+        ASSERT_EQ(log.seen.load(), i + 1u);
+    }
+    ASSERT_EQ(access_log.updates.load(), kFrames);
+    ASSERT_EQ(world.entities().getArchetype<AccessComponent<5> >().size(), kFrames);
+}
+
+TEST(System, parallel_update_rethrows) {
+    using namespace mustache;
+    WorldContext context;
+    context.dispatcher = std::make_shared<Dispatcher>(3u);
+    World world{context};
+    AccessLog log;
+    world.systems().addSystem<ThrowingSystem>();
+    world.systems().addSystem<AccessSystem<8, 7> >(log); // after ThrowingSystem
+    world.systems().addSystem<AccessSystem<9> >(log); // independent
+    world.systems().setParallelUpdate(true);
+    world.systems().init();
+
+    ASSERT_THROW(world.update(), std::runtime_error);
+    ASSERT_FALSE(world.entities().isLocked());
+    // recorded commands are applied, successor of the failed system is skipped
+    ASSERT_EQ(world.entities().getArchetype<AccessComponent<7> >().size(), 1u);
+    ASSERT_EQ(log.updates.load(), 1u);
+}
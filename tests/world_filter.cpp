@@ -3,6 +3,7 @@
 #include <mustache/ecs/job.hpp>
 #include <mustache/utils/benchmark.hpp>
 #include <mustache/utils/dispatch.hpp>
+#include <set>
 
 namespace {
     template<size_t, size_t _Size = 256>
@@ -108,3 +109,51 @@ TEST(WorldFilter, chunk_version) {
     }
 
 }
+
+TEST(WorldFilter, block_version) {
+    constexpr uint32_t kNumObjects = 10000u;
+
+    struct CheckJob : mustache::PerEntityJob<CheckJob> {
+        std::set<uint32_t> visited;
+        void operator() (mustache::Entity entity, const Component<0>&) {
+            visited.insert(entity.id().toInt());
+        }
+
+        mustache::ComponentIdMask checkMask() const noexcept {
+            return mustache::ComponentFactory::makeMask<Component<0> >();
+        }
+    };
+    mustache::World world = mustache::World{mustache::WorldId::make(0)};
+    auto& entities = world.entities();
+    world.dispatcher().setSingleThreadMode(true);
+
+    std::vector<mustache::Entity> created;
+    for (uint32_t i = 0; i < kNumObjects; ++i) {
+        created.push_back(entities.create<Component<0> >());
+    }
+    CheckJob job;
+    job.run(world);
+    ASSERT_EQ(job.visited.size(), kNumObjects);
+    world.update();
+
+    job.visited.clear();
+    job.run(world);
+    ASSERT_TRUE(job.visited.empty());
+
+    // only blocks of changed entities are visited, not whole chunks
+    const uint32_t block_size = mustache::VersionStorage::kBlockSize;
+    const std::vector<uint32_t> changed {5u, 2000u, 2001u, kNumObjects - 1u};
+    for (auto index : changed) {
+        entities.getComponent<Component<0> >(created[index])->data[0] = std::byte{1};
+    }
+    job.visited.clear();
+    job.run(world);
+    const uint32_t last_block_size = kNumObjects % 1024u % block_size;
+    ASSERT_EQ(job.visited.size(), 2u * block_size + (last_block_size == 0u ? block_size : last_block_size));
+    for (auto index : changed) {
+        ASSERT_EQ(job.visited.count(created[index].id().toInt()), 1u);
+    }
+    ASSERT_EQ(job.visited.count(created[kNumObjects / 2u].id().toInt()), 0u);
+    ASSERT_LT(entities.getWorldVersionOfLastComponentUpdate<Component<0> >(created[1000u]),
+              entities.getWorldVersionOfLastComponentUpdate<Component<0> >(created[2000u]));
+}